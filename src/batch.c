@@ -0,0 +1,186 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <assert.h>
+#include "slab.h"
+#include "batch.h"
+
+#define BATCH_INITIAL_ROWS 64
+#define BATCH_INITIAL_LENGTH 4096
+
+/**************************************************************************//**
+ * @brief Frees memory space pointed by ptr.
+ * @param[in] ptr Pointer to batch object.
+ */
+void batch_free(void *ptr)
+{
+  if (ptr == NULL) return;
+  batch_t *obj = (batch_t *) ptr;
+
+  syslog(LOG_DEBUG, "removed batch [address=%p, table=%s, rows=%zu]",
+         ptr, obj->table->name, obj->num_rows);
+
+  slab_free(obj->offsets);
+  slab_free(obj->lengths);
+  slab_free(obj->data);
+  slab_free(obj);
+}
+
+/**************************************************************************//**
+ * @brief Allocate and initialize an empty batch.
+ * @param[in] table Destination table.
+ * @return Initialized object or NULL if error.
+ */
+batch_t* batch_alloc(table_t *table)
+{
+  if (table == NULL) {
+    assert(false);
+    return(NULL);
+  }
+
+  batch_t *ret = (batch_t *) slab_alloc(sizeof(batch_t));
+  if (ret == NULL) {
+    return(NULL);
+  }
+
+  ret->table = table;
+  ret->num_cols = table->parameters.size;
+  ret->num_rows = 0;
+  ret->max_rows = 0;
+  ret->offsets = NULL;
+  ret->lengths = NULL;
+  ret->data = NULL;
+  ret->data_length = 0;
+  ret->data_pos = 0;
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Doubles the number of allocated rows.
+ * @param[in,out] batch Batch object.
+ * @return 0=OK, otherwise=error.
+ */
+static int batch_grow(batch_t *batch)
+{
+  size_t max_rows = (batch->max_rows == 0 ? BATCH_INITIAL_ROWS : 2 * batch->max_rows);
+  size_t num = MAX(batch->num_cols, 1) * max_rows;
+
+  size_t *offsets = (size_t *) slab_alloc(num * sizeof(size_t));
+  int *lengths = (int *) slab_alloc(num * sizeof(int));
+  if (offsets == NULL || lengths == NULL) {
+    slab_free(offsets);
+    slab_free(lengths);
+    return(1);
+  }
+
+  for(size_t col=0; batch->num_rows > 0 && col<batch->num_cols; col++) {
+    memcpy(offsets + col * max_rows, batch->offsets + col * batch->max_rows, batch->num_rows * sizeof(size_t));
+    memcpy(lengths + col * max_rows, batch->lengths + col * batch->max_rows, batch->num_rows * sizeof(int));
+  }
+
+  slab_free(batch->offsets);
+  slab_free(batch->lengths);
+  batch->offsets = offsets;
+  batch->lengths = lengths;
+  batch->max_rows = max_rows;
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Appends a row to batch.
+ * @param[in,out] batch Batch object.
+ * @param[in] values Row values (one per column).
+ * @return 0=OK, otherwise=error.
+ */
+int batch_append(batch_t *batch, const value_t *values)
+{
+  if (batch == NULL || (batch->num_cols > 0 && values == NULL)) {
+    assert(false);
+    return(1);
+  }
+
+  if (batch->num_rows == batch->max_rows && batch_grow(batch) != 0) {
+    return(1);
+  }
+
+  // computing size to append (value + '\0')
+  size_t len = 0;
+  for(size_t col=0; col<batch->num_cols; col++) {
+    if (values[col].ptr != NULL) {
+      len += values[col].len + 1;
+    }
+  }
+
+  if (batch->data_pos + len > batch->data_length) {
+    size_t length = MAX(batch->data_length, BATCH_INITIAL_LENGTH);
+    while (length < batch->data_pos + len) {
+      length *= 2;
+    }
+    char *data = (char *) slab_realloc(batch->data, length);
+    if (data == NULL) {
+      return(1);
+    }
+    batch->data = data;
+    batch->data_length = length;
+  }
+
+  // setting values
+  for(size_t col=0; col<batch->num_cols; col++) {
+    const value_t *value = values + col;
+    size_t k = col * batch->max_rows + batch->num_rows;
+    if (value->ptr == NULL) {
+      batch->offsets[k] = 0;
+      batch->lengths[k] = -1;
+      continue;
+    }
+    batch->offsets[k] = batch->data_pos;
+    batch->lengths[k] = (int) value->len;
+    memcpy(batch->data + batch->data_pos, value->ptr, value->len);
+    batch->data_pos += value->len;
+    batch->data[batch->data_pos] = '\0';
+    batch->data_pos++;
+  }
+
+  batch->num_rows++;
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Returns a value of a batch.
+ * @param[in] batch Batch object.
+ * @param[in] row Row index.
+ * @param[in] col Column index.
+ * @return Value ('\0' ended), NULL if NULL value.
+ */
+const char* batch_value(const batch_t *batch, size_t row, size_t col)
+{
+  assert(row < batch->num_rows);
+  assert(col < batch->num_cols);
+
+  size_t k = col * batch->max_rows + row;
+  return(batch->lengths[k] < 0 ? NULL : batch->data + batch->offsets[k]);
+}
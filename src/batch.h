@@ -0,0 +1,69 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "format.h"
+#include "table.h"
+
+/**************************************************************************//**
+ * @brief Rows of a table to be persisted in DB (struct-of-arrays).
+ * @details Values are stored contiguously in data ('\0' ended). Each column
+ *          has its own range of the offsets and lengths arrays (stride is
+ *          max_rows), so writers get the values of a row (or the values of
+ *          a column) without parsing. Memory is allocated from slab.
+ * @details Use batch_value() to retrieve a value.
+ */
+typedef struct batch_t
+{
+  //! Destination table.
+  table_t *table;
+  //! Number of columns (table parameters).
+  size_t num_cols;
+  //! Number of rows.
+  size_t num_rows;
+  //! Allocated rows.
+  size_t max_rows;
+  //! Offset of values in data (num_cols x max_rows).
+  size_t *offsets;
+  //! Length of values (num_cols x max_rows, -1=NULL).
+  int *lengths;
+  //! Values storage.
+  char *data;
+  //! Allocated length of data.
+  size_t data_length;
+  //! Used length of data.
+  size_t data_pos;
+} batch_t;
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern batch_t* batch_alloc(table_t *table);
+extern void batch_free(void *obj);
+extern int batch_append(batch_t *batch, const value_t *values);
+extern const char* batch_value(const batch_t *batch, size_t row, size_t col);
+
+#endif
+
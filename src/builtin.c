@@ -0,0 +1,508 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "scan.h"
+#include "builtin.h"
+
+static const char *BUILTIN_NAMES[] = {
+    "httpd_combined",
+    "httpd_error",
+    "rfc3164",
+    "rfc5424",
+    "nginx_combined",
+    NULL
+};
+
+static const char *PARAMS_COMBINED[] = {
+    "hostname", "identd", "userid", "rtime", "request", "status", "bytes", "referer", "useragent", NULL
+};
+
+static const char *PARAMS_HTTPD_ERROR[] = {
+    "rtime", "loglevel", "pid", "ipaddress", "msg", NULL
+};
+
+static const char *PARAMS_RFC3164[] = {
+    "timestamp", "loghost", "app", "msg", NULL
+};
+
+static const char *PARAMS_RFC5424[] = {
+    "priority", "version", "timestamp", "hostname", "app", "procid", "msgid", "sd", "msg", NULL
+};
+
+/**************************************************************************//**
+ * @brief Checks if a character is a whitespace (as regex '\s').
+ * @param[in] c Character to check.
+ * @return true=whitespace, false=otherwise.
+ */
+static inline bool is_space(char c)
+{
+  return(c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v');
+}
+
+/**************************************************************************//**
+ * @brief Checks if a character is a digit.
+ * @param[in] c Character to check.
+ * @return true=digit, false=otherwise.
+ */
+static inline bool is_digit(char c)
+{
+  return(c >= '0' && c <= '9');
+}
+
+/**************************************************************************//**
+ * @brief Checks if a character is an ascii letter.
+ * @param[in] c Character to check.
+ * @return true=letter, false=otherwise.
+ */
+static inline bool is_alpha(char c)
+{
+  return((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
+}
+
+/**************************************************************************//**
+ * @brief Sets a value.
+ * @param[out] value Value to set.
+ * @param[in] ptr1 Value begin.
+ * @param[in] ptr2 Value end (not included).
+ */
+static inline void set_value(value_t *value, const char *ptr1, const char *ptr2)
+{
+  value->ptr = ptr1;
+  value->len = ptr2 - ptr1;
+}
+
+/**************************************************************************//**
+ * @brief Skips blanks (as regex '[ \t]+').
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @return true=at least one blank skipped, false=otherwise.
+ */
+static bool skip_blanks(const char **ptr, const char *end)
+{
+  const char *aux = *ptr;
+  while(aux < end && (*aux == ' ' || *aux == '\t')) aux++;
+  bool ret = (aux > *ptr);
+  *ptr = aux;
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Skips whitespaces (as regex '\s+').
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @return true=at least one whitespace skipped, false=otherwise.
+ */
+static bool skip_spaces(const char **ptr, const char *end)
+{
+  const char *aux = *ptr;
+  while(aux < end && is_space(*aux)) aux++;
+  bool ret = (aux > *ptr);
+  *ptr = aux;
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Skips a given character.
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @param[in] c Expected character.
+ * @return true=character skipped, false=otherwise.
+ */
+static inline bool skip_char(const char **ptr, const char *end, char c)
+{
+  if (*ptr >= end || **ptr != c) {
+    return(false);
+  }
+  (*ptr)++;
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Reads a non-empty token ended by c1 or c2 (as regex '[^c1c2]+').
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @param[in] c1 Token separator.
+ * @param[in] c2 Token separator.
+ * @param[out] value Token.
+ * @return true=OK, false=empty token.
+ */
+static bool take_token(const char **ptr, const char *end, char c1, char c2, value_t *value)
+{
+  const char *aux = scan_chr2(*ptr, end, c1, c2);
+  if (aux == *ptr) {
+    return(false);
+  }
+  set_value(value, *ptr, aux);
+  *ptr = aux;
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Reads content enclosed by delimiters (as regex '\[([^\]]*)\]').
+ * @param[in,out] ptr Current position (at opening delimiter).
+ * @param[in] end End of content.
+ * @param[in] open Opening delimiter.
+ * @param[in] close Closing delimiter.
+ * @param[in] empty Empty content allowed.
+ * @param[out] value Enclosed content.
+ * @return true=OK, false=KO.
+ */
+static bool take_enclosed(const char **ptr, const char *end, char open, char close, bool empty, value_t *value)
+{
+  if (!skip_char(ptr, end, open)) {
+    return(false);
+  }
+  const char *aux = memchr(*ptr, close, end - *ptr);
+  if (aux == NULL || (!empty && aux == *ptr)) {
+    return(false);
+  }
+  set_value(value, *ptr, aux);
+  *ptr = aux + 1;
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Reads the rest of current line (as multiline regex '.*$').
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @param[out] value Line content.
+ */
+static void take_line(const char **ptr, const char *end, value_t *value)
+{
+  const char *aux = memchr(*ptr, '\n', end - *ptr);
+  if (aux == NULL) {
+    aux = end;
+  }
+  set_value(value, *ptr, aux);
+  *ptr = aux;
+}
+
+/**************************************************************************//**
+ * @brief Reads a sequence of digits.
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @param[in] min Minimum number of digits.
+ * @param[in] max Maximum number of digits.
+ * @param[out] value Digits (can be NULL).
+ * @return true=OK, false=KO.
+ */
+static bool take_digits(const char **ptr, const char *end, size_t min, size_t max, value_t *value)
+{
+  const char *aux = *ptr;
+  while(aux < end && is_digit(*aux) && (size_t)(aux - *ptr) < max) aux++;
+  if ((size_t)(aux - *ptr) < min || (aux < end && is_digit(*aux))) {
+    return(false);
+  }
+  if (value != NULL) {
+    set_value(value, *ptr, aux);
+  }
+  *ptr = aux;
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Parses the combined log format.
+ * @details %h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-agent}i\"
+ * @see https://httpd.apache.org/docs/2.4/logs.html#accesslog
+ * @see http://nginx.org/en/docs/http/ngx_http_log_module.html#log_format
+ * @param[in] ptr Content to parse.
+ * @param[in] end End of content.
+ * @param[out] values Parsed values.
+ * @return 0=OK, otherwise=KO.
+ */
+static int parse_combined(const char *ptr, const char *end, value_t *values)
+{
+  // hostname, identd, userid
+  for(int i=0; i<3; i++) {
+    if (!take_token(&ptr, end, ' ', '\t', values+i) || !skip_blanks(&ptr, end)) return(1);
+  }
+  // [rtime]
+  if (!take_enclosed(&ptr, end, '[', ']', false, values+3) || !skip_blanks(&ptr, end)) return(1);
+  // "request"
+  if (!take_enclosed(&ptr, end, '"', '"', true, values+4) || !skip_blanks(&ptr, end)) return(1);
+  // status, bytes (digits or '-')
+  for(int i=5; i<7; i++) {
+    const char *aux = ptr;
+    while(ptr < end && (is_digit(*ptr) || *ptr == '-')) ptr++;
+    if (ptr == aux) return(1);
+    set_value(values+i, aux, ptr);
+    if (!skip_blanks(&ptr, end)) return(1);
+  }
+  // "referer" "useragent"
+  if (!take_enclosed(&ptr, end, '"', '"', true, values+7) || !skip_blanks(&ptr, end)) return(1);
+  if (!take_enclosed(&ptr, end, '"', '"', true, values+8)) return(1);
+  // trailing content is ignored
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Parses the apache error log format.
+ * @details [rtime] [loglevel] [pid] [ipaddress] msg
+ * @see https://httpd.apache.org/docs/2.4/mod/core.html#errorlogformat
+ * @param[in] ptr Content to parse.
+ * @param[in] end End of content.
+ * @param[out] values Parsed values.
+ * @return 0=OK, otherwise=KO.
+ */
+static int parse_httpd_error(const char *ptr, const char *end, value_t *values)
+{
+  for(int i=0; i<4; i++) {
+    if (!take_enclosed(&ptr, end, '[', ']', false, values+i) || !skip_blanks(&ptr, end)) return(1);
+  }
+  take_line(&ptr, end, values+4);
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Parses the BSD syslog format.
+ * @details [<pri>]Mmm dd hh:mm:ss loghost app[pid]: msg
+ *          Days with a single digit can be padded with a space.
+ * @see https://tools.ietf.org/html/rfc3164
+ * @param[in] ptr Content to parse.
+ * @param[in] end End of content.
+ * @param[out] values Parsed values.
+ * @return 0=OK, otherwise=KO.
+ */
+static int parse_rfc3164(const char *ptr, const char *end, value_t *values)
+{
+  // optional priority (as written by some relays)
+  if (ptr < end && *ptr == '<') {
+    ptr++;
+    if (!take_digits(&ptr, end, 1, 3, NULL) || !skip_char(&ptr, end, '>')) return(1);
+  }
+
+  // timestamp
+  const char *aux = ptr;
+  while(ptr < end && is_alpha(*ptr)) ptr++;
+  if (ptr == aux || !skip_char(&ptr, end, ' ')) return(1);
+  skip_char(&ptr, end, ' ');
+  if (!take_digits(&ptr, end, 1, 2, NULL) || !skip_char(&ptr, end, ' ')) return(1);
+  const char *aux2 = ptr;
+  while(ptr < end && (is_digit(*ptr) || *ptr == ':')) ptr++;
+  if (ptr == aux2) return(1);
+  set_value(values+0, aux, ptr);
+  if (!skip_spaces(&ptr, end)) return(1);
+
+  // loghost
+  aux = memchr(ptr, ' ', end - ptr);
+  if (aux == NULL || aux == ptr) return(1);
+  set_value(values+1, ptr, aux);
+  ptr = aux;
+  if (!skip_spaces(&ptr, end)) return(1);
+
+  // app (up to ':', '[' or whitespace)
+  aux = ptr;
+  while(ptr < end && *ptr != ':' && *ptr != '[' && !is_space(*ptr)) ptr++;
+  if (ptr == aux) return(1);
+  set_value(values+2, aux, ptr);
+
+  // skip up to ':' (eg. '[pid]')
+  aux = memchr(ptr, ':', end - ptr);
+  if (aux == NULL) return(1);
+  ptr = aux + 1;
+  if (!skip_spaces(&ptr, end)) return(1);
+
+  // msg
+  take_line(&ptr, end, values+3);
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Skips the syslog structured data.
+ * @details Param values are quoted strings where '"', '\' and ']' are escaped.
+ * @see https://tools.ietf.org/html/rfc5424#section-6.3
+ * @param[in,out] ptr Current position.
+ * @param[in] end End of content.
+ * @return true=OK, false=KO.
+ */
+static bool skip_structured_data(const char **ptr, const char *end)
+{
+  const char *aux = *ptr;
+
+  if (aux < end && *aux == '-') {
+    *ptr = aux + 1;
+    return(true);
+  }
+
+  if (aux >= end || *aux != '[') {
+    return(false);
+  }
+
+  while(aux < end && *aux == '[')
+  {
+    aux++;
+    while(true) {
+      aux = scan_chr2(aux, end, ']', '"');
+      if (aux >= end) {
+        return(false);
+      }
+      if (*aux == ']') {
+        aux++;
+        break;
+      }
+      // quoted param value
+      aux++;
+      while(true) {
+        aux = scan_chr2(aux, end, '"', '\\');
+        if (aux >= end) {
+          return(false);
+        }
+        if (*aux == '"') {
+          aux++;
+          break;
+        }
+        aux += 2;
+      }
+    }
+  }
+
+  *ptr = aux;
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Parses the IETF syslog format.
+ * @details <pri>version timestamp hostname app procid msgid sd [msg]
+ *          NILVALUES ('-') are preserved. Missing msg is NULL.
+ * @see https://tools.ietf.org/html/rfc5424
+ * @param[in] ptr Content to parse.
+ * @param[in] end End of content.
+ * @param[out] values Parsed values.
+ * @return 0=OK, otherwise=KO.
+ */
+static int parse_rfc5424(const char *ptr, const char *end, value_t *values)
+{
+  // <priority>version
+  if (!skip_char(&ptr, end, '<') || !take_digits(&ptr, end, 1, 3, values+0) || !skip_char(&ptr, end, '>')) return(1);
+  if (ptr >= end || *ptr == '0' || !take_digits(&ptr, end, 1, 3, values+1) || !skip_char(&ptr, end, ' ')) return(1);
+
+  // timestamp, hostname, app, procid, msgid
+  for(int i=2; i<7; i++) {
+    const char *aux = memchr(ptr, ' ', end - ptr);
+    if (aux == NULL || aux == ptr) return(1);
+    set_value(values+i, ptr, aux);
+    ptr = aux + 1;
+  }
+
+  // structured data
+  const char *aux = ptr;
+  if (!skip_structured_data(&ptr, end)) return(1);
+  set_value(values+7, aux, ptr);
+
+  // optional msg
+  values[8] = (value_t){NULL, 0};
+  if (ptr < end && *ptr == ' ') {
+    ptr++;
+    take_line(&ptr, end, values+8);
+  }
+  else if (ptr < end && *ptr != '\n') {
+    return(1);
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Returns the built-in format identifier.
+ * @param[in] name Built-in format name (eg. 'rfc3164').
+ * @return Built-in format or BUILTIN_NONE if not found.
+ */
+builtin_e builtin_find(const char *name)
+{
+  if (name == NULL) {
+    return(BUILTIN_NONE);
+  }
+
+  int i = 0;
+  while(BUILTIN_NAMES[i] != NULL && strcmp(BUILTIN_NAMES[i], name) != 0) i++;
+  return((builtin_e) i);
+}
+
+/**************************************************************************//**
+ * @brief Returns the built-in format name.
+ * @param[in] id Built-in format.
+ * @return Format name, NULL if none.
+ */
+const char* builtin_name(builtin_e id)
+{
+  return(id < BUILTIN_NONE ? BUILTIN_NAMES[id] : NULL);
+}
+
+/**************************************************************************//**
+ * @brief Returns the built-in format parameters.
+ * @param[in] id Built-in format.
+ * @return List of parameter names (NULL ended), NULL if none.
+ */
+const char** builtin_parameters(builtin_e id)
+{
+  switch(id) {
+    case BUILTIN_HTTPD_COMBINED:
+    case BUILTIN_NGINX_COMBINED:
+      return(PARAMS_COMBINED);
+    case BUILTIN_HTTPD_ERROR:
+      return(PARAMS_HTTPD_ERROR);
+    case BUILTIN_RFC3164:
+      return(PARAMS_RFC3164);
+    case BUILTIN_RFC5424:
+      return(PARAMS_RFC5424);
+    default:
+      return(NULL);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Extracts the parameter values of a chunk.
+ * @details Values reference the parsed content (zero-copy).
+ * @param[in] id Built-in format.
+ * @param[in] str Content to parse (not '\0' ended).
+ * @param[in] len Content length.
+ * @param[out] values Parameter values (sorted as builtin_parameters()).
+ * @return 0=OK, otherwise=malformed content.
+ */
+int builtin_extract(builtin_e id, const char *str, size_t len, value_t *values)
+{
+  if (str == NULL || values == NULL) {
+    assert(false);
+    return(1);
+  }
+
+  const char *end = str + len;
+
+  switch(id) {
+    case BUILTIN_HTTPD_COMBINED:
+    case BUILTIN_NGINX_COMBINED:
+      return parse_combined(str, end, values);
+    case BUILTIN_HTTPD_ERROR:
+      return parse_httpd_error(str, end, values);
+    case BUILTIN_RFC3164:
+      return parse_rfc3164(str, end, values);
+    case BUILTIN_RFC5424:
+      return parse_rfc5424(str, end, values);
+    default:
+      assert(false);
+      return(1);
+  }
+}
@@ -0,0 +1,54 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <stddef.h>
+#include "format.h"
+
+#define BUILTIN_MAX_PARAMS 16
+
+/**************************************************************************//**
+ * @brief Built-in formats.
+ * @details Hand-written scanners equivalent to the regexes of the sample
+ *          configuration file.
+ */
+typedef enum {
+  BUILTIN_HTTPD_COMBINED = 0,  // Apache combined log format.
+  BUILTIN_HTTPD_ERROR,         // Apache error log format.
+  BUILTIN_RFC3164,             // BSD syslog format.
+  BUILTIN_RFC5424,             // IETF syslog format.
+  BUILTIN_NGINX_COMBINED,      // Nginx combined log format.
+  BUILTIN_NONE
+} builtin_e;
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern builtin_e builtin_find(const char *name);
+extern const char* builtin_name(builtin_e id);
+extern const char** builtin_parameters(builtin_e id);
+extern int builtin_extract(builtin_e id, const char *str, size_t len, value_t *values);
+
+#endif
+
@@ -29,13 +29,15 @@
 #include <assert.h>
 #include "config.h"
 #include "table.h"
-#include "wdata.h"
+#include "batch.h"
+#include "slab.h"
 #include "utils.h"
 #include "database.h"
 
 #define MAX_NUM_PARAMS 100
 
 #define DEFAULT_MAX_INSERTS 1000
+#define MAX_POP_MSGS 64
 #define DEFAULT_MAX_DURATION 10000
 #define DEFAULT_IDLE_TIMEOUT 1000
 #define DEFAULT_RETRY_INTERVAL 30000
@@ -102,7 +104,9 @@ void database_reset(database_t *database)
   database->ts_idletimeout = 0;
   database->tables = NULL;
   database->mqueue = NULL;
-  vector_reset(&(database->pending), free);
+  database->pipeline = false;
+  vector_reset(&(database->pending), batch_free);
+  slab_flush();
 }
 
 /**************************************************************************//**
@@ -152,7 +156,9 @@ static bool database_create_stmts(database_t *database)
   // create prepared statements
   for(uint32_t i=0; i<database->tables->size; i++) {
     table_t *table = (table_t*)(database->tables->data[i]);
-    done &= database_prepare_stmt(database, table);
+    if (table->writer == database->writer) {
+      done &= database_prepare_stmt(database, table);
+    }
   }
 
   if (!done) {
@@ -200,10 +206,11 @@ static bool database_connect(database_t *database)
  * @param[in,out] database Database object.
  * @param[in] cfg Configuration file.
  * @param[in] tables List of tables.
+ * @param[in] writer Writer group.
  * @param[in] mqueue Message queue (processor -> database).
  * @return 0=OK, otherwise an error ocurred.
  */
-int database_init(database_t *database, const config_t *cfg, vector_t *tables, mqueue_t *mqueue)
+int database_init(database_t *database, const config_t *cfg, vector_t *tables, size_t writer, mqueue_t *mqueue)
 {
   if (database == NULL || database->status != DB_STATUS_UNINITIALIZED ||
       cfg == NULL || tables == NULL || mqueue == NULL) {
@@ -223,8 +230,10 @@ int database_init(database_t *database, const config_t *cfg, vector_t *tables, m
   database->ts_timeval = (struct timeval){0};
   database->status = DB_STATUS_UNINITIALIZED;
   database->tables = NULL;
+  database->writer = writer;
   database->mqueue = NULL;
   database->pending = (vector_t){0};
+  database->pipeline = false;
 
   // getting database entry in configuration file
   config_setting_t *parent = config_lookup(cfg, "database");
@@ -353,8 +362,14 @@ static bool database_commit(database_t *database)
     database->ts_numinserts = 0;
     database->ts_timeval = (struct timeval){0};
     database->status = DB_STATUS_CONNECTED;
-    vector_clear(&(database->pending), free);
-    syslog(LOG_DEBUG, "database - commit");
+    // rows are counted once committed (pending batches can be replayed)
+    for(uint32_t i=0; i<database->pending.size; i++) {
+      batch_t *batch = (batch_t *) database->pending.data[i];
+      atomic_fetch_add(&(batch->table->num_rows), batch->num_rows);
+    }
+    vector_clear(&(database->pending), batch_free);
+    slab_flush();
+    syslog(LOG_DEBUG, "database - commit [rows memory=%zu, peak=%zu]", slab_used(), slab_peak());
   }
 
   PQclear(res);
@@ -362,26 +377,136 @@ static bool database_commit(database_t *database)
 }
 
 /**************************************************************************//**
- * @brief Inserts data to database.
+ * @brief Inserts the rows of a batch one by one.
+ * @details Each insert waits for its result (one round-trip per row).
  * @param[in,out] database Database parameters.
- * @param[in] item Witem's data owner.
- * @param[in] ptr Table param values (sorted, separated by '\0').
+ * @param[in] batch Rows to insert.
+ * @return Number of inserted rows.
+ */
+static size_t database_exec_rows(database_t *database, batch_t *batch)
+{
+  table_t *table = batch->table;
+  int numParams = batch->num_cols;
+  const char *paramValues[MAX_NUM_PARAMS];
+  size_t num_rows = 0;
+
+  for(size_t row=0; row<batch->num_rows; row++)
+  {
+    for(int i=0; i<numParams; i++) {
+      paramValues[i] = batch_value(batch, row, i);
+    }
+
+    PGresult* res = PQexecPrepared(database->conn, table->name, numParams, paramValues, NULL, NULL, 0);
+    if (PQresultStatus(res) == PGRES_NONFATAL_ERROR) {
+      syslog(LOG_WARNING, "database - %s", PQerrorMessage(database->conn));
+    }
+    if (PQresultStatus(res) == PGRES_NONFATAL_ERROR || PQresultStatus(res) == PGRES_COMMAND_OK) {
+      num_rows++;
+      PQclear(res);
+    }
+    else {
+      database_process_error(database);
+      PQclear(res);
+      break;
+    }
+  }
+
+  return(num_rows);
+}
+
+/**************************************************************************//**
+ * @brief Inserts the rows of a batch in pipeline mode.
+ * @details All the inserts are sent before reading their results (one
+ *          round-trip per batch). Results of a batch (BATCH_MAX_ROWS
+ *          command tags) fit in the socket buffers, so blocking sends do
+ *          not deadlock. An error aborts the remaining inserts (and the
+ *          transaction). Rows are inserted one by one when libpq lacks
+ *          pipeline mode (libpq < 14).
+ * @see https://www.postgresql.org/docs/14/libpq-pipeline-mode.html
+ * @param[in,out] database Database parameters.
+ * @param[in] batch Rows to insert.
+ * @return Number of inserted rows.
+ */
+static size_t database_exec_pipeline(database_t *database, batch_t *batch)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+  table_t *table = batch->table;
+  int numParams = batch->num_cols;
+  const char *paramValues[MAX_NUM_PARAMS];
+  size_t num_rows = 0;
+
+  if (PQenterPipelineMode(database->conn) != 1) {
+    database_process_error(database);
+    return(0);
+  }
+
+  for(size_t row=0; row<batch->num_rows; row++)
+  {
+    for(int i=0; i<numParams; i++) {
+      paramValues[i] = batch_value(batch, row, i);
+    }
+
+    if (PQsendQueryPrepared(database->conn, table->name, numParams, paramValues, NULL, NULL, 0) != 1) {
+      database_process_error(database);
+      return(0);
+    }
+  }
+
+  if (PQpipelineSync(database->conn) != 1) {
+    database_process_error(database);
+    return(0);
+  }
+
+  // one result (followed by NULL) per insert
+  for(size_t row=0; row<batch->num_rows; row++)
+  {
+    PGresult *res = PQgetResult(database->conn);
+    ExecStatusType status = PQresultStatus(res);
+    PQclear(res);
+
+    if (status != PGRES_COMMAND_OK && status != PGRES_NONFATAL_ERROR) {
+      // connection is closed on error (pending results are dropped)
+      database_process_error(database);
+      return(num_rows);
+    }
+
+    num_rows++;
+    while((res = PQgetResult(database->conn)) != NULL) {
+      PQclear(res);
+    }
+  }
+
+  PGresult *res = PQgetResult(database->conn);
+  bool synced = (PQresultStatus(res) == PGRES_PIPELINE_SYNC);
+  PQclear(res);
+
+  if (!synced || PQexitPipelineMode(database->conn) != 1) {
+    database_process_error(database);
+  }
+
+  return(num_rows);
+#else
+  return(database_exec_rows(database, batch));
+#endif
+}
+
+/**************************************************************************//**
+ * @brief Inserts a batch of rows to database.
+ * @details Rows are inserted using the table prepared statement, one by
+ *          one or pipelined (see database_t::pipeline).
+ * @param[in,out] database Database parameters.
+ * @param[in] batch Rows to insert.
  * @return true=inserted, false=otherwise.
  */
-static bool database_exec(database_t *database, wdata_t *data)
+static bool database_exec(database_t *database, batch_t *batch)
 {
   assert(database != NULL);
-  assert(data != NULL);
+  assert(batch != NULL);
 
-  witem_t *item = data->item;
-  assert(item != NULL);
-  const char *ptr = &(data->x);
-  table_t *table = ((file_t *) item->ptr)->table;
+  table_t *table = batch->table;
   assert(table != NULL);
-  int numParams = table->parameters.size;
-  const char *paramValues[MAX_NUM_PARAMS];
 
-  vector_insert(&(database->pending), data);
+  vector_insert(&(database->pending), batch);
 
   // ensures that a transaction exists
   if (database->status == DB_STATUS_CONNECTED) {
@@ -391,30 +516,19 @@ static bool database_exec(database_t *database, wdata_t *data)
     return(false);
   }
 
-  syslog(LOG_DEBUG, "database - exec [table=%s, file=%s, values=%p]",
-         table->name, item->filename, (void *)(ptr));
+  syslog(LOG_DEBUG, "database - exec [table=%s, rows=%zu, batch=%p]",
+         table->name, batch->num_rows, (void *)(batch));
 
-  for(int i=0; i<numParams; i++) {
-    size_t len = strlen(ptr);
-    paramValues[i] = ptr;
-    ptr += len + 1;
-  }
+  struct timeval t1 = {0};
+  gettimeofday(&t1, NULL);
 
-  bool done = true;
-  PGresult* res = PQexecPrepared(database->conn, table->name, numParams, paramValues, NULL, NULL, 0);
-  if (PQresultStatus(res) == PGRES_NONFATAL_ERROR) {
-    syslog(LOG_WARNING, "database - %s", PQerrorMessage(database->conn));
-  }
-  if (PQresultStatus(res) == PGRES_NONFATAL_ERROR || PQresultStatus(res) == PGRES_COMMAND_OK) {
-    database->ts_numinserts++;
-  }
-  else {
-    database_process_error(database);
-    done = false;
-  }
+  size_t num_rows = (database->pipeline ? database_exec_pipeline(database, batch) :
+                                          database_exec_rows(database, batch));
+  database->ts_numinserts += num_rows;
 
-  PQclear(res);
-  return(done);
+  atomic_fetch_add(&(table->millis_exec), elapsed_millis(&t1));
+
+  return(database->status != DB_STATUS_ERROR);
 }
 
 /**************************************************************************//**
@@ -431,8 +545,8 @@ static bool database_process_pending(database_t *database)
   vector_swap(&aux, &(database->pending));
 
   for(uint32_t i=0; i<aux.size; i++) {
-    wdata_t *data = (wdata_t *) aux.data[i];
-    done = database_exec(database, data);
+    batch_t *batch = (batch_t *) aux.data[i];
+    done = database_exec(database, batch);
     if (!done) {
       break;
     }
@@ -534,29 +648,37 @@ void* database_run(void *ptr)
       database_reconnect(database);
     }
 
-    // waiting for a new message
-    msg_t msg = mqueue_pop(database->mqueue, millisToWait);
+    // waiting for new messages
+    msg_t msgs[MAX_POP_MSGS];
+    size_t num = mqueue_pop_n(database->mqueue, msgs, MAX_POP_MSGS, millisToWait);
 
-    // processing message
-    if (msg.type == MSG_TYPE_ERROR) {
-      terminate(EXIT_FAILURE);
-      break;
-    }
-    else if (msg.type == MSG_TYPE_CLOSE) {
-      break;
-    }
-    else if (msg.type == MSG_TYPE_EINTR || msg.type == MSG_TYPE_NULL) {
-      continue;
-    }
-    else if (msg.type == MSG_TYPE_TIMEOUT) {
-      database_commit(database);
+    // processing messages
+    if (num == 0) {
+      if (msgs[0].type == MSG_TYPE_ERROR) {
+        terminate(EXIT_FAILURE);
+        break;
+      }
+      else if (msgs[0].type == MSG_TYPE_CLOSE) {
+        break;
+      }
+      else if (msgs[0].type == MSG_TYPE_TIMEOUT) {
+        database_commit(database);
+      }
       continue;
     }
-    else {
-      assert(msg.type == MSG_TYPE_MATCH1);
-      wdata_t *data = (wdata_t *) msg.data;
-      assert(data != NULL);
-      database_exec(database, data);
+
+    // lanes are served by priority (see mqueue_init_lockfree_lanes)
+    for(size_t i=0; i<num; i++) {
+      assert(msgs[i].type == MSG_TYPE_BATCH);
+      batch_t *batch = (batch_t *) msgs[i].data;
+      assert(batch != NULL);
+      database_exec(database, batch);
+      // limits are checked per batch (a pop returns several batches)
+      if (database->status == DB_STATUS_TRANSACTION &&
+          (database->ts_numinserts >= database->ts_maxinserts ||
+           elapsed_millis(&(database->ts_timeval)) >= database->ts_maxduration)) {
+        database_commit(database);
+      }
     }
   }
 
@@ -565,6 +687,21 @@ void* database_run(void *ptr)
     database_commit(database);
   }
 
+  // queues are closed, pending rows are lost (see run)
+  if (database->pending.size > 0) {
+    syslog(LOG_ERR, "database - %u batches not committed at exit", database->pending.size);
+  }
+
+  // per table counters (identify the bottleneck)
+  for(uint32_t i=0; i<database->tables->size; i++) {
+    table_t *table = (table_t*)(database->tables->data[i]);
+    if (table->writer == database->writer) {
+      syslog(LOG_INFO, "database - table %s [writer=%s, rows=%zu, millis=%zu, deferred=%zu]",
+             table->name, table->writer_name, atomic_load(&(table->num_rows)),
+             atomic_load(&(table->millis_exec)), atomic_load(&(table->num_deferred)));
+    }
+  }
+
   syslog(LOG_DEBUG, "database - thread ended");
   return(NULL);
 }
@@ -40,7 +40,7 @@ typedef enum {
 } db_status_e;
 
 /**************************************************************************//**
- * @brief Database thread.
+ * @brief Database thread (one per writer group, see table_t::writer).
  */
 typedef struct database_t
 {
@@ -68,14 +68,18 @@ typedef struct database_t
   size_t ts_numinserts;
   //! List of tables.
   vector_t *tables;
-  //! List of wdata pending to commit.
+  //! Writer group (only tables of this writer are inserted).
+  size_t writer;
+  //! List of batches pending to commit.
   vector_t pending;
+  //! Inserts of a batch are pipelined (see database_exec_pipeline).
+  bool pipeline;
 } database_t;
 
 /**************************************************************************
  * Function declarations.
  */
-extern int database_init(database_t *database, const config_t *cfg, vector_t *tables, mqueue_t *mqueue);
+extern int database_init(database_t *database, const config_t *cfg, vector_t *tables, size_t writer, mqueue_t *mqueue);
 extern void* database_run(void *ptr);
 extern void database_reset(database_t *database);
 
@@ -36,24 +36,41 @@
 #define FILE_PARAM_FORMAT "format"
 #define FILE_PARAM_TABLE "table"
 #define FILE_PARAM_DISCARD "discard"
+#define FILE_PARAM_PRIORITY "priority"
+#define FILE_PARAM_ROTATED "rotated"
 
 static const char *FILE_PARAMS[] = {
     FILE_PARAM_PATH,
     FILE_PARAM_FORMAT,
     FILE_PARAM_TABLE,
     FILE_PARAM_DISCARD,
+    FILE_PARAM_PRIORITY,
+    FILE_PARAM_ROTATED,
     NULL
 };
 
+static const char *PRIORITY_NAMES[] = {
+    "high",
+    "normal",
+    "low",
+    NULL
+};
+
+// Share of each priority when all of them are backlogged (6:3:1).
+const int PRIORITY_WEIGHTS[PRIORITY_LEVELS] = {6, 3, 1};
+
 /**************************************************************************//**
  * @brief Allocate and initialize a wfile object.
  * @param[in] name File name.
  * @param[in] format Pointer to format.
  * @param[in] table Pointer to table.
  * @param[in] discard Discard filename (can be NULL).
+ * @param[in] priority File priority.
+ * @param[in] rotated Rotated files pattern (can be NULL).
  * @return Initialized object or NULL if error.
  */
-static file_t* wfile_alloc(const char *pattern, format_t *format, table_t *table, const char *discard)
+static file_t* wfile_alloc(const char *pattern, format_t *format, table_t *table, const char *discard,
+                           priority_e priority, const char *rotated)
 {
   assert(pattern != NULL);
   assert(format != NULL);
@@ -64,17 +81,22 @@ static file_t* wfile_alloc(const char *pattern, format_t *format, table_t *table
     return(NULL);
   }
 
-  syslog(LOG_DEBUG, "created wfile [address=%p, pattern=%s, format=%s, table=%s, discard=%s]",
-         (void *)ret, pattern, format->name, table->name, discard);
+  syslog(LOG_DEBUG, "created wfile [address=%p, pattern=%s, format=%s, table=%s, discard=%s, priority=%s, rotated=%s]",
+         (void *)ret, pattern, format->name, table->name, discard, PRIORITY_NAMES[priority], rotated);
 
   ret->pattern = strdup(pattern);
   ret->format = format;
   ret->table = table;
   ret->discard = NULL;
+  ret->priority = priority;
+  ret->rotated = NULL;
 
   if (discard != NULL) {
     ret->discard = strdup(discard);
   }
+  if (rotated != NULL) {
+    ret->rotated = strdup(rotated);
+  }
 
   return(ret);
 }
@@ -93,6 +115,7 @@ static void wfile_free(void *ptr)
 
   free(obj->pattern);
   free(obj->discard);
+  free(obj->rotated);
   free(ptr);
 }
 
@@ -144,10 +167,12 @@ void dir_free(void *ptr)
  * @param[in] format Pointer to format.
  * @param[in] table Pointer to table.
  * @param[in] discard Discard filename (can be NULL).
+ * @param[in] priority File priority.
+ * @param[in] rotated Rotated files pattern (can be NULL).
  * @return 0=OK, otherwise = an error ocurred.
  */
 static int dirs_add(vector_t *lst, const char *path, const char *pattern, format_t *format,
-                    table_t *table, const char *discard)
+                    table_t *table, const char *discard, priority_e priority, const char *rotated)
 {
   assert(lst != NULL);
   assert(path != NULL);
@@ -183,7 +208,7 @@ static int dirs_add(vector_t *lst, const char *path, const char *pattern, format
   // Adding the file pattern to directory. Every file creation
   // will be matched with the list of file patterns to determine
   // if the new file need to be watched.
-  file_t *file = wfile_alloc(pattern, format, table, discard);
+  file_t *file = wfile_alloc(pattern, format, table, discard, priority, rotated);
   vector_insert(&(dir->files), file);
 
 dirs_add_exit:
@@ -205,7 +230,15 @@ static int dirs_check_parameters(config_setting_t *setting, format_t *format, ta
 
   int rc = 0;
 
+  // structured formats accept any key (missing keys are NULL)
+  if (format->type == FORMAT_TYPE_JSON || format->type == FORMAT_TYPE_LOGFMT) {
+    return(0);
+  }
+
   for(uint32_t j=0; j<table->parameters.size; j++) {
+    if (table_meta_find(table->parameters.data[j]) != META_NONE) {
+      continue;
+    }
     bool found = false;
     for(uint32_t i=0; i<format->parameters.size; i++) {
       if (strcmp(format->parameters.data[i], table->parameters.data[j]) == 0) {
@@ -215,7 +248,7 @@ static int dirs_check_parameters(config_setting_t *setting, format_t *format, ta
     }
     if (!found) {
       config_setting_t *aux = config_setting_lookup(setting, FILE_PARAM_TABLE);
-      syslog(LOG_ERR, "error at %s:%d - parameter '%s' declared in table '%s' not found in '%s' format regex",
+      syslog(LOG_ERR, "error at %s:%d - parameter '%s' declared in table '%s' not found in '%s' format",
              config_setting_source_file(aux),
              config_setting_source_line(aux),
              (char*)(table->parameters.data[j]),
@@ -229,7 +262,7 @@ static int dirs_check_parameters(config_setting_t *setting, format_t *format, ta
 
 /**************************************************************************//**
  * @brief Parse a monitor entry and adds to list.
- * @detail setting format: { path="xxx"; format="yyy"; table="zzz" }
+ * @detail setting format: { path="xxx"; format="yyy"; table="zzz"; priority="high"; rotated="$FILENAME.*.gz" }
  * @param[in,out] list List of watched items.
  * @param[in] setting Configuration setting.
  * @param[in] formats List of user-defined formats.
@@ -250,6 +283,9 @@ static int dirs_parse(vector_t *lst, config_setting_t *setting, vector_t *format
   const char *format = NULL;
   const char *table = NULL;
   const char *discard = NULL;
+  const char *priority = NULL;
+  const char *rotated = NULL;
+  priority_e opriority = PRIORITY_NORMAL;
 
   // check attributes
   rc = setting_check_childs(setting, FILE_PARAMS);
@@ -280,6 +316,23 @@ static int dirs_parse(vector_t *lst, config_setting_t *setting, vector_t *format
   }
 
   config_setting_lookup_string(setting, "discard", &discard);
+  config_setting_lookup_string(setting, FILE_PARAM_ROTATED, &rotated);
+
+  config_setting_lookup_string(setting, FILE_PARAM_PRIORITY, &priority);
+  if (priority != NULL) {
+    int i = 0;
+    while (PRIORITY_NAMES[i] != NULL && strcmp(PRIORITY_NAMES[i], priority) != 0) i++;
+    if (PRIORITY_NAMES[i] == NULL) {
+      config_setting_t *aux = config_setting_lookup(setting, FILE_PARAM_PRIORITY);
+      syslog(LOG_ERR, "invalid file " FILE_PARAM_PRIORITY " '%s' at %s:%d.", priority,
+             config_setting_source_file(aux),
+             config_setting_source_line(aux));
+      rc = 1;
+    }
+    else {
+      opriority = (priority_e) i;
+    }
+  }
 
   if (rc != 0) {
     goto files_parse_item_exit;
@@ -345,7 +398,7 @@ static int dirs_parse(vector_t *lst, config_setting_t *setting, vector_t *format
 
   // adding directories and files
   for(int i=0; globbuf.gl_pathv[i]!=NULL; i++) {
-    dirs_add(lst, globbuf.gl_pathv[i], filepattern, oformat, otable, discard);
+    dirs_add(lst, globbuf.gl_pathv[i], filepattern, oformat, otable, discard, opriority, rotated);
   }
 
 files_parse_item_exit:
@@ -416,4 +469,3 @@ int dir_file_match(dir_t *dir, const char *name)
   }
   return(-1);
 }
-
@@ -28,6 +28,16 @@
 #include "table.h"
 #include "vector.h"
 
+/**************************************************************************//**
+ * @brief Priority of a file (lane index, see PRIORITY_WEIGHTS).
+ */
+typedef enum {
+  PRIORITY_HIGH = 0,
+  PRIORITY_NORMAL,
+  PRIORITY_LOW,
+  PRIORITY_LEVELS
+} priority_e;
+
 /**************************************************************************//**
  * @brief File defined in configuration file.
  * @details First member is 'char *' to be searchable.
@@ -42,6 +52,10 @@ typedef struct file_t
   table_t *table;
   //! Discard file pattern.
   char *discard;
+  //! Priority (processor scheduling and writer batch selection).
+  priority_e priority;
+  //! Rotated files pattern read before the file at startup (NULL=none).
+  char *rotated;
 } file_t;
 
 /**************************************************************************//**
@@ -56,6 +70,11 @@ typedef struct dir_t
   vector_t files;
 } dir_t;
 
+/**************************************************************************
+ * Public variables.
+ */
+extern const int PRIORITY_WEIGHTS[PRIORITY_LEVELS];
+
 /**************************************************************************
  * Function declarations.
  */
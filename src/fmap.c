@@ -0,0 +1,61 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <signal.h>
+#include <string.h>
+#include "fmap.h"
+
+//! Current SIGBUS guard of thread (NULL=none).
+_Thread_local sigjmp_buf *fmap_guard = NULL;
+
+/**************************************************************************//**
+ * @brief SIGBUS handler.
+ * @details Jumps to the thread guard. If not set, then the default action
+ *          is restored and the signal is raised again (core dump).
+ * @param[in] signum Signal number.
+ */
+static void fmap_sigbus(int signum)
+{
+  if (fmap_guard != NULL) {
+    siglongjmp(*fmap_guard, 1);
+  }
+
+  signal(signum, SIG_DFL);
+  raise(signum);
+}
+
+/**************************************************************************//**
+ * @brief Installs the SIGBUS handler.
+ * @details SA_NODEFER allows successive SIGBUS in the same thread without
+ *          saving the signal mask in sigsetjmp().
+ */
+void fmap_init(void)
+{
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = fmap_sigbus;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_NODEFER;
+
+  sigaction(SIGBUS, &sa, NULL);
+}
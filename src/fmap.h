@@ -0,0 +1,53 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef FMAP_H
+#define FMAP_H
+
+#include <setjmp.h>
+
+/**************************************************************************//**
+ * @brief Guard against SIGBUS when accessing memory-mapped files.
+ * @details A mapped page beyond the end of a truncated file raises SIGBUS.
+ *          Code accessing mapped memory sets the thread guard, and the
+ *          SIGBUS handler jumps back to it. Usage:
+ *
+ *            sigjmp_buf env;
+ *            sigjmp_buf *prev = fmap_guard;
+ *            if (sigsetjmp(env, 0) == 0) {
+ *              fmap_guard = &env;
+ *              // access mapped memory
+ *            }
+ *            else {
+ *              // file truncated
+ *            }
+ *            fmap_guard = prev;
+ */
+extern _Thread_local sigjmp_buf *fmap_guard;
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern void fmap_init(void);
+
+#endif
+
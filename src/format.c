@@ -27,23 +27,44 @@
 #include <assert.h>
 #include "config.h"
 #include "format.h"
+#include "builtin.h"
+#include "tstamp.h"
 
 #define FORMAT_PARAM_NAME "name"
+#define FORMAT_PARAM_TYPE "type"
+#define FORMAT_PARAM_BUILTIN "builtin"
 #define FORMAT_PARAM_MAXLENGTH "maxlength"
+#define FORMAT_PARAM_HARDLENGTH "hardlength"
+#define FORMAT_PARAM_BLOCKSIZE "blocksize"
 #define FORMAT_PARAM_STARTS "starts"
 #define FORMAT_PARAM_ENDS "ends"
 #define FORMAT_PARAM_VALUES "values"
+#define FORMAT_PARAM_TIMESTAMPS "timestamps"
 
 #define FORMAT_DEFAULT_MAXLENGTH 10000
+#define FORMAT_DEFAULT_BLOCKSIZE 16384
 #define MAX_NUM_PARAMS 99
 
 static const char *FORMAT_DEFAULT_ENDS = "\\n";
 static const char *FORMAT_PARAMS[] = {
     FORMAT_PARAM_NAME,
+    FORMAT_PARAM_TYPE,
+    FORMAT_PARAM_BUILTIN,
     FORMAT_PARAM_MAXLENGTH,
+    FORMAT_PARAM_HARDLENGTH,
+    FORMAT_PARAM_BLOCKSIZE,
     FORMAT_PARAM_STARTS,
     FORMAT_PARAM_ENDS,
     FORMAT_PARAM_VALUES,
+    FORMAT_PARAM_TIMESTAMPS,
+    NULL
+};
+
+static const char *FORMAT_TYPES[] = {
+    "regex",
+    "json",
+    "logfmt",
+    "builtin",
     NULL
 };
 
@@ -105,19 +126,27 @@ static int regex_get_parameters(pcre2_code *regex, vector_t *lst)
 /**************************************************************************//**
  * @brief Allocate and initialize a format object.
  * @param[in] name Format name.
+ * @param[in] type Format type.
+ * @param[in] builtin Built-in format (only if type is builtin).
  * @param[in] maxlength Maximum line length.
+ * @param[in] hardlength Maximum line length (growing buffer).
+ * @param[in] blocksize Read block size.
  * @param[in] re_starts Regular expression pattern.
  * @param[in] re_ends Regular expression pattern.
  * @param[in] re_values Regular expression pattern.
  * @return Initialized object or NULL if error.
  */
-static format_t* format_alloc(const char *name, size_t maxlength, pcre2_code *re_starts, pcre2_code *re_ends, pcre2_code *re_values,
+static format_t* format_alloc(const char *name, format_type_e type, builtin_e builtin, size_t maxlength, size_t hardlength, size_t blocksize,
+                              pcre2_code *re_starts, pcre2_code *re_ends, pcre2_code *re_values,
                               const char *pattern_starts, const char *pattern_ends, const char *pattern_values)
 {
   assert(name != NULL);
   assert(maxlength > 0);
+  assert(hardlength >= maxlength);
+  assert(blocksize > 0);
   assert(re_starts != NULL || re_ends != NULL);
-  assert(re_values != NULL);
+  assert(re_values != NULL || type != FORMAT_TYPE_REGEX);
+  assert(builtin != BUILTIN_NONE || type != FORMAT_TYPE_BUILTIN);
 
   format_t *ret = (format_t *) calloc(1, sizeof(format_t));
   if (ret == NULL) {
@@ -125,16 +154,29 @@ static format_t* format_alloc(const char *name, size_t maxlength, pcre2_code *re
   }
 
   ret->name = strdup(name);
+  ret->type = type;
+  ret->builtin = builtin;
   ret->maxlength = maxlength;
+  ret->hardlength = hardlength;
+  ret->blocksize = blocksize;
   ret->re_starts = re_starts;
   ret->re_ends = re_ends;
   ret->re_values = re_values;
   vector_reset(&(ret->parameters), NULL);
-  regex_get_parameters(re_values, &(ret->parameters));
+  vector_reset(&(ret->timestamps), NULL);
+  if (re_values != NULL) {
+    regex_get_parameters(re_values, &(ret->parameters));
+  }
+  if (type == FORMAT_TYPE_BUILTIN) {
+    const char **params = builtin_parameters(builtin);
+    for(int i=0; params[i]!=NULL; i++) {
+      vector_insert(&(ret->parameters), strdup(params[i]));
+    }
+  }
 
   char *str = vector_print(&(ret->parameters));
-  syslog(LOG_DEBUG, "created format [address=%p, name=%s, maxlength=%zu, starts=%s, ends=%s, values=%s, parameters=%s]",
-         (void *)ret, name, maxlength, pattern_starts, pattern_ends, pattern_values, str);
+  syslog(LOG_DEBUG, "created format [address=%p, name=%s, type=%s, builtin=%s, maxlength=%zu, hardlength=%zu, blocksize=%zu, starts=%s, ends=%s, values=%s, parameters=%s]",
+         (void *)ret, name, FORMAT_TYPES[type], builtin_name(builtin), maxlength, hardlength, blocksize, pattern_starts, pattern_ends, pattern_values, str);
   free(str);
 
   return(ret);
@@ -156,6 +198,7 @@ void format_free(void *ptr)
   pcre2_code_free(obj->re_ends);
   pcre2_code_free(obj->re_values);
   vector_reset(&(obj->parameters), free);
+  vector_reset(&(obj->timestamps), tstamp_param_free);
   free(obj);
 }
 
@@ -198,6 +241,69 @@ static pcre2_code* format_compile_regex(const char *pattern, const config_settin
   return(ret);
 }
 
+/**************************************************************************//**
+ * @brief Parse the timestamp parameters of a format.
+ * @details setting format: timestamps = { rtime = "clf"; ts = "epoch"; }
+ * @param[in,out] format Format object.
+ * @param[in] setting Format configuration setting.
+ * @return 0=OK, otherwise=KO.
+ */
+static int formats_parse_timestamps(format_t *format, const config_setting_t *setting)
+{
+  assert(format != NULL);
+  assert(setting != NULL);
+
+  int rc = 0;
+  config_setting_t *group = config_setting_get_member(setting, FORMAT_PARAM_TIMESTAMPS);
+  if (group == NULL) {
+    return(0);
+  }
+
+  if (config_setting_type(group) != CONFIG_TYPE_GROUP) {
+    syslog(LOG_ERR, "format " FORMAT_PARAM_TIMESTAMPS " is not a group at %s:%d.",
+           config_setting_source_file(group),
+           config_setting_source_line(group));
+    return(1);
+  }
+
+  for(int i=0; i<config_setting_length(group); i++)
+  {
+    config_setting_t *aux = config_setting_get_elem(group, i);
+    const char *param = config_setting_name(aux);
+    const char *layout_str = config_setting_get_string(aux);
+    tstamp_layout_e layout = tstamp_layout_find(layout_str);
+
+    if (layout == TSTAMP_NONE) {
+      syslog(LOG_ERR, "invalid timestamp layout '%s' at %s:%d.",
+             (layout_str==NULL?"":layout_str),
+             config_setting_source_file(aux),
+             config_setting_source_line(aux));
+      rc = 1;
+      continue;
+    }
+
+    // json and logfmt parameters are not known in advance
+    if ((format->type == FORMAT_TYPE_REGEX || format->type == FORMAT_TYPE_BUILTIN) &&
+        vector_find(&(format->parameters), param) < 0) {
+      syslog(LOG_ERR, "timestamp parameter '%s' not found in format at %s:%d.", param,
+             config_setting_source_file(aux),
+             config_setting_source_line(aux));
+      rc = 1;
+      continue;
+    }
+
+    tstamp_param_t *obj = (tstamp_param_t *) calloc(1, sizeof(tstamp_param_t));
+    if (obj == NULL) {
+      return(1);
+    }
+    obj->name = strdup(param);
+    obj->layout = layout;
+    vector_insert(&(format->timestamps), obj);
+  }
+
+  return(rc);
+}
+
 /**************************************************************************//**
  * @brief Parse a format entry and adds to table list.
  * @param[in,out] lst List of formats.
@@ -211,17 +317,27 @@ static int formats_parse_item(vector_t *lst, const config_setting_t *setting)
 
   int rc = 0;
   const char *name = NULL;
+  const char *type_str = NULL;
+  const char *builtin_str = NULL;
+  format_type_e type = FORMAT_TYPE_REGEX;
+  builtin_e builtin = BUILTIN_NONE;
   const char *pattern_starts = NULL;
   const char *pattern_ends = NULL;
   const char *pattern_values = NULL;
   size_t maxlength = FORMAT_DEFAULT_MAXLENGTH;
+  size_t hardlength = 0;
+  size_t blocksize = FORMAT_DEFAULT_BLOCKSIZE;
 
   // check attributes
   rc = setting_check_childs(setting, FORMAT_PARAMS);
 
   // retrieving attributes
   config_setting_lookup_string(setting, FORMAT_PARAM_NAME, &name);
+  config_setting_lookup_string(setting, FORMAT_PARAM_TYPE, &type_str);
+  config_setting_lookup_string(setting, FORMAT_PARAM_BUILTIN, &builtin_str);
   setting_read_uint(setting, FORMAT_PARAM_MAXLENGTH, &maxlength);
+  setting_read_uint(setting, FORMAT_PARAM_HARDLENGTH, &hardlength);
+  setting_read_uint(setting, FORMAT_PARAM_BLOCKSIZE, &blocksize);
   config_setting_lookup_string(setting, FORMAT_PARAM_STARTS, &pattern_starts);
   config_setting_lookup_string(setting, FORMAT_PARAM_ENDS, &pattern_ends);
   config_setting_lookup_string(setting, FORMAT_PARAM_VALUES, &pattern_values);
@@ -233,13 +349,65 @@ static int formats_parse_item(vector_t *lst, const config_setting_t *setting)
            config_setting_source_line(setting));
     rc = 1;
   }
-  if (pattern_values == NULL) {
+
+  // check format type
+  if (type_str != NULL) {
+    int i = 0;
+    while (FORMAT_TYPES[i] != NULL && strcmp(FORMAT_TYPES[i], type_str) != 0) i++;
+    if (FORMAT_TYPES[i] == NULL) {
+      config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_TYPE);
+      syslog(LOG_ERR, "invalid format " FORMAT_PARAM_TYPE " '%s' at %s:%d.", type_str,
+             config_setting_source_file(aux),
+             config_setting_source_line(aux));
+      rc = 1;
+    }
+    else {
+      type = (format_type_e) i;
+    }
+  }
+
+  // built-in formats (type is implicit)
+  if (builtin_str != NULL) {
+    builtin = builtin_find(builtin_str);
+    config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_BUILTIN);
+    if (builtin == BUILTIN_NONE) {
+      syslog(LOG_ERR, "invalid format " FORMAT_PARAM_BUILTIN " '%s' at %s:%d.", builtin_str,
+             config_setting_source_file(aux),
+             config_setting_source_line(aux));
+      rc = 1;
+    }
+    if (type_str != NULL && type != FORMAT_TYPE_BUILTIN) {
+      syslog(LOG_ERR, "format " FORMAT_PARAM_BUILTIN " not allowed in " FORMAT_PARAM_TYPE " '%s' at %s:%d.", type_str,
+             config_setting_source_file(aux),
+             config_setting_source_line(aux));
+      rc = 1;
+    }
+    type = FORMAT_TYPE_BUILTIN;
+  }
+  else if (type == FORMAT_TYPE_BUILTIN) {
+    config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_TYPE);
+    syslog(LOG_ERR, "format without " FORMAT_PARAM_BUILTIN " at %s:%d.",
+           config_setting_source_file(aux),
+           config_setting_source_line(aux));
+    rc = 1;
+  }
+
+  // values are only declared in regex formats
+  if (pattern_values == NULL && type == FORMAT_TYPE_REGEX) {
     config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_NAME);
     syslog(LOG_ERR, "format without " FORMAT_PARAM_VALUES " at %s:%d.",
            config_setting_source_file(aux),
            config_setting_source_line(aux));
     rc = 1;
   }
+  if (pattern_values != NULL && type != FORMAT_TYPE_REGEX) {
+    config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_VALUES);
+    syslog(LOG_ERR, "format of " FORMAT_PARAM_TYPE " '%s' does not accept " FORMAT_PARAM_VALUES " at %s:%d.",
+           FORMAT_TYPES[type],
+           config_setting_source_file(aux),
+           config_setting_source_line(aux));
+    rc = 1;
+  }
 
   // check maximum length
   if (maxlength < 32) {
@@ -250,6 +418,27 @@ static int formats_parse_item(vector_t *lst, const config_setting_t *setting)
     rc = 1;
   }
 
+  // check hard length (growing buffer)
+  if (hardlength == 0) {
+    hardlength = maxlength;
+  }
+  else if (hardlength < maxlength) {
+    config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_HARDLENGTH);
+    syslog(LOG_ERR, "format with " FORMAT_PARAM_HARDLENGTH " < " FORMAT_PARAM_MAXLENGTH " at %s:%d.",
+           config_setting_source_file(aux),
+           config_setting_source_line(aux));
+    rc = 1;
+  }
+
+  // check read block size
+  if (blocksize < 512) {
+    config_setting_t *aux = config_setting_get_member(setting, FORMAT_PARAM_BLOCKSIZE);
+    syslog(LOG_ERR, "format with " FORMAT_PARAM_BLOCKSIZE " < 512 at %s:%d.",
+           config_setting_source_file(aux),
+           config_setting_source_line(aux));
+    rc = 1;
+  }
+
   // check if event bounds are set
   if (pattern_starts == NULL && pattern_ends == NULL) {
     pattern_ends = FORMAT_DEFAULT_ENDS;
@@ -286,7 +475,7 @@ static int formats_parse_item(vector_t *lst, const config_setting_t *setting)
   }
 
   // create format
-  format_t *item = format_alloc(name, maxlength, re_starts, re_ends, re_values, pattern_starts, pattern_ends, pattern_values);
+  format_t *item = format_alloc(name, type, builtin, maxlength, hardlength, blocksize, re_starts, re_ends, re_values, pattern_starts, pattern_ends, pattern_values);
   if (item == NULL) {
     pcre2_code_free(re_starts);
     pcre2_code_free(re_ends);
@@ -305,6 +494,12 @@ static int formats_parse_item(vector_t *lst, const config_setting_t *setting)
     return(1);
   }
 
+  // timestamp parameters
+  if (formats_parse_timestamps(item, setting) != 0) {
+    format_free(item);
+    return(1);
+  }
+
   // append format to list
   rc = vector_insert(lst, item);
   if (rc != 0) {
@@ -29,7 +29,27 @@
 #include <pcre2.h>
 #include "vector.h"
 
+/**************************************************************************//**
+ * @brief Types of formats.
+ */
+typedef enum {
+  FORMAT_TYPE_REGEX = 0,  // Values captured by a regular expression.
+  FORMAT_TYPE_JSON,       // One JSON object per chunk.
+  FORMAT_TYPE_LOGFMT,     // Sequence of key=value pairs.
+  FORMAT_TYPE_BUILTIN     // Values extracted by a built-in scanner.
+} format_type_e;
 
+/**************************************************************************//**
+ * @brief Value extracted from a chunk.
+ * @details ptr=NULL means a NULL value (eg. missing key).
+ */
+typedef struct value_t
+{
+  //! Value content (not '\0' ended).
+  const char *ptr;
+  //! Value length.
+  size_t len;
+} value_t;
 
 /**************************************************************************//**
  * @brief Format defined in configuration file.
@@ -40,16 +60,26 @@ typedef struct format_t
 {
   //! Format name.
   char *name;
+  //! Format type.
+  format_type_e type;
+  //! Built-in format identifier (see builtin_e).
+  int builtin;
   //! Maximum length.
   size_t maxlength;
+  //! Maximum length of a chunk (buffer grows on demand up to it).
+  size_t hardlength;
+  //! Read block size (stdio reader).
+  size_t blocksize;
   //! Regular expression.
   pcre2_code *re_starts;
   //! Regular expression.
   pcre2_code *re_ends;
   //! Regular expression.
   pcre2_code *re_values;
-  //! Format parameters (strings).
+  //! Format parameters (strings, empty if json or logfmt).
   vector_t parameters;
+  //! Timestamp parameters (tstamp_param_t).
+  vector_t timestamps;
 } format_t;
 
 /**************************************************************************
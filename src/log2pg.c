@@ -27,6 +27,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/stat.h>
 #include <libconfig.h>
 #include <syslog.h>
 #include <pthread.h>
@@ -39,9 +42,15 @@
 #include "monitor.h"
 #include "processor.h"
 #include "database.h"
+#include "witem.h"
+#include "table.h"
+#include "utils.h"
+#include "batch.h"
+#include "slab.h"
 
 #define DEFAULT_CONFIG_FILE "/etc/" PACKAGE_NAME ".conf"
 #define QUEUE2_MAX_CAPACITY 32000
+#define ONCE_POLL_MILLIS 100
 
 /**************************************************************************
  * Public variables.
@@ -108,14 +117,17 @@ void set_signal_handlers(void)
 void help(void)
 {
   fprintf(stdout,
-    "Usage: " PACKAGE_NAME " [OPTION]...\n"
+    "Usage: " PACKAGE_NAME " [OPTION]... [FILE]...\n"
     "\n"
     "File forwarder to Postgresql database.\n"
     "\n"
     "Mandatory arguments to long options are mandatory for short options too.\n"
+    "  -b, --backfill      Process existing file contents in parallel (implies -s).\n"
     "  -d, --daemon        Run as daemon (detach from terminal).\n"
     "  -f, --file=CONFIG   Set configuration file (default = " DEFAULT_CONFIG_FILE ").\n"
     "  -h, --help          Show this message and exit.\n"
+    "  -o, --once          Process FILEs (default = configured files) up to EOF\n"
+    "                      and exit, printing a throughput summary (implies -b).\n"
     "  -s, --seek0         Process also existing file contents.\n"
     "      --version       Show version info and exit.\n"
     "\n"
@@ -143,14 +155,168 @@ void version(void)
   );
 }
 
+/**************************************************************************//**
+ * @brief Adds a file to the list of files processed once.
+ * @param[in,out] items List of witems.
+ * @param[in] filename Real filename with absolute path.
+ * @param[in] file Files entry matching the filename.
+ * @return 0=OK (or already added), otherwise=file can not be read.
+ */
+static int once_add(vector_t *items, const char *filename, file_t *file)
+{
+  for(uint32_t i=0; i<items->size; i++) {
+    if (strcmp(((witem_t *) items->data[i])->filename, filename) == 0) {
+      return(0);
+    }
+  }
+
+  struct stat st;
+  witem_t *item = witem_alloc(filename, WITEM_FILE, file, true);
+  if (item == NULL) {
+    syslog(LOG_ERR, "cannot access file %s", filename);
+    return(1);
+  }
+
+  // read in backfill mode up to the current size (see processor_backfill)
+  if (item->pid == 0 && fstat(fileno(item->file), &st) == 0) {
+    item->backfill_end = st.st_size;
+  }
+
+  vector_insert(items, item);
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Collects the files processed once (--once).
+ * @details Given files must match a configured files entry. Without given
+ *          files, the configured files entries are globbed.
+ * @param[out] items List of witems.
+ * @param[in] dirs User defined dir/patterns declared in config file.
+ * @param[in] filenames Given files (NULL terminated, NULL=configured files).
+ * @return 0=OK, otherwise=some file can not be processed.
+ */
+static int once_files(vector_t *items, const vector_t *dirs, char * const *filenames)
+{
+  int rc = 0;
+
+  for(size_t k=0; filenames != NULL && filenames[k] != NULL; k++)
+  {
+    char *filename = realpath(filenames[k], NULL);
+    char *name = (filename == NULL ? NULL : strrchr(filename, '/'));
+    int num = 0;
+
+    for(uint32_t i=0; name != NULL && i<dirs->size && num == 0; i++) {
+      dir_t *dir = (dir_t *) dirs->data[i];
+      size_t len = strlen(dir->path);
+      int pos = -1;
+      if (len == (size_t)(name - filename) && strncmp(dir->path, filename, len) == 0) {
+        pos = dir_file_match(dir, name + 1);
+      }
+      if (pos >= 0) {
+        rc |= once_add(items, filename, (file_t *) dir->files.data[pos]);
+        num++;
+      }
+    }
+
+    if (num == 0) {
+      syslog(LOG_ERR, "file %s %s", filenames[k],
+             (filename == NULL ? "not found" : "does not match any files entry"));
+      rc = 1;
+    }
+    free(filename);
+  }
+
+  for(uint32_t i=0; filenames == NULL && i<dirs->size; i++)
+  {
+    dir_t *dir = (dir_t *) dirs->data[i];
+    for(uint32_t j=0; j<dir->files.size; j++)
+    {
+      file_t *file = (file_t *) dir->files.data[j];
+      char *pattern = concat(3, dir->path, "/", file->pattern);
+      glob_t globbuf = {0};
+      if (glob(pattern, GLOB_BRACE, NULL, &globbuf) == 0) {
+        for(size_t k=0; k<globbuf.gl_pathc; k++) {
+          if (is_readable_file(globbuf.gl_pathv[k])) {
+            rc |= once_add(items, globbuf.gl_pathv[k], file);
+          }
+        }
+      }
+      globfree(&globbuf);
+      free(pattern);
+    }
+  }
+
+  return(rc);
+}
+
+/**************************************************************************//**
+ * @brief Checks if the files processed once are completed.
+ * @details A file is completed when it is read up to EOF and it is not
+ *          queued (parsed rows are sent). Processing is completed when the
+ *          database threads have retrieved all the rows too (a closed
+ *          queue drops pending messages).
+ * @param[in] items List of witems.
+ * @param[in] mqueues Message queues (processor -> database, one per writer).
+ * @param[in] num_writers Number of writers.
+ * @return true=completed, false=otherwise.
+ */
+static bool once_done(const vector_t *items, mqueue_t *mqueues, size_t num_writers)
+{
+  for(uint32_t i=0; i<items->size; i++) {
+    witem_t *item = (witem_t *) items->data[i];
+    if (atomic_load(&(item->state)) != 0) {
+      return(false);
+    }
+    if (!ferror(item->file) && (item->pid == 0 ? item->backfill_end > 0 : !feof(item->file))) {
+      return(false);
+    }
+  }
+
+  for(size_t i=0; i<num_writers; i++) {
+    if (mqueue_length(mqueues + i) > 0) {
+      return(false);
+    }
+  }
+
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Displays the throughput summary of the files processed once.
+ * @param[in] items List of witems.
+ * @param[in] tables List of tables.
+ * @param[in] t0 Starting time.
+ */
+static void once_summary(const vector_t *items, const vector_t *tables, const struct timeval *t0)
+{
+  long long bytes = 0;
+  size_t rows = 0;
+  double secs = (double) MAX(elapsed_millis(t0), 1) / 1000.0;
+
+  for(uint32_t i=0; i<items->size; i++) {
+    bytes += atomic_load(&(((witem_t *) items->data[i])->read_offset));
+  }
+  for(uint32_t i=0; i<tables->size; i++) {
+    rows += atomic_load(&(((table_t *) tables->data[i])->num_rows));
+  }
+
+  syslog(LOG_INFO, "processed %u files [bytes=%lld, rows=%zu, millis=%zu]",
+         items->size, bytes, rows, elapsed_millis(t0));
+  fprintf(stdout, "%u files, %lld bytes, %zu rows in %.3f s (%.1f MB/s, %.0f rows/s)\n",
+          items->size, bytes, rows, secs, (double) bytes / (secs * 1048576.0), (double) rows / secs);
+}
+
 /**************************************************************************//**
  * @brief Executes parsing + monitoring + writing.
  * @param[in] filename Configuration filename.
  * @param[in] daemonize Daemonize process.
  * @param[in] seek0 Process files from start or not.
+ * @param[in] backfill Backfill existing file contents (see processor_backfill).
+ * @param[in] once Process files up to EOF and exit (no monitor).
+ * @param[in] filenames Files processed once (NULL terminated, NULL=configured files).
  * @return 0=OK, otherwise=KO.
  */
-int run(const char *filename, bool daemonize, bool seek0)
+int run(const char *filename, bool daemonize, bool seek0, bool backfill, bool once, char * const *filenames)
 {
   log_t log = {0};
   config_t cfg = {0};
@@ -158,13 +324,18 @@ int run(const char *filename, bool daemonize, bool seek0)
   vector_t tables = {0};
   vector_t dirs = {0};
   mqueue_t mqueue1 = {0};
-  mqueue_t mqueue2 = {0};
+  mqueue_t *mqueues = NULL;
   monitor_t monitor = {0};
   processor_t processor = {0};
-  database_t database = {0};
+  database_t *databases = NULL;
+  size_t num_writers = 0;
+  vector_t items = {0};
+  int items_rc = 0;
+  struct timeval t0 = {0};
+  pthread_t thread_main = pthread_self();
   pthread_t thread_monitor;
-  pthread_t thread_processor;
-  pthread_t thread_database;
+  pthread_t *thread_processor = NULL;
+  pthread_t *thread_database = NULL;
 
   // read configuration file
   return_code = init_config(&cfg, filename);
@@ -178,43 +349,66 @@ int run(const char *filename, bool daemonize, bool seek0)
   loglevel = log.level;
 
   // initialize message queue between monitor-processor
-  return_code = mqueue_init(&mqueue1, "mqueue1", 0);
+  return_code = mqueue_init_lanes(&mqueue1, "mqueue1", 0, PRIORITY_WEIGHTS, PRIORITY_LEVELS);
   if (return_code != EXIT_SUCCESS) {
     syslog(LOG_CRIT, "error creating message queue monitor->processor (%d)", return_code);
     goto run_exit;
   }
 
-  // initialize message queue between processor-database
-  return_code = mqueue_init(&mqueue2, "mqueue2", QUEUE2_MAX_CAPACITY);
-  if (return_code != EXIT_SUCCESS) {
-    syslog(LOG_CRIT, "error creating message queue processor->database (%d)", return_code);
-    goto run_exit;
-  }
-
   // initializations
   return_code |= formats_init(&formats, &cfg);
   return_code |= tables_init(&tables, &cfg);
   return_code |= dirs_init(&dirs, &cfg, &formats, &tables);
-  return_code |= database_init(&database, &cfg, &tables, &mqueue2);
-  config_destroy(&cfg);
   if (return_code != EXIT_SUCCESS) {
     goto run_exit;
   }
 
-  // initialize processor object
-  return_code = processor_init(&processor, &mqueue1, &mqueue2);
-  if (return_code != EXIT_SUCCESS) {
-    syslog(LOG_CRIT, "error initializing processor");
+  // one queue + database connection per writer group
+  num_writers = tables_writers(&tables);
+  mqueues = (mqueue_t *) calloc(num_writers, sizeof(mqueue_t));
+  databases = (database_t *) calloc(num_writers, sizeof(database_t));
+  thread_database = (pthread_t *) calloc(num_writers, sizeof(pthread_t));
+  if (mqueues == NULL || databases == NULL || thread_database == NULL) {
+    return_code = EXIT_FAILURE;
     goto run_exit;
   }
 
-  // initialize monitor object
-  return_code = monitor_init(&monitor, &dirs, &mqueue1, seek0);
+  // initialize message queues between processor-database
+  for(size_t i=0; i<num_writers; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "mqueue2.%zu", i);
+    return_code = mqueue_init_lockfree_lanes(&mqueues[i], name, QUEUE2_MAX_CAPACITY, PRIORITY_WEIGHTS, PRIORITY_LEVELS);
+    if (return_code != EXIT_SUCCESS) {
+      syslog(LOG_CRIT, "error creating message queue processor->database (%d)", return_code);
+      goto run_exit;
+    }
+  }
+
+  for(size_t i=0; i<num_writers; i++) {
+    return_code |= database_init(&databases[i], &cfg, &tables, i, &mqueues[i]);
+    databases[i].pipeline = backfill || once;
+  }
+  return_code |= processor_init(&processor, &cfg, &mqueue1, mqueues, num_writers, backfill || once);
   if (return_code != EXIT_SUCCESS) {
-    syslog(LOG_CRIT, "error initializing monitor");
     goto run_exit;
   }
 
+  if (once) {
+    // files are read up to EOF without yielding the turn
+    processor.quantum = 0;
+    items_rc = once_files(&items, &dirs, filenames);
+    config_destroy(&cfg);
+  }
+  else {
+    // initialize monitor object
+    return_code = monitor_init(&monitor, &cfg, &dirs, &mqueue1, seek0 || backfill);
+    config_destroy(&cfg);
+    if (return_code != EXIT_SUCCESS) {
+      syslog(LOG_CRIT, "error initializing monitor");
+      goto run_exit;
+    }
+  }
+
   // detach from terminal
   if (daemonize) {
     daemon(1, 0);
@@ -223,37 +417,101 @@ int run(const char *filename, bool daemonize, bool seek0)
   // catching interruptions like ctrl-C
   set_signal_handlers();
 
-  return_code = pthread_create(&thread_database, NULL, database_run, &database);
-  if (return_code != EXIT_SUCCESS) {
-    syslog(LOG_ERR, "Error creating database thread");
-    goto run_exit;
+  for(size_t i=0; i<num_writers; i++) {
+    return_code = pthread_create(&thread_database[i], NULL, database_run, &databases[i]);
+    if (return_code != EXIT_SUCCESS) {
+      syslog(LOG_ERR, "Error creating database thread");
+      goto run_exit;
+    }
   }
 
-  return_code = pthread_create(&thread_processor, NULL, processor_run, &processor);
-  if (return_code != EXIT_SUCCESS) {
-    syslog(LOG_ERR, "Error creating processor thread");
+  thread_processor = (pthread_t *) calloc(processor.workers, sizeof(pthread_t));
+  if (thread_processor == NULL) {
+    return_code = EXIT_FAILURE;
     goto run_exit;
   }
 
-  return_code = pthread_create(&thread_monitor, NULL, monitor_run, &monitor);
-  if (return_code != EXIT_SUCCESS) {
-    syslog(LOG_ERR, "Error creating monitor thread");
-    goto run_exit;
+  for(size_t i=0; i<processor.workers; i++) {
+    return_code = pthread_create(&thread_processor[i], NULL, processor_run, &processor);
+    if (return_code != EXIT_SUCCESS) {
+      syslog(LOG_ERR, "Error creating processor thread");
+      goto run_exit;
+    }
+  }
+
+  if (once) {
+    // this thread receives signals that interrupts the wait
+    sigset_t signals_to_catch = {0};
+    sigaddset(&signals_to_catch, SIGINT);
+    sigaddset(&signals_to_catch, SIGABRT);
+    sigaddset(&signals_to_catch, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &signals_to_catch, NULL);
+    thread1 = &thread_main;
+
+    gettimeofday(&t0, NULL);
+    for(uint32_t i=0; i<items.size; i++) {
+      witem_t *item = (witem_t *) items.data[i];
+      if (witem_notify(item, false)) {
+        mqueue_push_lane(&mqueue1, witem_priority(item), MSG_TYPE_FILE0, item, 0);
+      }
+    }
+
+    struct timespec ts = {0, ONCE_POLL_MILLIS * 1000000L};
+    while(keep_running && !once_done(&items, mqueues, num_writers)) {
+      nanosleep(&ts, NULL);
+    }
+    if (!keep_running && return_code == EXIT_SUCCESS) {
+      return_code = EXIT_FAILURE;
+    }
+    mqueue_close(&mqueue1);
+  }
+  else {
+    return_code = pthread_create(&thread_monitor, NULL, monitor_run, &monitor);
+    if (return_code != EXIT_SUCCESS) {
+      syslog(LOG_ERR, "Error creating monitor thread");
+      goto run_exit;
+    }
+    thread1 = &thread_monitor;
   }
-  thread1 = &thread_monitor;
 
-  pthread_join(thread_database, NULL);
-  pthread_join(thread_processor, NULL);
-  pthread_join(thread_monitor, NULL);
+  for(size_t i=0; i<num_writers; i++) {
+    pthread_join(thread_database[i], NULL);
+    // rows not committed at exit (eg. last commit failed)
+    if (databases[i].pending.size > 0) {
+      return_code = EXIT_FAILURE;
+    }
+  }
+  for(size_t i=0; i<processor.workers; i++) {
+    pthread_join(thread_processor[i], NULL);
+  }
+  if (!once) {
+    pthread_join(thread_monitor, NULL);
+  }
   thread1 = NULL;
 
+  if (once) {
+    once_summary(&items, &tables, &t0);
+    return_code = (items_rc != 0 ? EXIT_FAILURE : return_code);
+  }
+
 run_exit:
   config_destroy(&cfg);
-  database_reset(&database);
+  for(size_t i=0; databases != NULL && i<num_writers; i++) {
+    database_reset(&databases[i]);
+  }
   processor_reset(&processor);
+  free(thread_processor);
   monitor_reset(&monitor);
+  vector_reset(&items, witem_free);
   mqueue_reset(&mqueue1, NULL);
-  mqueue_reset(&mqueue2, free);
+  for(size_t i=0; mqueues != NULL && i<num_writers; i++) {
+    mqueue_reset(&mqueues[i], batch_free);
+  }
+  free(mqueues);
+  free(databases);
+  free(thread_database);
+  syslog(LOG_DEBUG, "rows memory peak = %zu bytes", slab_peak());
+  slab_reset();
   vector_reset(&dirs, dir_free);
   vector_reset(&formats, format_free);
   vector_reset(&tables, table_free);
@@ -275,12 +533,14 @@ int main(int argc, char *argv[])
   // config filename
   char *filename = NULL;
   // short options
-  char* const options1 = "dhf:s" ;
+  char* const options1 = "bdhf:os" ;
   // long options (name + has_arg + flag + val)
   const struct option options2[] = {
+      { "backfill",     0,  NULL,  'b' },
       { "daemon",       0,  NULL,  'd' },
       { "file",         1,  NULL,  'f' },
       { "help",         0,  NULL,  'h' },
+      { "once",         0,  NULL,  'o' },
       { "seek0",        0,  NULL,  's' },
       { "version",      0,  NULL,  301 },
       { NULL,           0,  NULL,   0  }
@@ -289,6 +549,10 @@ int main(int argc, char *argv[])
   bool daemonize = false;
   // process all file contents
   bool seek0 = false;
+  // process existing file contents in parallel
+  bool backfill = false;
+  // process files up to EOF and exit
+  bool once = false;
 
   // parsing options
   while (1)
@@ -300,6 +564,10 @@ int main(int argc, char *argv[])
 
     switch(curropt)
     {
+      case 'b': // -b or --backfill (process existent file contents in parallel)
+        backfill = true;
+        break;
+
       case 'd': // -d or --daemon
         daemonize = true;
         break;
@@ -320,6 +588,10 @@ int main(int argc, char *argv[])
           goto main_exit;
           break;
 
+      case 'o': // -o or --once (process files and exit)
+          once = true;
+          break;
+
       case 's': // -s or --seek0 (process existent file contents)
           seek0 = true;
           break;
@@ -338,8 +610,8 @@ int main(int argc, char *argv[])
     }
   }
 
-  // check remaining arguments
-  if (argc != optind) {
+  // check remaining arguments (files processed once)
+  if (argc != optind && !once) {
     fprintf(stderr, "Error: unexpected argument found.\n");
     fprintf(stderr, "Try \"" PACKAGE_NAME " --help\" for more information.\n");
     rc = EXIT_FAILURE;
@@ -352,11 +624,10 @@ int main(int argc, char *argv[])
   }
 
   // running simulation
-  rc = run(filename, daemonize, seek0);
+  rc = run(filename, daemonize, seek0, backfill, once, (argc != optind ? argv + optind : NULL));
 
 main_exit:
   free(filename);
   closelog();
   return(rc==0?EXIT_SUCCESS:EXIT_FAILURE);
 }
-
@@ -28,22 +28,48 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <assert.h>
+#include "config.h"
 #include "witem.h"
 #include "utils.h"
 #include "monitor.h"
 
-#ifdef __GNUC__
-#  define ALIGNAS(TYPE) __attribute__ ((aligned(__alignof__(TYPE))))
-#else
-#  define ALIGNAS(TYPE) /* empty */
-#endif
-
 #define EVENT_SIZE (sizeof(struct inotify_event) + NAME_MAX + 1)
 #define BUFFER_LEN (256*(EVENT_SIZE))
+#define MAX_QUEUED_EVENTS_FILE "/proc/sys/fs/inotify/max_queued_events"
+#define DEFAULT_ROTATE_WAIT 5000
+#define DRAIN_POLL_MILLIS 10
+#define SEEN_KEY_LEN 40
+
+#define MONITOR_PARAM_WATCH "watch"
+#define MONITOR_PARAM_DEBOUNCE "debounce"
+#define MONITOR_PARAM_DEBOUNCE_BYTES "debounce-bytes"
+#define MONITOR_PARAM_BUFFER_SIZE "buffer-size"
+#define MONITOR_PARAM_MAX_QUEUED_EVENTS "max-queued-events"
+#define MONITOR_PARAM_ROTATE_WAIT "rotate-wait"
+
+static const char *MONITOR_PARAMS[] = {
+    MONITOR_PARAM_WATCH,
+    MONITOR_PARAM_DEBOUNCE,
+    MONITOR_PARAM_DEBOUNCE_BYTES,
+    MONITOR_PARAM_BUFFER_SIZE,
+    MONITOR_PARAM_MAX_QUEUED_EVENTS,
+    MONITOR_PARAM_ROTATE_WAIT,
+    NULL
+};
+
+static const char *WATCH_TYPES[] = {
+    "files",
+    "dirs",
+    NULL
+};
 
 /**************************************************************************//**
  * @brief Inotify codes.
@@ -53,6 +79,25 @@ typedef struct code_t {
   int value;
 } code_t;
 
+/**************************************************************************//**
+ * @brief File read since its directory is watched (see monitor_track).
+ */
+typedef struct seen_t
+{
+  //! Inode key (see seen_key).
+  char key[SEEN_KEY_LEN];
+  //! Directory where the file is.
+  const dir_t *dir;
+  //! Current file name (NULL=renamed, waiting its new name).
+  char *filename;
+  //! Rename cookie (see monitor_detach).
+  uint32_t cookie;
+  //! Event reads since it was renamed (see monitor_forget).
+  int age;
+  //! Found in its directory (see monitor_reconcile).
+  bool present;
+} seen_t;
+
 static code_t eventnames[] = {
   { "ACCESS", IN_ACCESS },
   { "MODIFY", IN_MODIFY },
@@ -72,14 +117,436 @@ static code_t eventnames[] = {
   { NULL, -1 }
 };
 
+/**************************************************************************//**
+ * @brief Returns a monotonic time in milliseconds.
+ * @return Milliseconds (greater than 0).
+ */
+static size_t monitor_millis(void)
+{
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((size_t) ts.tv_sec * 1000 + (size_t) ts.tv_nsec / 1000000 + 1);
+}
+
+/**************************************************************************//**
+ * @brief Returns the current size of a file.
+ * @param[in] filename File name.
+ * @return File size (0 if error).
+ */
+static off_t monitor_file_size(const char *filename)
+{
+  struct stat st;
+  return(stat(filename, &st) == 0 ? st.st_size : 0);
+}
+
+/**************************************************************************//**
+ * @brief Notifies a file change to processor.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] item Watched file.
+ */
+static void monitor_notify(monitor_t *monitor, witem_t *item)
+{
+  item->debounce_millis = 0;
+  if (witem_notify(item, false)) {
+    mqueue_push_lane(monitor->mqueue, witem_priority(item), MSG_TYPE_FILE0, item, 0);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Removes a file from the debounced list.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] item Watched file.
+ */
+static void monitor_undebounce(monitor_t *monitor, witem_t *item)
+{
+  if (item->debounce_millis == 0) {
+    return;
+  }
+
+  item->debounce_millis = 0;
+  for(uint32_t i=0; i<monitor->debounced.size; i++) {
+    if (monitor->debounced.data[i] == item) {
+      vector_remove(&(monitor->debounced), i, NULL);
+      break;
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Coalesces the changes of a file.
+ * @details The first change of a file is delayed up to debounce millis and
+ *          further changes are merged into it, so a process doing lots of
+ *          small writes wakes up the processor once per interval instead of
+ *          once per write. Changes are notified without delay when
+ *          debounce-bytes have been appended since the last notification
+ *          or when the file shrinks.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] item Watched file.
+ */
+static void monitor_debounce(monitor_t *monitor, witem_t *item)
+{
+  if (monitor->debounce == 0) {
+    monitor_notify(monitor, item);
+    return;
+  }
+
+  if (monitor->debounce_bytes > 0) {
+    off_t size = monitor_file_size(item->filename);
+    if (size < item->debounce_size || (size_t)(size - item->debounce_size) >= monitor->debounce_bytes) {
+      monitor_undebounce(monitor, item);
+      item->debounce_size = size;
+      monitor_notify(monitor, item);
+      return;
+    }
+  }
+
+  if (item->debounce_millis == 0) {
+    item->debounce_millis = monitor_millis();
+    vector_insert(&(monitor->debounced), item);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Notifies the debounced files whose delay has expired.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] all Notify all debounced files.
+ * @return Milliseconds until the next expiration (-1=none).
+ */
+static int monitor_flush(monitor_t *monitor, bool all)
+{
+  int ret = -1;
+  size_t now = monitor_millis();
+
+  for(int i=(int) monitor->debounced.size-1; i>=0; i--) {
+    witem_t *item = (witem_t *) monitor->debounced.data[i];
+    size_t deadline = item->debounce_millis + monitor->debounce;
+    if (all || deadline <= now) {
+      vector_remove(&(monitor->debounced), i, NULL);
+      if (monitor->debounce_bytes > 0) {
+        item->debounce_size = monitor_file_size(item->filename);
+      }
+      monitor_notify(monitor, item);
+    }
+    else if (ret < 0 || deadline - now < (size_t) ret) {
+      ret = (int) (deadline - now);
+    }
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Builds the key of a file in the seen map (device and inode).
+ * @param[out] key Key buffer (SEEN_KEY_LEN chars).
+ * @param[in] dev Device number.
+ * @param[in] ino Inode number.
+ */
+static void seen_key(char *key, dev_t dev, ino_t ino)
+{
+  snprintf(key, SEEN_KEY_LEN, "%jx:%jx", (uintmax_t) dev, (uintmax_t) ino);
+}
+
+/**************************************************************************//**
+ * @brief Deallocates a seen entry.
+ * @param[in] obj Seen entry to free.
+ */
+static void seen_free(void *obj)
+{
+  seen_t *seen = (seen_t *) obj;
+  if (seen == NULL) {
+    return;
+  }
+  free(seen->filename);
+  free(seen);
+}
+
+/**************************************************************************//**
+ * @brief Checks if a file is already watched (by inode, not by name).
+ * @details Renamed files keep their inode, so a file renamed to a name
+ *          matching a pattern (eg. app.log.1 to app.log.2) is not read
+ *          again, even if it was closed.
+ * @param[in] monitor Monitor parameters.
+ * @param[in] item Item watching the file name (can be NULL).
+ * @param[in] st File status.
+ * @return true=file is watched by item, by a rotated item or it was
+ *         already read (see monitor_track), false=otherwise.
+ */
+static bool monitor_is_watched(const monitor_t *monitor, const witem_t *item, const struct stat *st)
+{
+  if (item != NULL && witem_same_file(item, st)) {
+    return(true);
+  }
+
+  for(uint32_t i=0; i<monitor->rotated.size; i++) {
+    if (witem_same_file(monitor->rotated.data[i], st)) {
+      return(true);
+    }
+  }
+
+  char key[SEEN_KEY_LEN];
+  seen_key(key, st->st_dev, st->st_ino);
+  return(map_str_find(&(monitor->seen), key) != NULL);
+}
+
+/**************************************************************************//**
+ * @brief Removes a seen entry from the monitor lists and frees it.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] seen Entry to remove.
+ */
+static void monitor_remove_seen(monitor_t *monitor, seen_t *seen)
+{
+  if (seen->filename != NULL) {
+    map_str_remove(&(monitor->seen_names), seen->filename, NULL);
+  }
+  else {
+    for(uint32_t i=0; i<monitor->moved.size; i++) {
+      if (monitor->moved.data[i] == seen) {
+        vector_remove(&(monitor->moved), i, NULL);
+        break;
+      }
+    }
+  }
+  map_str_remove(&(monitor->seen), seen->key, seen_free);
+}
+
+/**************************************************************************//**
+ * @brief Forgets a file name (file deleted or name reused).
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] filename File name.
+ */
+static void monitor_untrack(monitor_t *monitor, const char *filename)
+{
+  seen_t *seen = (seen_t *) map_str_find(&(monitor->seen_names), filename);
+  if (seen != NULL) {
+    monitor_remove_seen(monitor, seen);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Attaches a seen entry to a new name.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] seen Entry (attached or waiting its new name).
+ * @param[in] dir Directory where the file is.
+ * @param[in] filename New file name (owned by the entry).
+ */
+static void monitor_rename_seen(monitor_t *monitor, seen_t *seen, const dir_t *dir, char *filename)
+{
+  if (seen->filename != NULL) {
+    map_str_remove(&(monitor->seen_names), seen->filename, NULL);
+    free(seen->filename);
+  }
+  else {
+    for(uint32_t i=0; i<monitor->moved.size; i++) {
+      if (monitor->moved.data[i] == seen) {
+        vector_remove(&(monitor->moved), i, NULL);
+        break;
+      }
+    }
+  }
+
+  // replaced file (rename over an existing name)
+  monitor_untrack(monitor, filename);
+  seen->filename = filename;
+  seen->dir = dir;
+  map_str_insert(&(monitor->seen_names), seen->filename, seen);
+}
+
+/**************************************************************************//**
+ * @brief Records that a file is read (see monitor_is_watched).
+ * @details Records are kept while the file remains in a watched directory,
+ *          whatever its name (see monitor_detach and monitor_attach).
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] dir Directory where the file was found.
+ * @param[in] filename File name.
+ * @param[in] st File status.
+ */
+static void monitor_track(monitor_t *monitor, const dir_t *dir, const char *filename, const struct stat *st)
+{
+  char key[SEEN_KEY_LEN];
+  seen_key(key, st->st_dev, st->st_ino);
+  if (map_str_find(&(monitor->seen), key) != NULL) {
+    return;
+  }
+
+  // name reused by another file
+  monitor_untrack(monitor, filename);
+
+  seen_t *seen = (seen_t *) calloc(1, sizeof(seen_t));
+  if (seen == NULL) {
+    return;
+  }
+
+  strcpy(seen->key, key);
+  seen->dir = dir;
+  seen->filename = strdup(filename);
+  if (seen->filename == NULL) {
+    free(seen);
+    return;
+  }
+
+  map_str_insert(&(monitor->seen), seen->key, seen);
+  map_str_insert(&(monitor->seen_names), seen->filename, seen);
+}
+
+/**************************************************************************//**
+ * @brief Detaches a renamed file from its name (IN_MOVED_FROM).
+ * @details The file is still known by inode until its new name is
+ *          reported (see monitor_attach) or the rename expires (see
+ *          monitor_forget).
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] filename Old file name.
+ * @param[in] cookie Rename cookie.
+ */
+static void monitor_detach(monitor_t *monitor, const char *filename, uint32_t cookie)
+{
+  seen_t *seen = (seen_t *) map_str_find(&(monitor->seen_names), filename);
+  if (seen == NULL) {
+    return;
+  }
+
+  map_str_remove(&(monitor->seen_names), filename, NULL);
+  free(seen->filename);
+  seen->filename = NULL;
+  seen->cookie = cookie;
+  seen->age = 0;
+  vector_insert(&(monitor->moved), seen);
+}
+
+/**************************************************************************//**
+ * @brief Attaches a renamed file to its new name (IN_MOVED_TO).
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] dir Directory where the file was moved to.
+ * @param[in] name New file name (without path).
+ * @param[in] cookie Rename cookie.
+ */
+static void monitor_attach(monitor_t *monitor, const dir_t *dir, const char *name, uint32_t cookie)
+{
+  for(uint32_t i=0; i<monitor->moved.size; i++) {
+    seen_t *seen = (seen_t *) monitor->moved.data[i];
+    if (seen->cookie != cookie) {
+      continue;
+    }
+    char *filename = concat(3, dir->path, "/", name);
+    if (filename != NULL) {
+      monitor_rename_seen(monitor, seen, dir, filename);
+    }
+    return;
+  }
+}
+
+/**************************************************************************//**
+ * @brief Forgets the files renamed out of the watched directories.
+ * @details Renames are reported by a pair of events (IN_MOVED_FROM and
+ *          IN_MOVED_TO) that can be split between two reads, so a detached
+ *          file is forgotten after the next read (the inode of a file no
+ *          longer watched can be reused by a new file).
+ * @param[in,out] monitor Monitor parameters.
+ */
+static void monitor_forget(monitor_t *monitor)
+{
+  for(int i=(int) monitor->moved.size-1; i>=0; i--) {
+    seen_t *seen = (seen_t *) monitor->moved.data[i];
+    if (seen->age++ > 0) {
+      vector_remove(&(monitor->moved), i, NULL);
+      map_str_remove(&(monitor->seen), seen->key, seen_free);
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Forgets the files of a directory (directory moved).
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] dir Directory.
+ */
+static void monitor_untrack_dir(monitor_t *monitor, const dir_t *dir)
+{
+  vector_t removed = {0};
+  map_str_bucket_t *bucket = NULL;
+  map_str_iterator_t it = {0};
+
+  while((bucket = map_str_next(&(monitor->seen), &it)) != NULL) {
+    seen_t *seen = (seen_t *) bucket->value;
+    if (seen->dir == dir) {
+      vector_insert(&removed, seen);
+    }
+  }
+
+  for(uint32_t i=0; i<removed.size; i++) {
+    monitor_remove_seen(monitor, removed.data[i]);
+  }
+  vector_reset(&removed, NULL);
+}
+
+/**************************************************************************//**
+ * @brief Updates the files read when events were lost (see monitor_rescan).
+ * @details Directories are read once. Files found are attached to their
+ *          current name, the others are forgotten.
+ * @param[in,out] monitor Monitor parameters.
+ */
+static void monitor_reconcile(monitor_t *monitor)
+{
+  vector_t removed = {0};
+  map_str_bucket_t *bucket = NULL;
+  map_str_iterator_t it = {0};
+
+  while((bucket = map_str_next(&(monitor->seen), &it)) != NULL) {
+    ((seen_t *) bucket->value)->present = false;
+  }
+
+  for(uint32_t i=0; i<monitor->dirs->size; i++) {
+    const dir_t *dir = (const dir_t *) monitor->dirs->data[i];
+    struct stat st;
+    DIR *dp = (stat(dir->path, &st) == 0 ? opendir(dir->path) : NULL);
+    struct dirent *entry = NULL;
+    while(dp != NULL && (entry = readdir(dp)) != NULL) {
+      char key[SEEN_KEY_LEN];
+      seen_key(key, st.st_dev, entry->d_ino);
+      seen_t *seen = (seen_t *) map_str_find(&(monitor->seen), key);
+      if (seen == NULL || seen->present) {
+        continue;
+      }
+      seen->present = true;
+      // renamed while events were lost
+      char *filename = concat(3, dir->path, "/", entry->d_name);
+      if (filename != NULL && (seen->filename == NULL || strcmp(seen->filename, filename) != 0)) {
+        monitor_rename_seen(monitor, seen, dir, filename);
+      }
+      else {
+        free(filename);
+      }
+    }
+    if (dp != NULL) {
+      closedir(dp);
+    }
+  }
+
+  it = (map_str_iterator_t){0};
+  while((bucket = map_str_next(&(monitor->seen), &it)) != NULL) {
+    seen_t *seen = (seen_t *) bucket->value;
+    if (!seen->present) {
+      vector_insert(&removed, seen);
+    }
+  }
+
+  for(uint32_t i=0; i<removed.size; i++) {
+    monitor_remove_seen(monitor, removed.data[i]);
+  }
+  vector_reset(&removed, NULL);
+}
+
 /**************************************************************************//**
  * @brief Add a inotify watch.
+ * @details When only directories are watched, files get a negative key
+ *          instead of a watch descriptor (IN_MODIFY is reported by the
+ *          directory watch, see process_event_dir).
  * @param[in,out] monitor Monitor parameters.
  * @param[in] item Item to monitor.
  * @param[in] freeonerror Free item if inotify fails to monitor it.
+ * @param[in] notify Notify the new file to processor (false when the
+ *            notification is deferred, see monitor_catchup).
  * @return 1=watch added succesfully, 0=otherwise.
  */
-static int monitor_add_watch(monitor_t *monitor, witem_t *item, bool freeonerror)
+static int monitor_add_watch(monitor_t *monitor, witem_t *item, bool freeonerror, bool notify)
 {
   assert(monitor != NULL);
   assert(monitor->ifd > 0);
@@ -95,31 +562,138 @@ static int monitor_add_watch(monitor_t *monitor, witem_t *item, bool freeonerror
   }
   else { // directory
     mask = IN_CREATE|IN_MOVE_SELF|IN_MOVED_FROM|IN_MOVED_TO|IN_EXCL_UNLINK|IN_ONLYDIR|IN_DELETE;
+    mask |= (monitor->watch_dirs ? IN_MODIFY : 0);
   }
 
-  wd = inotify_add_watch(monitor->ifd, item->filename, mask);
-  if (wd < 0) {
-    syslog(LOG_ALERT, "monitor - failed to monitor %s '%s' - %s",
-           (item->type==WITEM_DIR?"directory":"file"), item->filename, strerror(errno));
-    if (freeonerror) {
-      witem_free(item);
-    }
-    return(0);
+  if (item->type == WITEM_FILE && monitor->watch_dirs) {
+    // changes are reported by the directory watch
+    wd = --(monitor->last_key);
   }
   else {
-    item->wd = wd;
-    // update dictionaries for fast retrieval
-    map_int_insert(&(monitor->dict1), item->wd, item);
-    map_str_insert(&(monitor->dict2), item->filename, item);
-    // notifies to other threads that a new file is available
-    if (item->type == WITEM_FILE) {
-      mqueue_push(monitor->mqueue, MSG_TYPE_FILE0, item, true, 0);
-    }
-    // trace
-    syslog(LOG_INFO, "monitor - monitoring %s '%s' on WD #%d",
-           (item->type==WITEM_DIR?"directory":"file"), item->filename, wd);
-    return(1);
+    wd = inotify_add_watch(monitor->ifd, item->filename, mask);
+    if (wd < 0) {
+      syslog(LOG_ALERT, "monitor - failed to monitor %s '%s' - %s",
+             (item->type==WITEM_DIR?"directory":"file"), item->filename, strerror(errno));
+      if (freeonerror) {
+        witem_free(item);
+      }
+      return(0);
+    }
+  }
+
+  item->wd = wd;
+  // update dictionaries for fast retrieval
+  map_int_insert(&(monitor->dict1), item->wd, item);
+  map_str_insert(&(monitor->dict2), item->filename, item);
+  // notifies to other threads that a new file is available
+  if (item->type == WITEM_FILE) {
+    if (monitor->debounce_bytes > 0) {
+      item->debounce_size = monitor_file_size(item->filename);
+    }
+    if (notify) {
+      monitor_notify(monitor, item);
+    }
+  }
+  // trace
+  syslog(LOG_INFO, "monitor - monitoring %s '%s' on WD #%d",
+         (item->type==WITEM_DIR?"directory":"file"), item->filename, wd);
+  return(1);
+}
+
+/**************************************************************************//**
+ * @brief Compares rotated files by modification time (oldest first).
+ * @param[in] a Pointer to first filename.
+ * @param[in] b Pointer to second filename.
+ * @return <0 if a is older than b, 0 if same, >0 otherwise.
+ */
+static int rotated_cmp(const void *a, const void *b)
+{
+  const char *filename1 = *((const char **) a);
+  const char *filename2 = *((const char **) b);
+  struct stat st1 = {0};
+  struct stat st2 = {0};
+
+  stat(filename1, &st1);
+  stat(filename2, &st2);
+
+  if (st1.st_mtim.tv_sec != st2.st_mtim.tv_sec) {
+    return(st1.st_mtim.tv_sec < st2.st_mtim.tv_sec ? -1 : 1);
+  }
+  if (st1.st_mtim.tv_nsec != st2.st_mtim.tv_nsec) {
+    return(st1.st_mtim.tv_nsec < st2.st_mtim.tv_nsec ? -1 : 1);
   }
+  // logrotate numbering (app.log.2 is older than app.log.1)
+  return(strcmp(filename2, filename1));
+}
+
+/**************************************************************************//**
+ * @brief Reads the rotated files of a file before the file itself.
+ * @details The unread content of a file can already be in its rotated
+ *          files (eg. access.log.1, access.log.2.gz) after a downtime. They
+ *          are read oldest first (compressed ones are decompressed by a
+ *          child process), then the file is read. The file is owned by the
+ *          catch-up meanwhile (see processor_handover). The item is
+ *          claimed before its first notification, so that a queued
+ *          message never refers to an item released by the catch-up.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] item Watched file (just added, not notified yet).
+ */
+static void monitor_catchup(monitor_t *monitor, witem_t *item)
+{
+  glob_t globbuf = {0};
+  vector_t filenames = {0};
+  witem_t *first = NULL;
+  char *pattern = witem_rotated_pattern(item);
+
+  if (pattern == NULL || glob(pattern, GLOB_BRACE, NULL, &globbuf) != 0) {
+    goto monitor_catchup_exit;
+  }
+
+  // rotated files not watched as live files
+  for(size_t i=0; i<globbuf.gl_pathc; i++) {
+    const char *filename = globbuf.gl_pathv[i];
+    if (map_str_find(&(monitor->dict2), filename) == NULL && is_readable_file(filename)) {
+      vector_insert(&filenames, strdup(filename));
+    }
+  }
+  if (filenames.size == 0) {
+    goto monitor_catchup_exit;
+  }
+  qsort(filenames.data, filenames.size, sizeof(void *), rotated_cmp);
+
+  syslog(LOG_INFO, "monitor - catching up file '%s' from %u rotated files", item->filename, filenames.size);
+
+  while(first == NULL && filenames.size > 0) {
+    char *filename = (char *) filenames.data[0];
+    vector_remove(&filenames, 0, NULL);
+    first = witem_alloc(filename, WITEM_FILE, item->ptr, true);
+    free(filename);
+  }
+  if (first == NULL) {
+    goto monitor_catchup_exit;
+  }
+
+  // file notifications are kept pending until the catch-up ends
+  if (!witem_claim(item)) {
+    assert(false);
+    witem_free(first);
+    goto monitor_catchup_exit;
+  }
+  first->catchup = filenames;
+  first->live = item;
+  filenames = (vector_t){0};
+  if (witem_notify(first, true)) {
+    mqueue_push_lane(monitor->mqueue, witem_priority(first), MSG_TYPE_FILE1, first, 0);
+  }
+
+monitor_catchup_exit:
+  // no catch-up, file is read as usual
+  if (first == NULL) {
+    monitor_notify(monitor, item);
+  }
+  vector_reset(&filenames, free);
+  globfree(&globbuf);
+  free(pattern);
 }
 
 /**************************************************************************//**
@@ -127,9 +701,10 @@ static int monitor_add_watch(monitor_t *monitor, witem_t *item, bool freeonerror
  * @param[in,out] monitor Monitor parameters.
  * @param[in] dir Directory to monitor.
  * @param[in] file File pattern to monitor.
+ * @param[in] rescan Only new files are added (read from start).
  * @return Number of added watches.
  */
-static int monitor_add_dir_pattern(monitor_t *monitor, dir_t *dir, file_t *file)
+static int monitor_add_dir_pattern(monitor_t *monitor, dir_t *dir, file_t *file, bool rescan)
 {
   assert(monitor != NULL);
   assert(dir != NULL);
@@ -156,13 +731,35 @@ static int monitor_add_dir_pattern(monitor_t *monitor, dir_t *dir, file_t *file)
 
     witem_t *item = map_str_find(&(monitor->dict2), realfilename);
     if (item != NULL) {
-      syslog(LOG_WARNING, "monitor - file '%s' matched twice. Only first match applies", realfilename);
+      if (!rescan) {
+        syslog(LOG_WARNING, "monitor - file '%s' matched twice. Only first match applies", realfilename);
+      }
+      continue;
+    }
+
+    // already read under another name (eg. renamed while events were lost)
+    struct stat st;
+    if (stat(realfilename, &st) == 0 && monitor_is_watched(monitor, NULL, &st)) {
       continue;
     }
 
+    // files created while events were lost are read from start
     if (is_readable_file(realfilename)) {
-      item = witem_alloc(realfilename, WITEM_FILE, file, monitor->seek0);
-      num_watches += monitor_add_watch(monitor, item, true);
+      item = witem_alloc(realfilename, WITEM_FILE, file, monitor->seek0 || rescan);
+      // existing content can be backfilled (see processor_backfill)
+      if (item != NULL && monitor->seek0 && !rescan && item->pid == 0 &&
+          fstat(fileno(item->file), &st) == 0) {
+        item->backfill_end = st.st_size;
+      }
+      bool catchup = (monitor->seek0 && !rescan && file->rotated != NULL);
+      if (monitor_add_watch(monitor, item, true, !catchup) == 0) {
+        continue;
+      }
+      monitor_track(monitor, dir, realfilename, &st);
+      num_watches++;
+      if (catchup) {
+        monitor_catchup(monitor, item);
+      }
     }
     else {
       syslog(LOG_WARNING, "monitor - cannot access file %s", realfilename);
@@ -179,30 +776,36 @@ monitor_add_dir_pattern_exit:
  * @brief Add inotify watches on a directory and its patterns.
  * @param[in,out] monitor Monitor parameters.
  * @param[in] dir Directory to monitor.
+ * @param[in] rescan Only new directory and files are added.
  * @return Number of added watches.
  */
-static int monitor_add_dir(monitor_t *monitor, dir_t *dir)
+static int monitor_add_dir(monitor_t *monitor, dir_t *dir, bool rescan)
 {
   assert(monitor != NULL);
   assert(dir != NULL);
 
   if (!is_readable_dir(dir->path)) {
-    syslog(LOG_WARNING, "monitor - cannot access directory %s", dir->path);
+    if (!rescan) {
+      syslog(LOG_WARNING, "monitor - cannot access directory %s", dir->path);
+    }
     return(0);
   }
 
   int num_watches = 0;
 
   // adding directory
-  witem_t *item = witem_alloc(dir->path, WITEM_DIR, dir, monitor->seek0);
-  num_watches += monitor_add_watch(monitor, item, true);
+  if (!rescan || map_str_find(&(monitor->dict2), dir->path) == NULL) {
+    witem_t *item = witem_alloc(dir->path, WITEM_DIR, dir, monitor->seek0);
+    num_watches += monitor_add_watch(monitor, item, true, true);
+    if (num_watches == 0) {
+      return(0);
+    }
+  }
 
   // adding files matching patterns
-  if (num_watches > 0) {
-    for(uint32_t i=0; i<dir->files.size; i++) {
-      file_t *file = (file_t *) dir->files.data[i];
-      num_watches += monitor_add_dir_pattern(monitor, dir, file);
-    }
+  for(uint32_t i=0; i<dir->files.size; i++) {
+    file_t *file = (file_t *) dir->files.data[i];
+    num_watches += monitor_add_dir_pattern(monitor, dir, file, rescan);
   }
 
   return num_watches;
@@ -222,12 +825,32 @@ static int monitor_add_dirs(monitor_t *monitor, const vector_t *dirs)
 
   for(uint32_t i=0; i<dirs->size; i++) {
     dir_t *dir = (dir_t *) dirs->data[i];
-    num_watches += monitor_add_dir(monitor, dir);
+    num_watches += monitor_add_dir(monitor, dir, false);
   }
 
   return(num_watches);
 }
 
+/**************************************************************************//**
+ * @brief Removes a file from the rotated list.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] item Watched file.
+ */
+static void monitor_unrotate(monitor_t *monitor, witem_t *item)
+{
+  if (item->rotate_millis == 0) {
+    return;
+  }
+
+  item->rotate_millis = 0;
+  for(uint32_t i=0; i<monitor->rotated.size; i++) {
+    if (monitor->rotated.data[i] == item) {
+      vector_remove(&(monitor->rotated), i, NULL);
+      break;
+    }
+  }
+}
+
 /**************************************************************************//**
  * @brief Remove inotify watch.
  * @param[in,out] monitor Monitor parameters.
@@ -237,7 +860,6 @@ static void monitor_rm_watch(monitor_t *monitor, int wd)
 {
   assert(monitor != NULL);
   assert(monitor->ifd > 0);
-  assert(wd >= 0);
 
   // retrieve watched item
   witem_t *item = (witem_t *) map_int_find(&(monitor->dict1), wd);
@@ -250,16 +872,24 @@ static void monitor_rm_watch(monitor_t *monitor, int wd)
   syslog(LOG_INFO, "monitor - stop monitoring %s '%s' on WD #%d",
          (item->type==WITEM_DIR?"directory":"file"), item->filename, wd);
 
-  // remove inotify watch
-  inotify_rm_watch(monitor->ifd, wd);
+  // remove inotify watch (files watched by its directory have not)
+  if (wd >= 0) {
+    inotify_rm_watch(monitor->ifd, wd);
+  }
 
-  // remove item from map
+  // remove item from maps (a rotated file no longer owns its name)
   map_int_remove(&(monitor->dict1), item->wd, NULL);
-  map_str_remove(&(monitor->dict2), item->filename, NULL);
+  if (map_str_find(&(monitor->dict2), item->filename) == item) {
+    map_str_remove(&(monitor->dict2), item->filename, NULL);
+  }
+  monitor_undebounce(monitor, item);
+  monitor_unrotate(monitor, item);
 
   // notify that something has changed
   if (item->type == WITEM_FILE && monitor->mqueue->open) {
-    mqueue_push(monitor->mqueue, MSG_TYPE_FILE1, item, true, 0);
+    if (witem_notify(item, true)) {
+      mqueue_push_lane(monitor->mqueue, witem_priority(item), MSG_TYPE_FILE1, item, 0);
+    }
   }
   else {
     witem_free(item);
@@ -284,6 +914,64 @@ static void monitor_rm_watches(monitor_t *monitor)
   }
 }
 
+/**************************************************************************//**
+ * @brief Processes the rename of a watched file (log rotation).
+ * @details The writer keeps appending to the renamed file until it reopens
+ *          the original name. The renamed file remains opened and it is
+ *          drained during rotate-wait millis, then it is read up to EOF and
+ *          closed. Its name is released, so a new file with the same name
+ *          is watched as soon as it is created. When only directories are
+ *          watched, changes of the renamed file are read at the end of the
+ *          drain period.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in,out] item Watched file.
+ */
+static void monitor_rotate(monitor_t *monitor, witem_t *item)
+{
+  if (monitor->rotate_wait == 0) {
+    monitor_rm_watch(monitor, item->wd);
+    return;
+  }
+  if (item->rotate_millis != 0) {
+    return;
+  }
+
+  syslog(LOG_INFO, "monitor - file '%s' rotated, draining it for %zu ms",
+         item->filename, monitor->rotate_wait);
+
+  map_str_remove(&(monitor->dict2), item->filename, NULL);
+  monitor_undebounce(monitor, item);
+  item->rotate_millis = monitor_millis();
+  vector_insert(&(monitor->rotated), item);
+  monitor_notify(monitor, item);
+}
+
+/**************************************************************************//**
+ * @brief Closes the rotated files whose drain period has expired.
+ * @param[in,out] monitor Monitor parameters.
+ * @param[in] all Close all rotated files.
+ * @return Milliseconds until the next expiration (-1=none).
+ */
+static int monitor_expire(monitor_t *monitor, bool all)
+{
+  int ret = -1;
+  size_t now = monitor_millis();
+
+  for(int i=(int) monitor->rotated.size-1; i>=0; i--) {
+    witem_t *item = (witem_t *) monitor->rotated.data[i];
+    size_t deadline = item->rotate_millis + monitor->rotate_wait;
+    if (all || deadline <= now) {
+      // removed from rotated list, read up to EOF and freed by processor
+      monitor_rm_watch(monitor, item->wd);
+    }
+    else if (ret < 0 || deadline - now < (size_t) ret) {
+      ret = (int) (deadline - now);
+    }
+  }
+
+  return(ret);
+}
+
 /**************************************************************************//**
  * @brief Trace inotify event info to stderr.
  * @details Use only for debug purposes.
@@ -323,12 +1011,15 @@ static void trace_event(const struct inotify_event *event, witem_t *item)
 static void process_event_file(monitor_t *monitor, const struct inotify_event *event, witem_t *item)
 {
   if (event->mask & IN_MODIFY) {
-    mqueue_push(monitor->mqueue, MSG_TYPE_FILE0, item, true, 0);
+    monitor_debounce(monitor, item);
   }
 }
 
 /**************************************************************************//**
- * @brief Process IN_CREATE event on a directory.
+ * @brief Process IN_CREATE|IN_MOVED_TO event on a directory.
+ * @details New files are read from start. A file moved to the directory
+ *          is ignored if it was already read (see monitor_is_watched),
+ *          otherwise all its content is new too.
  * @param[in] monitor Monitor parameters.
  * @param[in] dir Directory where event ocurres.
  * @param[in] name File name (not a pattern).
@@ -343,14 +1034,26 @@ static void process_event_dir_create(monitor_t *monitor, dir_t *dir, const char
 
   file_t *file = dir->files.data[ipos];
   char *filename = concat(3, dir->path, "/", name);
+  witem_t *item = map_str_find(&(monitor->dict2), filename);
+  struct stat st;
 
-  // create a new witem and monitor it
-  if (is_readable_file(filename)) {
-    witem_t *item = witem_alloc(filename, WITEM_FILE, file, monitor->seek0);
-    monitor_add_watch(monitor, item, true);
+  if (!is_readable_file(filename) || stat(filename, &st) != 0) {
+    syslog(LOG_INFO, "monitor - '%s' is not a readable file", filename);
+  }
+  else if (monitor_is_watched(monitor, item, &st)) {
+    // file renamed to a matching name (eg. app.log.1 to app.log.2)
+    syslog(LOG_DEBUG, "monitor - file '%s' already watched", filename);
   }
   else {
-    syslog(LOG_INFO, "monitor - '%s' is not a readable file", filename);
+    // name replaced without a previous rename/delete event
+    if (item != NULL) {
+      monitor_rotate(monitor, item);
+    }
+    // create a new witem and monitor it (all its content is new)
+    item = witem_alloc(filename, WITEM_FILE, file, true);
+    if (monitor_add_watch(monitor, item, true, true) > 0) {
+      monitor_track(monitor, dir, filename, &st);
+    }
   }
 
   free(filename);
@@ -358,17 +1061,46 @@ static void process_event_dir_create(monitor_t *monitor, dir_t *dir, const char
 
 /**************************************************************************//**
  * @brief Process IN_DELETE|IN_MOVED_FROM event on a directory.
+ * @details Renamed files are drained before closing them (see monitor_rotate).
  * @param[in] monitor Monitor parameters.
  * @param[in] dir Directory where event ocurres.
  * @param[in] name File name (not a pattern).
+ * @param[in] moved File was renamed (true) or deleted (false).
+ * @param[in] cookie Rename cookie (see monitor_detach).
  */
-static void process_event_dir_delete(monitor_t *monitor, dir_t *dir, const char *name)
+static void process_event_dir_delete(monitor_t *monitor, dir_t *dir, const char *name, bool moved, uint32_t cookie)
 {
   char *filename = concat(3, dir->path, "/", name);
   witem_t *item = map_str_find(&(monitor->dict2), filename);
-  if (item != NULL) {
+  if (item != NULL && item->type == WITEM_FILE && moved) {
+    monitor_rotate(monitor, item);
+  }
+  else if (item != NULL) {
     monitor_rm_watch(monitor, item->wd);
   }
+  if (moved) {
+    monitor_detach(monitor, filename, cookie);
+  }
+  else {
+    monitor_untrack(monitor, filename);
+  }
+  free(filename);
+}
+
+/**************************************************************************//**
+ * @brief Process IN_MODIFY event on a directory.
+ * @details Only reported when directories are watched (see watch_dirs).
+ * @param[in] monitor Monitor parameters.
+ * @param[in] event Event to process.
+ * @param[in] dir Directory where event ocurres.
+ */
+static void process_event_dir_modify(monitor_t *monitor, const struct inotify_event *event, dir_t *dir)
+{
+  char *filename = concat(3, dir->path, "/", event->name);
+  witem_t *item = map_str_find(&(monitor->dict2), filename);
+  if (item != NULL && item->type == WITEM_FILE) {
+    process_event_file(monitor, event, item);
+  }
   free(filename);
 }
 
@@ -402,6 +1134,7 @@ static void process_event_dir_move_self(monitor_t *monitor, int wd, dir_t *dir)
     }
   }
 
+  monitor_untrack_dir(monitor, dir);
   free(path);
 }
 
@@ -413,6 +1146,14 @@ static void process_event_dir_move_self(monitor_t *monitor, int wd, dir_t *dir)
  */
 static void process_event_dir(monitor_t *monitor, const struct inotify_event *event, witem_t *item)
 {
+  // file in this directory modified (the most frequent one)
+  if (event->mask & IN_MODIFY) {
+    if (event->len > 0) {
+      process_event_dir_modify(monitor, event, item->ptr);
+    }
+    return;
+  }
+
   // new file in this directory
   if (event->mask & IN_CREATE) {
     const char *name = event->name;
@@ -423,13 +1164,14 @@ static void process_event_dir(monitor_t *monitor, const struct inotify_event *ev
   // file renamed or moved from this directory
   if (event->mask & IN_MOVED_FROM) {
     const char *name = event->name;
-    process_event_dir_delete(monitor, item->ptr, name);
+    process_event_dir_delete(monitor, item->ptr, name, true, event->cookie);
     return;
   }
 
   // file renamed or moved to this directory
   if (event->mask & IN_MOVED_TO) {
     const char *name = event->name;
+    monitor_attach(monitor, item->ptr, name, event->cookie);
     process_event_dir_create(monitor, item->ptr, name);
     return;
   }
@@ -437,7 +1179,7 @@ static void process_event_dir(monitor_t *monitor, const struct inotify_event *ev
   // file removed from this directory
   if (event->mask & IN_DELETE) {
     const char *name = event->name;
-    process_event_dir_delete(monitor, item->ptr, name);
+    process_event_dir_delete(monitor, item->ptr, name, false, 0);
     return;
   }
 
@@ -480,6 +1222,90 @@ static void process_event(monitor_t *monitor, const struct inotify_event *event)
   }
 }
 
+/**************************************************************************//**
+ * @brief Recovers from an inotify queue overflow.
+ * @details Events were lost, so watched directories and patterns are
+ *          scanned again (new files are added) and every known file whose
+ *          size differs from its read offset is notified.
+ * @param[in,out] monitor Monitor parameters.
+ */
+static void monitor_rescan(monitor_t *monitor)
+{
+  int num_added = 0;
+  size_t num_queued = 0;
+  map_int_bucket_t *bucket = NULL;
+  map_int_iterator_t it = {0};
+
+  syslog(LOG_WARNING, "monitor - inotify queue overflow, rescanning");
+
+  // known files first (added files are already notified)
+  while((bucket = map_int_next(&(monitor->dict1), &it)) != NULL) {
+    witem_t *item = (witem_t *) bucket->value;
+    if (item->type != WITEM_FILE || item->rotate_millis != 0) {
+      continue;
+    }
+    struct stat st;
+    if (stat(item->filename, &st) == 0 && !witem_same_file(item, &st)) {
+      // name replaced while events were lost (new file added below)
+      monitor_rotate(monitor, item);
+      num_queued++;
+      if (monitor->rotate_wait == 0) {
+        // item removed from dict1
+        it.pos = it.pos - (it.pos==0?0:1);
+        it.num--;
+      }
+    }
+    else if (monitor_file_size(item->filename) != (off_t) atomic_load(&(item->read_offset))) {
+      monitor_undebounce(monitor, item);
+      monitor_notify(monitor, item);
+      num_queued++;
+    }
+  }
+
+  // only files not read yet (by inode) are added
+  monitor_reconcile(monitor);
+  for(uint32_t i=0; i<monitor->dirs->size; i++) {
+    dir_t *dir = (dir_t *) monitor->dirs->data[i];
+    num_added += monitor_add_dir(monitor, dir, true);
+  }
+
+  syslog(LOG_INFO, "monitor - rescan done [added=%d, queued=%zu]", num_added, num_queued);
+}
+
+/**************************************************************************//**
+ * @brief Sets the inotify queue size (system wide).
+ * @details Only enlarges it. Requires privileges.
+ * @param[in] max_queued_events Minimum value of max_queued_events.
+ */
+static void monitor_set_queue_size(size_t max_queued_events)
+{
+  size_t current = 0;
+
+  FILE *fp = fopen(MAX_QUEUED_EVENTS_FILE, "r");
+  if (fp == NULL || fscanf(fp, "%zu", &current) != 1) {
+    current = 0;
+  }
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  if (current >= max_queued_events) {
+    return;
+  }
+
+  fp = fopen(MAX_QUEUED_EVENTS_FILE, "w");
+  if (fp == NULL || fprintf(fp, "%zu\n", max_queued_events) < 0) {
+    syslog(LOG_WARNING, "monitor - cannot set %s to %zu - %s", MAX_QUEUED_EVENTS_FILE,
+           max_queued_events, strerror(errno));
+  }
+  else {
+    syslog(LOG_INFO, "monitor - %s set to %zu (was %zu)", MAX_QUEUED_EVENTS_FILE,
+           max_queued_events, current);
+  }
+  if (fp != NULL) {
+    fclose(fp);
+  }
+}
+
 /**************************************************************************//**
  * @brief Reset params linked to monitor.
  * @param[in,out] monitor Monitor parameters.
@@ -504,19 +1330,28 @@ void monitor_reset(monitor_t *monitor)
   monitor->mqueue = NULL;
   map_int_reset(&(monitor->dict1), witem_free);
   map_str_reset(&(monitor->dict2), NULL);
+  vector_reset(&(monitor->debounced), NULL);
+  vector_reset(&(monitor->rotated), NULL);
+  map_str_reset(&(monitor->seen_names), NULL);
+  map_str_reset(&(monitor->seen), seen_free);
+  vector_reset(&(monitor->moved), NULL);
+  free(monitor->buffer);
+  monitor->buffer = NULL;
+  monitor->buffer_size = 0;
 }
 
 /**************************************************************************//**
  * @brief Initialize inotify.
  * @param[in,out] monitor Monitor parameters.
+ * @param[in] cfg Configuration object.
  * @param[in] dirs User defined dir/patterns declared in config file.
  * @param[in] mqueue Message queue (monitor -> processor).
  * @param[in] seek0 Open files position.
  * @return 0=OK, otherwise=KO.
  */
-int monitor_init(monitor_t *monitor, const vector_t *dirs, mqueue_t *mqueue, bool seek0)
+int monitor_init(monitor_t *monitor, const config_t *cfg, const vector_t *dirs, mqueue_t *mqueue, bool seek0)
 {
-  if (monitor == NULL || dirs == NULL || mqueue == NULL) {
+  if (monitor == NULL || cfg == NULL || dirs == NULL || mqueue == NULL) {
     assert(false);
     return(1);
   }
@@ -527,6 +1362,62 @@ int monitor_init(monitor_t *monitor, const vector_t *dirs, mqueue_t *mqueue, boo
   monitor->dict2 = (map_str_t){0};
   monitor->mqueue = mqueue;
   monitor->seek0 = seek0;
+  monitor->watch_dirs = false;
+  monitor->last_key = 0;
+  monitor->debounce = 0;
+  monitor->debounce_bytes = 0;
+  monitor->debounced = (vector_t){0};
+  monitor->rotate_wait = DEFAULT_ROTATE_WAIT;
+  monitor->rotated = (vector_t){0};
+  monitor->seen = (map_str_t){0};
+  monitor->seen_names = (map_str_t){0};
+  monitor->moved = (vector_t){0};
+  monitor->dirs = dirs;
+  monitor->buffer = NULL;
+  monitor->buffer_size = BUFFER_LEN;
+  size_t max_queued_events = 0;
+
+  // monitor entry is optional
+  config_setting_t *parent = config_lookup(cfg, "monitor");
+  if (parent != NULL) {
+    rc = setting_check_childs(parent, MONITOR_PARAMS);
+    rc |= setting_read_uint(parent, MONITOR_PARAM_DEBOUNCE, &(monitor->debounce));
+    rc |= setting_read_uint(parent, MONITOR_PARAM_DEBOUNCE_BYTES, &(monitor->debounce_bytes));
+    rc |= setting_read_uint(parent, MONITOR_PARAM_BUFFER_SIZE, &(monitor->buffer_size));
+    rc |= setting_read_uint(parent, MONITOR_PARAM_MAX_QUEUED_EVENTS, &max_queued_events);
+    rc |= setting_read_uint(parent, MONITOR_PARAM_ROTATE_WAIT, &(monitor->rotate_wait));
+    const char *watch = NULL;
+    config_setting_lookup_string(parent, MONITOR_PARAM_WATCH, &watch);
+    if (watch != NULL) {
+      int i = 0;
+      while (WATCH_TYPES[i] != NULL && strcmp(WATCH_TYPES[i], watch) != 0) i++;
+      if (WATCH_TYPES[i] == NULL) {
+        config_setting_t *aux = config_setting_get_member(parent, MONITOR_PARAM_WATCH);
+        syslog(LOG_ERR, "invalid monitor " MONITOR_PARAM_WATCH " '%s' at %s:%d.", watch,
+               config_setting_source_file(aux),
+               config_setting_source_line(aux));
+        rc = 1;
+      }
+      else {
+        monitor->watch_dirs = (i == 1);
+      }
+    }
+    if (rc != 0) {
+      return(1);
+    }
+  }
+
+  // room for at least one event
+  monitor->buffer_size = MAX(monitor->buffer_size, EVENT_SIZE);
+  monitor->buffer = (char *) malloc(monitor->buffer_size);
+  if (monitor->buffer == NULL) {
+    syslog(LOG_CRIT, "monitor - %s", strerror(errno));
+    return(1);
+  }
+
+  if (max_queued_events > 0) {
+    monitor_set_queue_size(max_queued_events);
+  }
 
   monitor->ifd = inotify_init();
   if (monitor->ifd <= 0) {
@@ -551,6 +1442,24 @@ monitor_init_err:
   return(rc);
 }
 
+/**************************************************************************//**
+ * @brief Waits until the processor has retrieved the pending notifications.
+ * @details A closed queue drops its pending messages, so the queue is
+ *          closed once it is empty. The wait is bounded by rotate-wait
+ *          (the time renamed files are read) in case the processor is
+ *          stuck (eg. database down).
+ * @param[in] monitor Monitor parameters.
+ */
+static void monitor_drain(const monitor_t *monitor)
+{
+  struct timespec ts = {0, DRAIN_POLL_MILLIS * 1000000L};
+  size_t deadline = monitor_millis() + monitor->rotate_wait;
+
+  while(mqueue_length(monitor->mqueue) > 0 && monitor_millis() < deadline) {
+    nanosleep(&ts, NULL);
+  }
+}
+
 /**************************************************************************//**
  * @brief Process inotify events.
  * @details This function block the current thread until signal is received.
@@ -573,15 +1482,24 @@ void *monitor_run(void *ptr)
   sigaddset(&signals_to_catch, SIGTERM);
   pthread_sigmask(SIG_UNBLOCK, &signals_to_catch, NULL);
 
-  char buffer[BUFFER_LEN] ALIGNAS(struct inotify_event);
+  char *buffer = monitor->buffer;
   const struct inotify_event *event = NULL;
 
   syslog(LOG_DEBUG, "monitor - thread started");
 
   while(monitor->dict1.size > 0 && keep_running)
   {
-    // wait for inotify events
-    ssize_t len = read(monitor->ifd, buffer, sizeof(buffer));
+    // wait for inotify events (or the next debounced notification or rotated file expiration)
+    struct pollfd pfd = {monitor->ifd, POLLIN, 0};
+    int timeout = monitor_flush(monitor, false);
+    int expire = monitor_expire(monitor, false);
+    timeout = (timeout < 0 || (expire >= 0 && expire < timeout) ? expire : timeout);
+    int rc = poll(&pfd, 1, timeout);
+    if (rc == 0) {
+      continue;
+    }
+
+    ssize_t len = (rc < 0 ? -1 : read(monitor->ifd, buffer, monitor->buffer_size));
     if (len < 0) {
       if (errno != EINTR) {
         syslog(LOG_ERR, "monitor - %s", strerror(errno));
@@ -590,16 +1508,32 @@ void *monitor_run(void *ptr)
     }
 
     // process the list of readed events
+    bool overflow = false;
     for (char *ptr=buffer; ptr<buffer+len; ptr += sizeof(struct inotify_event)+event->len) {
       event = (const struct inotify_event *) ptr;
-      if (event->wd < 0 || event->mask & IN_Q_OVERFLOW) {
+      if (event->mask & IN_Q_OVERFLOW) {
+        overflow = true;
+        continue;
+      }
+      if (event->wd < 0) {
         continue;
       }
       process_event(monitor, event);
     }
+
+    // renames without its new name (moved out of the watched directories)
+    monitor_forget(monitor);
+
+    // events were lost
+    if (overflow) {
+      monitor_rescan(monitor);
+    }
   }
 
-  // notifies that there are no more messages
+  // notifies pending changes, drains rotated files and that there are no more messages
+  monitor_flush(monitor, true);
+  monitor_expire(monitor, true);
+  monitor_drain(monitor);
   mqueue_close(monitor->mqueue);
 
   syslog(LOG_DEBUG, "monitor - thread ended");
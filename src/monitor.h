@@ -24,6 +24,7 @@
 #define MONITOR_H
 
 #include <stdbool.h>
+#include <libconfig.h>
 #include "map_int.h"
 #include "map_str.h"
 #include "vector.h"
@@ -44,12 +45,38 @@ typedef struct monitor_t
   map_str_t dict2;
   //! File position at file opening (true=start, false=end).
   bool seek0;
+  //! Only directories are watched (files are resolved by name).
+  bool watch_dirs;
+  //! Last key of the files not having a watch (negative, see dict1).
+  int last_key;
+  //! Maximum delay of a file change notification (0=disabled).
+  size_t debounce;
+  //! Appended bytes notified without delay (0=disabled).
+  size_t debounce_bytes;
+  //! Files having delayed notifications (see monitor_debounce).
+  vector_t debounced;
+  //! Time (millis) a renamed file is drained before closing it (0=disabled).
+  size_t rotate_wait;
+  //! Renamed files being drained (see monitor_rotate).
+  vector_t rotated;
+  //! Files read since their directory is watched, by inode (see monitor_track).
+  map_str_t seen;
+  //! Same files by name (see monitor_untrack).
+  map_str_t seen_names;
+  //! Renamed files waiting their new name (see monitor_detach).
+  vector_t moved;
+  //! User defined dir/patterns (rescanned on inotify queue overflow).
+  const vector_t *dirs;
+  //! Inotify events buffer.
+  char *buffer;
+  //! Inotify events buffer length.
+  size_t buffer_size;
 } monitor_t;
 
 /**************************************************************************
  * Function declarations.
  */
-extern int monitor_init(monitor_t *monitor, const vector_t *dirs, mqueue_t *mqueue, bool seek0);
+extern int monitor_init(monitor_t *monitor, const config_t *cfg, const vector_t *dirs, mqueue_t *mqueue, bool seek0);
 extern void* monitor_run(void *ptr);
 extern void monitor_reset(monitor_t *monitor);
 
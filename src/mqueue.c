@@ -21,6 +21,7 @@
 //===========================================================================
 
 #include "log2pg.h"
+#include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
@@ -31,9 +32,11 @@
 #include <assert.h>
 #include "utils.h"
 #include "mqueue.h"
+#include "ring.h"
 
 #define INITIAL_CAPACITY 8
 #define RESIZE_FACTOR 2
+#define MAX_LANES 32
 
 /**************************************************************************//**
  * @brief Creates a message.
@@ -74,8 +77,10 @@ static const char* msg_type_str(int type)
       return "FILE0";
     case MSG_TYPE_FILE1:
       return "FILE1";
-    case MSG_TYPE_MATCH1:
-      return "MATCH1";
+    case MSG_TYPE_TASK:
+      return "TASK";
+    case MSG_TYPE_BATCH:
+      return "BATCH";
     default:
       return "UNKNOW";
   }
@@ -107,6 +112,12 @@ int mqueue_init(mqueue_t *mqueue, const char *name, size_t max_capacity)
   mqueue->num_delivered_msgs = 0U;
   mqueue->millis_waiting_push = 0U;
   mqueue->millis_waiting_pop = 0U;
+  mqueue->ring = NULL;
+  mqueue->lanes = NULL;
+  mqueue->num_lanes = 0U;
+  mqueue->weights = NULL;
+  mqueue->credits = NULL;
+  mqueue->pop_waiters = 0U;
 
   mqueue->name = strdup(name);
   if (mqueue->name == NULL) {
@@ -119,12 +130,19 @@ int mqueue_init(mqueue_t *mqueue, const char *name, size_t max_capacity)
     goto mqueue_init_err2;
   }
 
-  rc = pthread_cond_init(&(mqueue->tcond1), NULL);
+  // timeouts are not affected by system clock changes
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+  rc = pthread_cond_init(&(mqueue->tcond1), &attr);
   if (rc != 0) {
+    pthread_condattr_destroy(&attr);
     goto mqueue_init_err3;
   }
 
-  rc = pthread_cond_init(&(mqueue->tcond2), NULL);
+  rc = pthread_cond_init(&(mqueue->tcond2), &attr);
+  pthread_condattr_destroy(&attr);
   if (rc != 0) {
     goto mqueue_init_err4;
   }
@@ -152,6 +170,127 @@ mqueue_init_err1:
   return(rc);
 }
 
+/**************************************************************************//**
+ * @brief Initialize a lock-free mqueue struct.
+ * @details push/pop don't lock a mutex (see ring_t). Capacity is fixed
+ *          and unique push is not supported.
+ * @param[in,out] mqueue Message queue object.
+ * @param[in] name Message queue name (used in traces).
+ * @param[in] capacity Queue size (rounded up to a power of 2).
+ * @return 0=OK, otherwise an error ocurred.
+ */
+int mqueue_init_lockfree(mqueue_t *mqueue, const char *name, size_t capacity)
+{
+  if (mqueue == NULL || name == NULL || capacity == 0) {
+    assert(false);
+    return(1);
+  }
+
+  int rc = mqueue_init(mqueue, name, capacity);
+  if (rc != 0) {
+    return(rc);
+  }
+
+  mqueue->ring = ring_alloc(capacity);
+  if (mqueue->ring == NULL) {
+    mqueue_reset(mqueue, NULL);
+    return(1);
+  }
+
+  mqueue->max_capacity = mqueue->ring->mask + 1;
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Initialize a mqueue struct having priority lanes.
+ * @see mqueue_init_lanes
+ * @param[in] ring_capacity Size of each lane (0=lanes are buffers
+ *            protected by the mqueue mutex, otherwise lock-free rings).
+ */
+static int mqueue_init_lanes_int(mqueue_t *mqueue, const char *name, size_t max_capacity, const int *weights, size_t num_lanes, size_t ring_capacity)
+{
+  if (mqueue == NULL || name == NULL || weights == NULL || num_lanes == 0 || num_lanes > MAX_LANES) {
+    assert(false);
+    return(1);
+  }
+
+  int rc = mqueue_init(mqueue, name, max_capacity);
+  if (rc != 0) {
+    return(rc);
+  }
+
+  mqueue->lanes = (mqueue_t *) calloc(num_lanes, sizeof(mqueue_t));
+  mqueue->weights = (int *) calloc(num_lanes, sizeof(int));
+  mqueue->credits = (int *) calloc(num_lanes, sizeof(int));
+  if (mqueue->lanes == NULL || mqueue->weights == NULL || mqueue->credits == NULL) {
+    mqueue_reset(mqueue, NULL);
+    return(1);
+  }
+
+  for(size_t i=0; i<num_lanes; i++) {
+    char lane_name[128];
+    snprintf(lane_name, sizeof(lane_name), "%s.%zu", name, i);
+    rc = (ring_capacity > 0 ? mqueue_init_lockfree(mqueue->lanes + i, lane_name, ring_capacity) :
+                              mqueue_init(mqueue->lanes + i, lane_name, 0));
+    if (rc != 0) {
+      mqueue_reset(mqueue, NULL);
+      return(1);
+    }
+    mqueue->num_lanes++;
+    mqueue->weights[i] = (weights[i] > 0 ? weights[i] : 1);
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Initialize a mqueue struct having priority lanes.
+ * @details Each lane is a FIFO. pop() serves the non-empty lanes in
+ *          proportion to their weight (see swrr_select), so low priority
+ *          messages are delayed but not starved. Unique push is not
+ *          supported. mqueue_push() appends to lane 0.
+ * @param[in,out] mqueue Message queue object.
+ * @param[in] name Message queue name (used in traces).
+ * @param[in] max_capacity Maximum queue size, all lanes (0=unlimited).
+ * @param[in] weights Lanes weight (greater than 0).
+ * @param[in] num_lanes Number of lanes.
+ * @return 0=OK, otherwise an error ocurred.
+ */
+int mqueue_init_lanes(mqueue_t *mqueue, const char *name, size_t max_capacity, const int *weights, size_t num_lanes)
+{
+  return(mqueue_init_lanes_int(mqueue, name, max_capacity, weights, num_lanes, 0));
+}
+
+/**************************************************************************//**
+ * @brief Initialize a mqueue struct having lock-free priority lanes.
+ * @details Same as mqueue_init_lanes() but each lane is a lock-free ring
+ *          (see mqueue_init_lockfree), so publishers only lock the mutex
+ *          to wake up a waiting subscriber. Each lane has the given
+ *          capacity (push() waits while the lane is full), max_capacity
+ *          reports the capacity of one lane.
+ * @param[in,out] mqueue Message queue object.
+ * @param[in] name Message queue name (used in traces).
+ * @param[in] capacity Size of each lane (rounded up to a power of 2).
+ * @param[in] weights Lanes weight (greater than 0).
+ * @param[in] num_lanes Number of lanes.
+ * @return 0=OK, otherwise an error ocurred.
+ */
+int mqueue_init_lockfree_lanes(mqueue_t *mqueue, const char *name, size_t capacity, const int *weights, size_t num_lanes)
+{
+  if (capacity == 0) {
+    assert(false);
+    return(1);
+  }
+
+  int rc = mqueue_init_lanes_int(mqueue, name, 0, weights, num_lanes, capacity);
+  if (rc != 0) {
+    return(rc);
+  }
+
+  mqueue->max_capacity = mqueue->lanes[0].max_capacity;
+  return(0);
+}
+
 /**************************************************************************//**
  * @brief Reset a mqueue struct.
  * @param[in,out] mqueue Message queue object.
@@ -167,6 +306,20 @@ void mqueue_reset(mqueue_t *mqueue, void (*item_free)(void*))
          mqueue->name, mqueue->num_incoming_msgs, mqueue->num_delivered_msgs,
          mqueue->millis_waiting_push, mqueue->millis_waiting_pop);
 
+  ring_free(mqueue->ring, item_free);
+  mqueue->ring = NULL;
+
+  for(size_t i=0; i<mqueue->num_lanes; i++) {
+    mqueue_reset(mqueue->lanes + i, item_free);
+  }
+  free(mqueue->lanes);
+  free(mqueue->weights);
+  free(mqueue->credits);
+  mqueue->lanes = NULL;
+  mqueue->num_lanes = 0;
+  mqueue->weights = NULL;
+  mqueue->credits = NULL;
+
   // free objects (only if item_free not NULL)
   if (mqueue->buffer != NULL && item_free != NULL) {
     size_t len = mqueue->length;
@@ -236,7 +389,7 @@ static int mqueue_resize(mqueue_t *mqueue)
 }
 
 /**************************************************************************//**
- * @brief Returns current time + millis
+ * @brief Returns current time (CLOCK_MONOTONIC) + millis
  * @param millis Milliseconds to add to current time.
  * @return timespec struct filled.
  */
@@ -244,7 +397,7 @@ static struct timespec mqueue_timespec(size_t millis)
 {
   struct timespec ts = {0};
 
-  clock_gettime(CLOCK_REALTIME, &ts);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
 
   if (millis > 0) {
     size_t seconds = millis/1000;
@@ -316,6 +469,166 @@ static int mqueue_update_msg_type(const mqueue_t *mqueue, void *obj, short type)
   return(ret);
 }
 
+/**************************************************************************//**
+ * @brief Append a message to a lane.
+ * @details Caution, this function is not thread-safe.
+ * @param[in,out] mqueue Message queue object (having lanes).
+ * @param[in] lane Lane index.
+ * @param[in] msg Message to append.
+ * @return 0=OK, 1=KO.
+ */
+static int mqueue_lane_append(mqueue_t *mqueue, size_t lane, msg_t msg)
+{
+  mqueue_t *aux = mqueue->lanes + MIN(lane, mqueue->num_lanes-1);
+
+  if (aux->length >= aux->capacity && mqueue_resize(aux) != 0) {
+    return(1);
+  }
+
+  size_t pos = (aux->front+aux->length)%(aux->capacity);
+  aux->buffer[pos] = msg;
+  aux->length++;
+  aux->num_incoming_msgs++;
+  mqueue->length++;
+  mqueue->num_incoming_msgs++;
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves the next message of the lanes (weighted fair).
+ * @details Caution, this function is not thread-safe.
+ * @param[in,out] mqueue Message queue object (having lanes, not empty).
+ * @return Message.
+ */
+static msg_t mqueue_lane_take(mqueue_t *mqueue)
+{
+  unsigned int active = 0;
+
+  for(size_t i=0; i<mqueue->num_lanes; i++) {
+    if (mqueue->lanes[i].length > 0) {
+      active |= (1U << i);
+    }
+  }
+
+  int lane = swrr_select(mqueue->credits, mqueue->weights, active, mqueue->num_lanes);
+  assert(lane >= 0);
+
+  mqueue_t *aux = mqueue->lanes + lane;
+  msg_t ret = aux->buffer[aux->front];
+  aux->buffer[aux->front] = msg_create(MSG_TYPE_NULL, NULL);
+  aux->front = (aux->front+1)%aux->capacity;
+  aux->length--;
+  aux->num_delivered_msgs++;
+  mqueue->length--;
+  mqueue->num_delivered_msgs++;
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Checks if the lanes are lock-free rings.
+ * @param[in] mqueue Message queue object.
+ * @return true=lock-free lanes (see mqueue_init_lockfree_lanes), false=otherwise.
+ */
+static inline bool mqueue_has_rings(const mqueue_t *mqueue)
+{
+  return(mqueue->lanes != NULL && mqueue->lanes[0].ring != NULL);
+}
+
+/**************************************************************************//**
+ * @brief Wakes up the subscribers waiting on lock-free lanes (if any).
+ * @details The fence orders the previous push with the waiters load (a
+ *          waiting subscriber increments waiters before checking the
+ *          lanes, so one of both sides always sees the other).
+ * @param[in,out] mqueue Message queue object (having lock-free lanes).
+ */
+static void mqueue_lanes_wakeup(mqueue_t *mqueue)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&(mqueue->pop_waiters), __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&(mqueue->mutex));
+    pthread_cond_broadcast(&(mqueue->tcond1));
+    pthread_mutex_unlock(&(mqueue->mutex));
+  }
+}
+
+/**************************************************************************//**
+ * @brief Retrieves the available messages of the lock-free lanes (weighted fair).
+ * @details Caution, this function is not thread-safe (mutex locked by caller).
+ * @param[in,out] mqueue Message queue object (having lock-free lanes).
+ * @param[out] msgs Retrieved messages.
+ * @param[in] num Maximum number of messages to retrieve.
+ * @return Number of retrieved messages (0 if lanes are empty).
+ */
+static size_t mqueue_lanes_take_n(mqueue_t *mqueue, msg_t *msgs, size_t num)
+{
+  size_t ret = 0;
+
+  while (ret < num)
+  {
+    unsigned int active = 0;
+    for(size_t i=0; i<mqueue->num_lanes; i++) {
+      if (ring_length(mqueue->lanes[i].ring) > 0) {
+        active |= (1U << i);
+      }
+    }
+    if (active == 0) {
+      break;
+    }
+
+    int lane = swrr_select(mqueue->credits, mqueue->weights, active, mqueue->num_lanes);
+    assert(lane >= 0);
+
+    mqueue_t *aux = mqueue->lanes + lane;
+    if (ring_take_n(aux->ring, msgs + ret, 1) == 0) {
+      break;
+    }
+    __atomic_fetch_add(&(aux->num_delivered_msgs), 1, __ATOMIC_RELAXED);
+    ret++;
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Append a message to the lock-free ring.
+ * @see mqueue_push_int
+ */
+static int mqueue_push_ring(mqueue_t *mqueue, msg_t msg, bool unique, size_t millis)
+{
+  // unique requires traversing the queue
+  if (unique) {
+    return(MSG_TYPE_ERROR);
+  }
+
+  int rc = ring_push(mqueue->ring, msg, millis);
+  if (rc == 0) {
+    __atomic_fetch_add(&(mqueue->num_incoming_msgs), 1, __ATOMIC_RELAXED);
+  }
+
+  return(rc);
+}
+
+/**************************************************************************//**
+ * @brief Append a message to a lock-free lane.
+ * @details The subscriber is woken up after each message, so a publisher
+ *          waiting for room never holds back an unnotified message.
+ * @see mqueue_push_int
+ */
+static int mqueue_push_lanes(mqueue_t *mqueue, size_t lane, msg_t msg, bool unique, size_t millis)
+{
+  mqueue_t *aux = mqueue->lanes + MIN(lane, mqueue->num_lanes-1);
+
+  int rc = mqueue_push_ring(aux, msg, unique, millis);
+  if (rc == 0) {
+    __atomic_fetch_add(&(mqueue->num_incoming_msgs), 1, __ATOMIC_RELAXED);
+    mqueue_lanes_wakeup(mqueue);
+  }
+
+  return(rc);
+}
+
 /**************************************************************************//**
  * @brief Append an object to the message queue if not exists.
  * @details Assumes that this function is called uniquely by publisher.
@@ -335,15 +648,24 @@ static int mqueue_update_msg_type(const mqueue_t *mqueue, void *obj, short type)
  *         MSG_TYPE_CLOSE = message queue closed (not appended),
  *         otherwise = error (signal received, not enought memory, not initialized, etc).
  */
-static inline int mqueue_push_int(mqueue_t *mqueue, short type, void *obj, bool unique, size_t millis)
+static inline int mqueue_push_int(mqueue_t *mqueue, size_t lane, short type, void *obj, bool unique, size_t millis)
 {
   if (mqueue == NULL) {
     assert(false);
     return(MSG_TYPE_ERROR);
   }
+  else if (mqueue->ring != NULL) {
+    return(mqueue_push_ring(mqueue, msg_create(type, obj), unique, millis));
+  }
+  else if (mqueue_has_rings(mqueue)) {
+    return(mqueue_push_lanes(mqueue, lane, msg_create(type, obj), unique, millis));
+  }
   else if (!mqueue->open) {
     return(MSG_TYPE_CLOSE);
   }
+  else if (unique && mqueue->lanes != NULL) {
+    return(MSG_TYPE_ERROR);
+  }
 
   int rc = 0;
   struct timespec ts = {0};
@@ -368,6 +690,11 @@ static inline int mqueue_push_int(mqueue_t *mqueue, short type, void *obj, bool
     goto mqueue_push_exit;
   }
 
+  if (mqueue->lanes != NULL) {
+    rc = (mqueue_lane_append(mqueue, lane, msg_create(type, obj)) == 0 ? 0 : MSG_TYPE_ERROR);
+    goto mqueue_push_exit;
+  }
+
   // check if obj exist in mqueue
   if (unique && mqueue_update_msg_type(mqueue, obj, type) > 0) {
     rc = MSG_TYPE_EXISTS;
@@ -411,11 +738,11 @@ int mqueue_push(mqueue_t *mqueue, short type, void *obj, bool unique, size_t mil
   struct timeval t1 = {0};
   gettimeofday(&t1, NULL);
 
-  int rc = mqueue_push_int(mqueue, type, obj, unique, millis);
+  int rc = mqueue_push_int(mqueue, 0, type, obj, unique, millis);
 
   struct timeval t2 = {0};
   gettimeofday(&t2, NULL);
-  mqueue->millis_waiting_push += difftimeval(&t1, &t2);
+  __atomic_fetch_add(&(mqueue->millis_waiting_push), (size_t)(1000*difftimeval(&t1, &t2)), __ATOMIC_RELAXED);
 
   if (loglevel == LOG_DEBUG) {
     syslog(LOG_DEBUG, "mqueue - %s.push(%s, %p, %s, %zu) = %s, etime = %.3lf sec",
@@ -431,9 +758,96 @@ int mqueue_push(mqueue_t *mqueue, short type, void *obj, bool unique, size_t mil
   return rc;
 }
 
+/**************************************************************************//**
+ * @see mqueue_push_int
+ * @details Appends to the given lane (see mqueue_init_lanes). On a queue
+ *          without lanes it behaves like mqueue_push (unique=false).
+ */
+int mqueue_push_lane(mqueue_t *mqueue, size_t lane, short type, void *obj, size_t millis)
+{
+  struct timeval t1 = {0};
+  gettimeofday(&t1, NULL);
+
+  int rc = mqueue_push_int(mqueue, lane, type, obj, false, millis);
+
+  struct timeval t2 = {0};
+  gettimeofday(&t2, NULL);
+  __atomic_fetch_add(&(mqueue->millis_waiting_push), (size_t)(1000*difftimeval(&t1, &t2)), __ATOMIC_RELAXED);
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.push_lane(%zu, %s, %p, %zu) = %s, etime = %.3lf sec",
+         mqueue->name,
+         lane,
+         msg_type_str(type),
+         obj,
+         millis,
+         (rc==0?"OK":msg_type_str(rc)),
+         difftimeval(&t1, &t2));
+  }
+
+  return rc;
+}
+
+/**************************************************************************//**
+ * @brief Retrieves several messages from the lock-free lanes.
+ * @details Waits on the mqueue condition while all lanes are empty.
+ * @see mqueue_pop_n
+ */
+static size_t mqueue_pop_n_lanes(mqueue_t *mqueue, msg_t *msgs, size_t num, size_t millis)
+{
+  int rc = 0;
+  size_t ret = 0;
+  struct timespec ts = {0};
+  struct timespec *pts = NULL;
+
+  if (millis > 0) {
+    ts = mqueue_timespec(millis);
+    pts = &ts;
+  }
+
+  pthread_mutex_lock(&(mqueue->mutex));
+  // announced before checking the lanes (see mqueue_lanes_wakeup)
+  __atomic_fetch_add(&(mqueue->pop_waiters), 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while (rc == 0 && mqueue->open && (ret = mqueue_lanes_take_n(mqueue, msgs, num)) == 0) {
+    rc = mqueue_cond_wait(&(mqueue->tcond1), &(mqueue->mutex), pts);
+  }
+  __atomic_fetch_sub(&(mqueue->pop_waiters), 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&(mqueue->mutex));
+
+  if (ret == 0) {
+    msgs[0] = msg_create((rc != 0 ? rc : MSG_TYPE_CLOSE), NULL);
+  }
+
+  __atomic_fetch_add(&(mqueue->num_delivered_msgs), ret, __ATOMIC_RELAXED);
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.pop_n(%zu, %zu) = %zu", mqueue->name, num, millis, ret);
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves a message from the lock-free ring.
+ * @see mqueue_pop_int
+ */
+static msg_t mqueue_pop_ring(mqueue_t *mqueue, size_t millis)
+{
+  msg_t ret;
+
+  int rc = ring_pop(mqueue->ring, &ret, millis);
+  if (rc != 0) {
+    return(msg_create(rc, NULL));
+  }
+
+  __atomic_fetch_add(&(mqueue->num_delivered_msgs), 1, __ATOMIC_RELAXED);
+  return(ret);
+}
+
 /**************************************************************************//**
  * @brief Retrieves an object from mqueue.
- * @details Assumes that this function is called uniquely by subscriber.
+ * @details Several subscribers can wait concurrently (close wakes up all).
  * @details Waits until an object is available or timeout is elapsed.
  * @param[in,out] mqueue Message queue object.
  * @param[in] millis Milliseconds to wait before return (0=waits forever).
@@ -451,6 +865,14 @@ static inline msg_t mqueue_pop_int(mqueue_t *mqueue, size_t millis)
     assert(false);
     return(msg_create(MSG_TYPE_ERROR, NULL));
   }
+  else if (mqueue->ring != NULL) {
+    return(mqueue_pop_ring(mqueue, millis));
+  }
+  else if (mqueue_has_rings(mqueue)) {
+    msg_t ret;
+    mqueue_pop_n_lanes(mqueue, &ret, 1, millis);
+    return(ret);
+  }
   else if (!mqueue->open) {
     return(msg_create(MSG_TYPE_CLOSE, NULL));
   }
@@ -481,6 +903,10 @@ static inline msg_t mqueue_pop_int(mqueue_t *mqueue, size_t millis)
 
   // retrieve message
   assert(mqueue->length > 0);
+  if (mqueue->lanes != NULL) {
+    ret = mqueue_lane_take(mqueue);
+    goto mqueue_pop_exit;
+  }
   ret = mqueue->buffer[mqueue->front];
 
   // reset slot (not strictly necessary)
@@ -511,7 +937,7 @@ msg_t mqueue_pop(mqueue_t *mqueue, size_t millis)
 
   struct timeval t2 = {0};
   gettimeofday(&t2, NULL);
-  mqueue->millis_waiting_pop += difftimeval(&t1, &t2);
+  __atomic_fetch_add(&(mqueue->millis_waiting_pop), (size_t)(1000*difftimeval(&t1, &t2)), __ATOMIC_RELAXED);
 
   if (loglevel == LOG_DEBUG) {
     syslog(LOG_DEBUG, "mqueue - %s.pop(%zu) = [%s, %p], etime = %.3lf sec",
@@ -525,6 +951,295 @@ msg_t mqueue_pop(mqueue_t *mqueue, size_t millis)
   return ret;
 }
 
+/**************************************************************************//**
+ * @brief Appends several messages to the lock-free ring.
+ * @see mqueue_push_n
+ */
+static size_t mqueue_push_n_ring(mqueue_t *mqueue, const msg_t *msgs, size_t num, size_t millis)
+{
+  size_t ret = ring_push_n(mqueue->ring, msgs, num, millis);
+
+  __atomic_fetch_add(&(mqueue->num_incoming_msgs), ret, __ATOMIC_RELAXED);
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.push_n(%zu, %zu) = %zu", mqueue->name, num, millis, ret);
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Appends several messages to a lock-free lane.
+ * @see mqueue_push_n
+ */
+static size_t mqueue_push_n_lanes(mqueue_t *mqueue, size_t lane, const msg_t *msgs, size_t num, size_t millis)
+{
+  size_t ret = 0;
+
+  while (ret < num && mqueue_push_lanes(mqueue, lane, msgs[ret], false, millis) == 0) {
+    ret++;
+  }
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.push_n_lane(%zu, %zu, %zu) = %zu", mqueue->name, lane, num, millis, ret);
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Appends several messages to the message queue.
+ * @details Messages are appended holding the lock once (while there is
+ *          room) and waiting subscribers are woken up once. Duplicates are
+ *          allowed (see mqueue_push with unique=false).
+ * @param[in,out] mqueue Message queue object.
+ * @param[in] lane Lane index (only queues having lanes).
+ * @param[in] msgs Messages to append.
+ * @param[in] num Number of messages.
+ * @param[in] millis Milliseconds to wait (if full) before return (0=waits forever).
+ * @return Number of appended messages (less than num if the message queue
+ *         is closed, timeout expired or an error ocurred).
+ */
+static inline size_t mqueue_push_n_int(mqueue_t *mqueue, size_t lane, const msg_t *msgs, size_t num, size_t millis)
+{
+  if (mqueue == NULL || (msgs == NULL && num > 0)) {
+    assert(false);
+    return(0);
+  }
+  else if (!mqueue->open || num == 0) {
+    return(0);
+  }
+  else if (mqueue->ring != NULL) {
+    return(mqueue_push_n_ring(mqueue, msgs, num, millis));
+  }
+  else if (mqueue_has_rings(mqueue)) {
+    return(mqueue_push_n_lanes(mqueue, lane, msgs, num, millis));
+  }
+
+  int rc = 0;
+  size_t ret = 0;
+  struct timespec ts = {0};
+  struct timespec *pts = NULL;
+  struct timeval t1 = {0};
+  struct timeval t2 = {0};
+
+  gettimeofday(&t1, NULL);
+
+  if (millis > 0) {
+    ts = mqueue_timespec(millis);
+    pts = &ts;
+  }
+
+  pthread_mutex_lock(&(mqueue->mutex));
+
+  while (ret < num && rc == 0)
+  {
+    while (rc == 0 && mqueue->open &&
+           mqueue->max_capacity > 0 && mqueue->length >= mqueue->max_capacity) {
+      // let subscribers consume the already appended messages
+      pthread_cond_broadcast(&(mqueue->tcond1));
+      rc = mqueue_cond_wait(&(mqueue->tcond2), &(mqueue->mutex), pts);
+    }
+    if (rc != 0 || !mqueue->open) {
+      break;
+    }
+
+    if (mqueue->lanes != NULL) {
+      if (mqueue_lane_append(mqueue, lane, msgs[ret]) != 0) {
+        break;
+      }
+      ret++;
+      continue;
+    }
+
+    // if mqueue is full then increase capacity
+    if (mqueue->length >= mqueue->capacity && mqueue_resize(mqueue) != 0) {
+      break;
+    }
+
+    // copy messages while there is room
+    size_t room = mqueue->capacity - mqueue->length;
+    if (mqueue->max_capacity > 0) {
+      room = MIN(room, mqueue->max_capacity - mqueue->length);
+    }
+    for(size_t i=0; i<room && ret<num; i++, ret++) {
+      size_t pos = (mqueue->front+mqueue->length)%(mqueue->capacity);
+      mqueue->buffer[pos] = msgs[ret];
+      mqueue->length++;
+      mqueue->num_incoming_msgs++;
+    }
+  }
+
+  if (ret > 1) {
+    pthread_cond_broadcast(&(mqueue->tcond1));
+  }
+  else {
+    pthread_cond_signal(&(mqueue->tcond1));
+  }
+  pthread_mutex_unlock(&(mqueue->mutex));
+
+  gettimeofday(&t2, NULL);
+  __atomic_fetch_add(&(mqueue->millis_waiting_push), (size_t)(1000*difftimeval(&t1, &t2)), __ATOMIC_RELAXED);
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.push_n(%zu, %zu) = %zu, etime = %.3lf sec",
+           mqueue->name, num, millis, ret, difftimeval(&t1, &t2));
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @see mqueue_push_n_int
+ * @details Messages go to lane 0 on a queue having lanes.
+ */
+size_t mqueue_push_n(mqueue_t *mqueue, const msg_t *msgs, size_t num, size_t millis)
+{
+  return(mqueue_push_n_int(mqueue, 0, msgs, num, millis));
+}
+
+/**************************************************************************//**
+ * @see mqueue_push_n_int
+ * @details Appends to the given lane (see mqueue_init_lanes). On a queue
+ *          without lanes it behaves like mqueue_push_n.
+ */
+size_t mqueue_push_n_lane(mqueue_t *mqueue, size_t lane, const msg_t *msgs, size_t num, size_t millis)
+{
+  return(mqueue_push_n_int(mqueue, lane, msgs, num, millis));
+}
+
+/**************************************************************************//**
+ * @brief Retrieves several messages from the lock-free ring.
+ * @see mqueue_pop_n
+ */
+static size_t mqueue_pop_n_ring(mqueue_t *mqueue, msg_t *msgs, size_t num, size_t millis)
+{
+  size_t ret = ring_pop_n(mqueue->ring, msgs, num, millis);
+
+  __atomic_fetch_add(&(mqueue->num_delivered_msgs), ret, __ATOMIC_RELAXED);
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.pop_n(%zu, %zu) = %zu", mqueue->name, num, millis, ret);
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves several messages from mqueue.
+ * @details Waits until a message is available or timeout is elapsed. Then
+ *          retrieves up to num messages holding the lock once.
+ * @param[in,out] mqueue Message queue object.
+ * @param[out] msgs Retrieved messages (at least 1 slot).
+ * @param[in] num Maximum number of messages to retrieve.
+ * @param[in] millis Milliseconds to wait before return (0=waits forever).
+ * @return Number of retrieved messages. If 0 then msgs[0] contains the
+ *         error code (see mqueue_pop).
+ */
+size_t mqueue_pop_n(mqueue_t *mqueue, msg_t *msgs, size_t num, size_t millis)
+{
+  if (mqueue == NULL || msgs == NULL || num == 0) {
+    assert(false);
+    return(0);
+  }
+  else if (!mqueue->open) {
+    msgs[0] = msg_create(MSG_TYPE_CLOSE, NULL);
+    return(0);
+  }
+  else if (mqueue->ring != NULL) {
+    return(mqueue_pop_n_ring(mqueue, msgs, num, millis));
+  }
+  else if (mqueue_has_rings(mqueue)) {
+    return(mqueue_pop_n_lanes(mqueue, msgs, num, millis));
+  }
+
+  int rc = 0;
+  size_t ret = 0;
+  struct timespec ts = {0};
+  struct timespec *pts = NULL;
+  struct timeval t1 = {0};
+  struct timeval t2 = {0};
+
+  gettimeofday(&t1, NULL);
+
+  if (millis > 0) {
+    ts = mqueue_timespec(millis);
+    pts = &ts;
+  }
+
+  pthread_mutex_lock(&(mqueue->mutex));
+  while (rc == 0 && mqueue->open && mqueue->length == 0) {
+    rc = mqueue_cond_wait(&(mqueue->tcond1), &(mqueue->mutex), pts);
+  }
+
+  if (rc != 0) {
+    msgs[0] = msg_create(rc, NULL);
+  }
+  else if (!mqueue->open) {
+    msgs[0] = msg_create(MSG_TYPE_CLOSE, NULL);
+  }
+  else {
+    while (ret < num && mqueue->length > 0 && mqueue->lanes != NULL) {
+      msgs[ret++] = mqueue_lane_take(mqueue);
+    }
+    while (ret < num && mqueue->length > 0) {
+      msgs[ret] = mqueue->buffer[mqueue->front];
+      mqueue->buffer[mqueue->front] = msg_create(MSG_TYPE_NULL, NULL);
+      mqueue->front = (mqueue->front+1)%mqueue->capacity;
+      mqueue->length--;
+      mqueue->num_delivered_msgs++;
+      ret++;
+    }
+  }
+
+  if (ret > 1) {
+    pthread_cond_broadcast(&(mqueue->tcond2));
+  }
+  else {
+    pthread_cond_signal(&(mqueue->tcond2));
+  }
+  pthread_mutex_unlock(&(mqueue->mutex));
+
+  gettimeofday(&t2, NULL);
+  __atomic_fetch_add(&(mqueue->millis_waiting_pop), (size_t)(1000*difftimeval(&t1, &t2)), __ATOMIC_RELAXED);
+
+  if (loglevel == LOG_DEBUG) {
+    syslog(LOG_DEBUG, "mqueue - %s.pop_n(%zu, %zu) = %zu, etime = %.3lf sec",
+           mqueue->name, num, millis, ret, difftimeval(&t1, &t2));
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Returns the number of messages in the queue.
+ * @param[in] mqueue Message queue object.
+ * @return Number of messages (can change just after return).
+ */
+size_t mqueue_length(mqueue_t *mqueue)
+{
+  if (mqueue == NULL) {
+    assert(false);
+    return(0);
+  }
+  else if (mqueue->ring != NULL) {
+    return(ring_length(mqueue->ring));
+  }
+  else if (mqueue_has_rings(mqueue)) {
+    size_t ret = 0;
+    for(size_t i=0; i<mqueue->num_lanes; i++) {
+      ret += ring_length(mqueue->lanes[i].ring);
+    }
+    return(ret);
+  }
+
+  pthread_mutex_lock(&(mqueue->mutex));
+  size_t ret = mqueue->length;
+  pthread_mutex_unlock(&(mqueue->mutex));
+
+  return(ret);
+}
+
 /**************************************************************************//**
  * @brief Close the queue.
  * @details Caution, threads waiting for push/pop are not affected by close.
@@ -536,6 +1251,12 @@ void mqueue_close(mqueue_t *mqueue)
     assert(false);
     return;
   }
+  if (mqueue->ring != NULL) {
+    ring_close(mqueue->ring);
+  }
+  for(size_t i=0; mqueue_has_rings(mqueue) && i<mqueue->num_lanes; i++) {
+    ring_close(mqueue->lanes[i].ring);
+  }
   pthread_mutex_lock(&(mqueue->mutex));
   mqueue->open = false;
   pthread_cond_broadcast(&(mqueue->tcond1));
@@ -47,6 +47,10 @@ typedef struct msg_t
  *        - push() blocks if max capacity exceeded
  *        - pop() blocks if no elements
  *        - timeout support in push()/pop()
+ *        - batched push_n()/pop_n() (one lock and one wakeup per call)
+ *        - lock-free variant (fixed capacity, no unique, see ring_t)
+ *        - priority lanes variant (weighted fair pop, no unique)
+ *        - lock-free priority lanes variant (one ring per lane)
  */
 typedef struct mqueue_t
 {
@@ -78,14 +82,34 @@ typedef struct mqueue_t
   size_t millis_waiting_pop;
   //! Indicate if mqueue is open or closed.
   bool open;
+  //! Lock-free ring (NULL = mutex based queue).
+  struct ring_t *ring;
+  //! Priority lanes (NULL = single lane, see mqueue_init_lanes).
+  struct mqueue_t *lanes;
+  //! Number of lanes.
+  size_t num_lanes;
+  //! Lanes weight (share of pops when all lanes are backlogged).
+  int *weights;
+  //! Lanes credit (see swrr_select).
+  int *credits;
+  //! Number of subscribers waiting on lock-free lanes.
+  unsigned int pop_waiters;
 } mqueue_t;
 
 /**************************************************************************
  * Function declarations.
  */
 extern int mqueue_init(mqueue_t *mqueue, const char *name, size_t max_capacity);
+extern int mqueue_init_lockfree(mqueue_t *mqueue, const char *name, size_t capacity);
+extern int mqueue_init_lanes(mqueue_t *mqueue, const char *name, size_t max_capacity, const int *weights, size_t num_lanes);
+extern int mqueue_init_lockfree_lanes(mqueue_t *mqueue, const char *name, size_t capacity, const int *weights, size_t num_lanes);
 extern int mqueue_push(mqueue_t *mqueue, short type, void *obj, bool unique, size_t millis);
+extern int mqueue_push_lane(mqueue_t *mqueue, size_t lane, short type, void *obj, size_t millis);
 extern msg_t mqueue_pop(mqueue_t *mqueue, size_t millis);
+extern size_t mqueue_push_n(mqueue_t *mqueue, const msg_t *msgs, size_t num, size_t millis);
+extern size_t mqueue_push_n_lane(mqueue_t *mqueue, size_t lane, const msg_t *msgs, size_t num, size_t millis);
+extern size_t mqueue_pop_n(mqueue_t *mqueue, msg_t *msgs, size_t num, size_t millis);
+extern size_t mqueue_length(mqueue_t *mqueue);
 extern void mqueue_reset(mqueue_t *mqueue, void (*item_free)(void*));
 extern void mqueue_close(mqueue_t *mqueue);
 
@@ -109,8 +133,11 @@ extern void mqueue_close(mqueue_t *mqueue);
 #define MSG_TYPE_FILE0 21
 // Message type indicating a witem to close.
 #define MSG_TYPE_FILE1 22
+// Message type indicating pending pieces of a split witem.
+#define MSG_TYPE_TASK 23
 
-// Message type indicating a matched content.
-#define MSG_TYPE_MATCH1 31
+// Message type indicating a batch of parsed rows (see batch_t).
+#define MSG_TYPE_BATCH 31
 
 #endif
+
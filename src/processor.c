@@ -26,40 +26,206 @@
 #include <string.h>
 #include <stdbool.h>
 #include "time.h"
+#include <unistd.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <syslog.h>
 #include <pcre2.h>
 #include <assert.h>
+#include "config.h"
 #include "stringbuf.h"
 #include "witem.h"
-#include "wdata.h"
+#include "batch.h"
+#include "slab.h"
+#include "structured.h"
+#include "builtin.h"
+#include "scan.h"
 #include "utils.h"
+#include "fmap.h"
 #include "processor.h"
 
+#define DEFAULT_MAX_WORKERS 16
+#define MAX_WORKERS 256
+
+#define SPLIT_MIN_PIECE_SIZE 65536
+#define MMAP_WINDOW_SIZE (64*1024*1024)
+#define DEFAULT_BUFFERS_MEMORY (256*1024*1024)
+#define DEFAULT_MEMORY_BUDGET (1024*1024*1024)
+// Reading resumes when memory falls below this percent of budget.
+#define MEMORY_LOW_WATERMARK 75
+#define MEMORY_POLL_MILLIS 10
+// Files are deferred when their writer queue exceeds this percent of capacity.
+#define WRITER_HIGH_WATERMARK 75
+// Deferred files are resumed when their writer queue is below this percent.
+#define WRITER_LOW_WATERMARK 50
+#define DEFER_RETRY_MILLIS 100
+#define DEFAULT_QUANTUM (4*1024*1024)
+#define BATCH_MAX_ROWS 1024
+// Split size used by backfill when split-size is not set.
+#define BACKFILL_SPLIT_SIZE (8*1024*1024)
+#define BACKFILL_REPORT_MILLIS 10000
+#define BACKFILL_DROP_BYTES (8*1024*1024)
+
+#define PROCESSOR_PARAM_WORKERS "workers"
+#define PROCESSOR_PARAM_SPLIT_SIZE "split-size"
+#define PROCESSOR_PARAM_READER "reader"
+#define PROCESSOR_PARAM_BUFFERS_MEMORY "buffers-memory"
+#define PROCESSOR_PARAM_MEMORY_BUDGET "memory-budget"
+#define PROCESSOR_PARAM_QUANTUM "quantum"
+
+static const char *PROCESSOR_PARAMS[] = {
+    PROCESSOR_PARAM_WORKERS,
+    PROCESSOR_PARAM_SPLIT_SIZE,
+    PROCESSOR_PARAM_READER,
+    PROCESSOR_PARAM_BUFFERS_MEMORY,
+    PROCESSOR_PARAM_MEMORY_BUDGET,
+    PROCESSOR_PARAM_QUANTUM,
+    NULL
+};
+
+static const char *READER_TYPES[] = {
+    "stdio",
+    "mmap",
+    NULL
+};
+
 /**************************************************************************//**
  * @brief Types of database connection status.
  */
 typedef enum {
   DISCARD_BUFFER_FULL,      // Buffer full.
   DISCARD_NO_MATCH_PATTERN, // Values not found.
-  DISCARD_INTER_CHUNK       // Inter-chunk content.
+  DISCARD_INTER_CHUNK,      // Inter-chunk content.
+  DISCARD_INVALID_TIMESTAMP // Timestamp not parsed.
 } discard_cause_e;
 
+/**************************************************************************//**
+ * @brief Region of a split buffer parsed by a worker.
+ */
+typedef struct piece_t
+{
+  //! Forked item restricted to the region (parsed rows in its batch).
+  witem_t *item;
+  //! Number of bytes processed.
+  size_t length;
+  //! Last region (its incomplete chunk remains in buffer).
+  bool last;
+  //! File truncated while parsing (SIGBUS).
+  bool truncated;
+} piece_t;
+
+/**************************************************************************//**
+ * @brief Buffer of a witem split in pieces.
+ * @details Members next and done are protected by processor mutex.
+ */
+typedef struct split_t
+{
+  //! Pieces in file order.
+  piece_t *pieces;
+  //! Number of pieces.
+  size_t num;
+  //! Next piece to process.
+  size_t next;
+  //! Number of processed pieces.
+  size_t done;
+} split_t;
+
+// Forward declaration.
+static void process_witem(processor_t *, witem_t *);
+
 /**************************************************************************//**
  * @brief Initialize the processor.
+ * @details Number of workers defaults to the number of online processors.
+ *          Backfill mode enables the split of buffers when split-size is
+ *          not set.
  * @param[in,out] processor Processor object.
+ * @param[in] cfg Configuration object.
  * @param[in] mqueue1 Message queue (monitor -> processor).
- * @param[in] mqueue2 Message queue (processor -> database).
+ * @param[in] mqueues Message queues (processor -> database, one per writer).
+ * @param[in] num_writers Number of writers.
+ * @param[in] backfill Backfill existing file contents.
  * @return 0=OK, otherwise an error ocurred.
  */
-int processor_init(processor_t *processor, mqueue_t *mqueue1, mqueue_t *mqueue2)
+int processor_init(processor_t *processor, const config_t *cfg, mqueue_t *mqueue1, mqueue_t *mqueues, size_t num_writers, bool backfill)
 {
-  if (processor == NULL || mqueue1 == NULL || mqueue2 == NULL) {
+  if (processor == NULL || cfg == NULL || mqueue1 == NULL || mqueues == NULL || num_writers == 0) {
     assert(false);
     return(1);
   }
 
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  processor->workers = (nprocs < 1 ? 1 : MIN((size_t) nprocs, DEFAULT_MAX_WORKERS));
+  processor->split_size = 0;
+  processor->reader = READER_STDIO;
+  processor->buffers_memory = DEFAULT_BUFFERS_MEMORY;
+  processor->memory_budget = DEFAULT_MEMORY_BUDGET;
+  processor->quantum = DEFAULT_QUANTUM;
+  processor->backfill = backfill;
+
+  // processor entry is optional
+  config_setting_t *parent = config_lookup(cfg, "processor");
+  if (parent != NULL) {
+    int rc = setting_check_childs(parent, PROCESSOR_PARAMS);
+    rc |= setting_read_uint(parent, PROCESSOR_PARAM_WORKERS, &(processor->workers));
+    rc |= setting_read_uint(parent, PROCESSOR_PARAM_SPLIT_SIZE, &(processor->split_size));
+    rc |= setting_read_uint(parent, PROCESSOR_PARAM_BUFFERS_MEMORY, &(processor->buffers_memory));
+    rc |= setting_read_uint(parent, PROCESSOR_PARAM_MEMORY_BUDGET, &(processor->memory_budget));
+    rc |= setting_read_uint(parent, PROCESSOR_PARAM_QUANTUM, &(processor->quantum));
+    const char *reader = NULL;
+    config_setting_lookup_string(parent, PROCESSOR_PARAM_READER, &reader);
+    if (reader != NULL) {
+      int i = 0;
+      while (READER_TYPES[i] != NULL && strcmp(READER_TYPES[i], reader) != 0) i++;
+      if (READER_TYPES[i] == NULL) {
+        config_setting_t *aux = config_setting_get_member(parent, PROCESSOR_PARAM_READER);
+        syslog(LOG_ERR, "invalid processor " PROCESSOR_PARAM_READER " '%s' at %s:%d.", reader,
+               config_setting_source_file(aux),
+               config_setting_source_line(aux));
+        rc = 1;
+      }
+      else {
+        processor->reader = (reader_type_e) i;
+      }
+    }
+    if (rc != 0) {
+      return(1);
+    }
+    if (processor->workers < 1 || processor->workers > MAX_WORKERS) {
+      syslog(LOG_ERR, PROCESSOR_PARAM_WORKERS " out of range [1, %d] at %s:%d.", MAX_WORKERS,
+             config_setting_source_file(parent),
+             config_setting_source_line(parent));
+      return(1);
+    }
+  }
+
+  if (processor->backfill && processor->split_size == 0) {
+    processor->split_size = BACKFILL_SPLIT_SIZE;
+  }
+
   processor->mqueue1 = mqueue1;
-  processor->mqueue2 = mqueue2;
+  processor->mqueues = mqueues;
+  processor->num_writers = num_writers;
+  atomic_init(&(processor->running), processor->workers);
+  atomic_init(&(processor->paused), 0);
+  processor->splits = (vector_t){0};
+  processor->deferred = (vector_t){0};
+  atomic_init(&(processor->num_deferred), 0);
+  pthread_mutex_init(&(processor->mutex), NULL);
+  pthread_cond_init(&(processor->cond), NULL);
+
+  if (processor->reader == READER_MMAP) {
+    fmap_init();
+  }
+
+  if (gethostname(processor->hostname, sizeof(processor->hostname)) != 0) {
+    processor->hostname[0] = '\0';
+  }
+  processor->hostname[sizeof(processor->hostname)-1] = '\0';
+
+  syslog(LOG_DEBUG, "processor - params = [workers=%zu, split-size=%zu, reader=%s, buffers-memory=%zu, memory-budget=%zu, quantum=%zu, backfill=%s]",
+         processor->workers, processor->split_size, READER_TYPES[processor->reader], processor->buffers_memory,
+         processor->memory_budget, processor->quantum, (processor->backfill ? "yes" : "no"));
 
   return(0);
 }
@@ -72,8 +238,97 @@ void processor_reset(processor_t *processor)
 {
   if (processor != NULL) {
     processor->mqueue1 = NULL;
-    processor->mqueue2 = NULL;
+    processor->mqueues = NULL;
+    processor->num_writers = 0;
+    processor->hostname[0] = '\0';
+    processor->workers = 0;
+    processor->split_size = 0;
+    processor->backfill = false;
+    vector_reset(&(processor->splits), NULL);
+    // deferred files are queued (see processor_defer)
+    vector_reset(&(processor->deferred), witem_drop);
+    atomic_store(&(processor->num_deferred), 0);
+    pthread_cond_destroy(&(processor->cond));
+    pthread_mutex_destroy(&(processor->mutex));
+  }
+}
+
+/**************************************************************************//**
+ * @brief Returns the line number at a buffer position.
+ * @details Lines are counted incrementally, so positions must be requested
+ *          in increasing order (each byte is scanned only once).
+ * @param[in,out] item Watched item.
+ * @param[in] pos Position in buffer.
+ * @return Line number (1-based), 0 if lines are not tracked.
+ */
+static size_t witem_line_at(witem_t *item, size_t pos)
+{
+  if (!item->lines) {
+    return(0);
+  }
+
+  assert(pos >= item->line_pos);
+  assert(pos <= item->buffer_pos);
+
+  item->line += scan_count(item->buffer + item->line_pos, item->buffer + pos, '\n');
+  item->line_pos = pos;
+  return(item->line);
+}
+
+/**************************************************************************//**
+ * @brief Removes the first bytes of buffer.
+ * @details Updates the file offset and line number of the buffer begin.
+ *          Mapped buffers are advanced (no copies).
+ * @param[in,out] item Watched item.
+ * @param[in] len Number of bytes to remove.
+ */
+static void witem_consume(witem_t *item, size_t len)
+{
+  assert(len <= item->buffer_pos);
+
+  witem_line_at(item, len);
+  if (item->map != NULL) {
+    item->buffer += len;
+  }
+  else if (item->ring != NULL) {
+    item->buffer += len;
+    if (item->buffer >= item->ring + item->buffer_length) {
+      item->buffer -= item->buffer_length;
+    }
   }
+  else {
+    memmove(item->buffer, item->buffer + len, item->buffer_pos - len);
+  }
+  item->buffer_pos -= len;
+  item->offset += len;
+  item->line_pos = 0;
+}
+
+/**************************************************************************//**
+ * @brief Returns the discard file of a witem (opened on first use).
+ * @details Forked items discard to a temporary file that is appended to the
+ *          discard file of origin when pieces are re-sequenced.
+ * @param[in,out] item Watched item.
+ * @return The discard file, NULL if not set or error.
+ */
+static FILE* witem_discard_file(witem_t *item)
+{
+  if (item->discard != NULL) {
+    return(item->discard);
+  }
+
+  char *filename = witem_discard_filename(item);
+  if (filename == NULL) {
+    return(NULL);
+  }
+
+  item->discard = (item->origin != NULL ? tmpfile() : fopen(filename, "a"));
+  if (item->discard == NULL) {
+    syslog(LOG_WARNING, "error opening file '%s' - %s", filename, strerror(errno));
+  }
+  free(filename);
+
+  return(item->discard);
 }
 
 /**************************************************************************//**
@@ -84,32 +339,25 @@ void processor_reset(processor_t *processor)
  */
 static void processor_discard(witem_t *item, discard_cause_e cause, const char *ptr, size_t len)
 {
-  syslog(LOG_DEBUG, "processor - discarded content '%.*s'", (int)(len), ptr);
+  long long offset = (long long)(item->offset + (ptr - item->buffer));
 
-  if (item->discard == NULL) {
-    char *filename = witem_discard_filename(item);
-    if (filename != NULL) {
-      item->discard = fopen(filename, "a");
-      if (item->discard == NULL) {
-        syslog(LOG_WARNING, "error opening file '%s' - %s", filename, strerror(errno));
-      }
-      free(filename);
-    }
-  }
+  // content is not logged (mapped content can raise SIGBUS inside syslog)
+  syslog(LOG_DEBUG, "processor - discarded content (file=%s, offset=%lld, length=%zu)", item->filename, offset, len);
 
-  if (item->discard == NULL) {
+  FILE *file = witem_discard_file(item);
+  if (file == NULL) {
     return;
   }
 
-  FILE *file = item->discard;
+  size_t line = witem_line_at(item, ptr - item->buffer);
   const char *cause_str = NULL;
   time_t timer;
   char timestamp[26];
-  struct tm* tm_info;
+  struct tm tm_info;
 
   time(&timer);
-  tm_info = localtime(&timer);
-  strftime(timestamp, 26, "%Y-%m-%d %H:%M:%S", tm_info);
+  localtime_r(&timer, &tm_info);
+  strftime(timestamp, 26, "%Y-%m-%d %H:%M:%S", &tm_info);
 
   switch(cause) {
     case DISCARD_BUFFER_FULL:
@@ -121,11 +369,20 @@ static void processor_discard(witem_t *item, discard_cause_e cause, const char *
     case DISCARD_INTER_CHUNK:
       cause_str = "inter-chunk content";
       break;
+    case DISCARD_INVALID_TIMESTAMP:
+      cause_str = "invalid timestamp";
+      break;
   }
 
-  //TODO: add line number
-  fprintf(file, "%s - file=%s, cause=%s\n", timestamp, item->filename, cause_str);
-  fwrite(ptr, sizeof(char), len, file);
+  // line numbers are only tracked when $_LINE is used
+  if (line > 0) {
+    fprintf(file, "%s - file=%s, line=%zu, cause=%s\n", timestamp, item->filename, line, cause_str);
+  }
+  else {
+    fprintf(file, "%s - file=%s, offset=%lld, cause=%s\n", timestamp, item->filename, offset, cause_str);
+  }
+  // only the item owner writes (unlocked, ptr can raise SIGBUS if mapped)
+  fwrite_unlocked(ptr, sizeof(char), len, file);
   fflush(file);
 }
 
@@ -154,38 +411,258 @@ static int witem_flush_buffer(witem_t *item)
     return(9);
   }
 
-  item->buffer_pos = 0;
+  witem_consume(item, item->buffer_pos);
   item->buffer[0] = '\0';
   return(0);
 }
 
+/**************************************************************************//**
+ * @brief Memory accounted by the memory budget.
+ * @details File buffers (mapped files excluded) plus parsed rows, either
+ *          being built, queued to the database thread, or pending in the
+ *          current transaction (all rows are allocated from slab).
+ * @return Memory used (in bytes).
+ */
+static size_t processor_memory(void)
+{
+  return(witem_buffers_memory() + slab_used());
+}
+
+/**************************************************************************//**
+ * @brief Pauses reading while the memory budget is exceeded.
+ * @details Called before reading new content. When the memory used exceeds
+ *          the budget (high watermark), the worker waits until it falls
+ *          below MEMORY_LOW_WATERMARK percent of budget. It also resumes if
+ *          there are no rows left to drain (buffers alone exceed budget)
+ *          or if the processor is closing.
+ * @param[in] processor Processor parameters.
+ */
+static void processor_throttle(processor_t *processor)
+{
+  if (processor->memory_budget == 0 || processor_memory() <= processor->memory_budget) {
+    return;
+  }
+
+  size_t low = processor->memory_budget / 100 * MEMORY_LOW_WATERMARK;
+  struct timespec ts = {0, MEMORY_POLL_MILLIS * 1000000};
+
+  if (atomic_fetch_add(&(processor->paused), 1) == 0) {
+    syslog(LOG_WARNING, "processor - memory budget exceeded, reading paused [buffers=%zu, rows=%zu, budget=%zu]",
+           witem_buffers_memory(), slab_used(), processor->memory_budget);
+  }
+
+  while (processor->mqueue1->open && slab_used() > 0 && processor_memory() > low) {
+    nanosleep(&ts, NULL);
+  }
+
+  if (atomic_fetch_sub(&(processor->paused), 1) == 1) {
+    syslog(LOG_INFO, "processor - reading resumed [buffers=%zu, rows=%zu]",
+           witem_buffers_memory(), slab_used());
+  }
+}
+
+/**************************************************************************//**
+ * @brief Returns the queue to the writer of the item table.
+ * @param[in] processor Processor parameters.
+ * @param[in] item Watched item (or fork).
+ * @return Message queue.
+ */
+static mqueue_t* processor_mqueue(processor_t *processor, const witem_t *item)
+{
+  const table_t *table = ((file_t *) item->ptr)->table;
+  assert(table->writer < processor->num_writers);
+  return(processor->mqueues + table->writer);
+}
+
+/**************************************************************************//**
+ * @brief Sends the parsed rows of a witem to the database thread.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item (batch is released).
+ */
+static void processor_send(processor_t *processor, witem_t *item)
+{
+  if (item->batch == NULL || item->batch->num_rows == 0) {
+    return;
+  }
+
+  mqueue_push_lane(processor_mqueue(processor, item), witem_priority(item), MSG_TYPE_BATCH, item->batch, 0);
+  item->batch = NULL;
+}
+
+/**************************************************************************//**
+ * @brief Defers a file if its writer is congested.
+ * @details Called before reading new content. When the writer queue of
+ *          the file table exceeds WRITER_HIGH_WATERMARK percent of its
+ *          capacity, reading stops and the file is re-queued later (see
+ *          processor_resume). So a stalled table only holds back the files
+ *          feeding it. The item is flagged as queued (see witem_notify),
+ *          so it is not freed meanwhile.
+ * @param[in,out] processor Processor parameters.
+ * @param[in,out] item Watched item (owned by caller).
+ * @return true=file deferred (stop processing), false=otherwise.
+ */
+static bool processor_defer(processor_t *processor, witem_t *item)
+{
+  mqueue_t *mqueue = processor_mqueue(processor, item);
+  table_t *table = ((file_t *) item->ptr)->table;
+
+  if (mqueue_length(mqueue) * 100 < mqueue->max_capacity * WRITER_HIGH_WATERMARK) {
+    return(false);
+  }
+
+  atomic_fetch_add(&(table->num_deferred), 1);
+  syslog(LOG_DEBUG, "processor - file %s deferred [table=%s, writer=%s]",
+         item->filename, table->name, table->writer_name);
+
+  // already notified (will be processed again)
+  if (!witem_notify(item, false)) {
+    return(true);
+  }
+
+  pthread_mutex_lock(&(processor->mutex));
+  vector_insert(&(processor->deferred), item);
+  atomic_fetch_add(&(processor->num_deferred), 1);
+  pthread_mutex_unlock(&(processor->mutex));
+
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Charges processed bytes to the file turn (deficit round-robin).
+ * @details Each turn a file earns quantum bytes (see process_witem). When
+ *          they are spent and other messages are pending, the file is
+ *          re-queued behind them, so a file with a huge backlog doesn't
+ *          monopolize a worker. Overrun bytes (eg. a mmap window) are
+ *          charged to the next turn.
+ * @param[in,out] processor Processor parameters.
+ * @param[in,out] item Watched item (owned by caller).
+ * @param[in] bytes Processed bytes.
+ * @return true=turn ended (stop processing), false=otherwise.
+ */
+static bool processor_yield(processor_t *processor, witem_t *item, size_t bytes)
+{
+  if (processor->quantum == 0 || item->origin != NULL) {
+    return(false);
+  }
+
+  item->deficit -= (long long) bytes;
+  if (item->deficit > 0) {
+    return(false);
+  }
+
+  // nobody is waiting: a new turn starts
+  if (mqueue_length(processor->mqueue1) == 0) {
+    item->deficit = (long long) processor->quantum;
+    return(false);
+  }
+
+  syslog(LOG_DEBUG, "processor - file %s yields its turn", item->filename);
+
+  if (witem_yield(item)) {
+    mqueue_push_lane(processor->mqueue1, witem_priority(item), MSG_TYPE_FILE0, item, 0);
+  }
+
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Continues the catch-up of a file with the next rotated file.
+ * @details Rotated files are read one at a time, oldest first, before the
+ *          live file (see monitor_catchup). The live file is owned by the
+ *          catch-up meanwhile, so its notifications are kept pending (see
+ *          witem_claim). When the last rotated file has been read, the live
+ *          file is queued and released.
+ * @param[in,out] processor Processor parameters.
+ * @param[in,out] item Rotated file read up to EOF (owned by caller).
+ */
+static void processor_handover(processor_t *processor, witem_t *item)
+{
+  witem_t *live = item->live;
+  item->live = NULL;
+
+  while(item->catchup.size > 0)
+  {
+    char *filename = (char *) item->catchup.data[0];
+    vector_remove(&(item->catchup), 0, NULL);
+    witem_t *next = witem_alloc(filename, WITEM_FILE, item->ptr, true);
+    free(filename);
+    if (next == NULL) {
+      continue;
+    }
+
+    syslog(LOG_INFO, "processor - catching up file %s", next->filename);
+    next->catchup = item->catchup;
+    next->live = live;
+    item->catchup = (vector_t){0};
+    if (witem_notify(next, true)) {
+      mqueue_push_lane(processor->mqueue1, witem_priority(next), MSG_TYPE_FILE1, next, 0);
+    }
+    return;
+  }
+
+  syslog(LOG_INFO, "processor - file %s caught up", live->filename);
+  if (witem_yield(live)) {
+    mqueue_push_lane(processor->mqueue1, witem_priority(live), MSG_TYPE_FILE0, live, 0);
+  }
+
+  // queued message claimed meanwhile (notification transferred)
+  while(witem_release(live)) {
+    process_witem(processor, live);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Re-queues the deferred files whose writer is no longer congested.
+ * @param[in,out] processor Processor parameters.
+ */
+static void processor_resume(processor_t *processor)
+{
+  if (atomic_load(&(processor->num_deferred)) == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&(processor->mutex));
+  for(int i=(int) processor->deferred.size-1; i>=0; i--) {
+    witem_t *item = (witem_t *) processor->deferred.data[i];
+    mqueue_t *mqueue = processor_mqueue(processor, item);
+    if (mqueue_length(mqueue) * 100 <= mqueue->max_capacity * WRITER_LOW_WATERMARK) {
+      vector_remove(&(processor->deferred), i, NULL);
+      atomic_fetch_sub(&(processor->num_deferred), 1);
+      mqueue_push_lane(processor->mqueue1, witem_priority(item), MSG_TYPE_FILE0, item, 0);
+    }
+  }
+  pthread_mutex_unlock(&(processor->mutex));
+}
+
 /**************************************************************************//**
  * @brief Trace chunk values.
- * @param[in] md Match data.
- * @param[in] format File format.
+ * @param[in] item Watched item (values of current chunk).
  */
-static void trace_chunk_values(const char *str, pcre2_match_data *md, const format_t *format)
+static void trace_chunk_values(const witem_t *item)
 {
   if (loglevel != LOG_DEBUG) {
     return;
   }
 
   stringbuf_t aux = {0};
-  PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(md);
+  table_t *table = ((file_t *) item->ptr)->table;
 
   stringbuf_append(&aux, "[");
 
-  for(uint32_t i=0; i<format->parameters.size; i++)
+  for(uint32_t i=0; i<item->num_params; i++)
   {
     if (aux.length > 1) {
       stringbuf_append(&aux, ", ");
     }
 
-    stringbuf_append(&aux, format->parameters.data[i]);
+    stringbuf_append(&aux, table->parameters.data[i]);
     stringbuf_append(&aux, "=");
-    size_t pos = ovector[2*(i+1)];
-    int len = (int)(ovector[2*(i+1)+1] - ovector[2*(i+1)]);
-    stringbuf_append_n(&aux, str+pos, len);
+    if (item->values[i].ptr == NULL) {
+      stringbuf_append(&aux, "NULL");
+    }
+    else {
+      stringbuf_append_n(&aux, item->values[i].ptr, item->values[i].len);
+    }
   }
 
   stringbuf_append(&aux, "]");
@@ -195,7 +672,144 @@ static void trace_chunk_values(const char *str, pcre2_match_data *md, const form
 }
 
 /**************************************************************************//**
- * @brief Process an event.
+ * @brief Extract chunk values using the format regex.
+ * @details Unset substrings are NULL values.
+ * @see https://www.pcre.org/current/doc/html/pcre2api.html#SEC31
+ * @param[in,out] item Watched item.
+ * @param[in] format File format.
+ * @param[in] str String to process (not \0 terminated).
+ * @param[in] len Length of the string.
+ * @return 0=OK, otherwise=no match.
+ */
+static int regex_extract(witem_t *item, const format_t *format, const char *str, size_t len)
+{
+  int rc = pcre2_match(format->re_values, (PCRE2_SPTR)str, (PCRE2_SIZE)len, 0, PCRE2_NOTEMPTY, item->md_values, NULL);
+  if (rc < 0) {
+    return(1);
+  }
+
+  PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(item->md_values);
+
+  for(size_t i=0; i<item->num_params; i++) {
+    size_t j = item->param_pos[i];
+    if (ovector[2*(j+1)] == PCRE2_UNSET) {
+      item->values[i] = (value_t){NULL, 0};
+    }
+    else {
+      item->values[i].ptr = str + ovector[2*(j+1)];
+      item->values[i].len = ovector[2*(j+1)+1] - ovector[2*(j+1)];
+    }
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Extract chunk values using a built-in format.
+ * @param[in,out] item Watched item.
+ * @param[in] format File format.
+ * @param[in] str String to process (not \0 terminated).
+ * @param[in] len Length of the string.
+ * @return 0=OK, otherwise=malformed content.
+ */
+static int builtin_values(witem_t *item, const format_t *format, const char *str, size_t len)
+{
+  value_t fields[BUILTIN_MAX_PARAMS];
+
+  if (builtin_extract(format->builtin, str, len, fields) != 0) {
+    return(1);
+  }
+
+  for(size_t i=0; i<item->num_params; i++) {
+    item->values[i] = fields[item->param_pos[i]];
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Converts timestamp values to canonical form.
+ * @param[in,out] item Watched item (values of current chunk).
+ * @return 0=OK, otherwise=invalid timestamp.
+ */
+static int convert_timestamps(witem_t *item)
+{
+  if (item->tstamps == NULL) {
+    return(0);
+  }
+
+  for(size_t i=0; i<item->num_params; i++) {
+    tstamp_t *tstamp = item->tstamps + i;
+    value_t *value = item->values + i;
+    if (tstamp->layout == TSTAMP_NONE || value->ptr == NULL) {
+      continue;
+    }
+    if (tstamp_parse(tstamp, value->ptr, value->len, 0, value) != 0) {
+      return(1);
+    }
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Sets the values of reserved parameters.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item (values of current chunk).
+ * @param[in] pos Chunk position in buffer.
+ */
+static void resolve_meta(processor_t *processor, witem_t *item, size_t pos)
+{
+  if (item->meta == NULL) {
+    return;
+  }
+
+  for(size_t i=0; i<item->num_params; i++) {
+    value_t *value = item->values + i;
+    switch(item->meta[i]) {
+      case META_FILE:
+        value->ptr = item->filename;
+        value->len = strlen(item->filename);
+        break;
+      case META_OFFSET:
+        value->ptr = item->meta_offset;
+        value->len = snprintf(item->meta_offset, sizeof(item->meta_offset), "%lld", (long long)(item->offset + pos));
+        break;
+      case META_LINE:
+        value->ptr = item->meta_line;
+        value->len = snprintf(item->meta_line, sizeof(item->meta_line), "%zu", witem_line_at(item, pos));
+        break;
+      case META_HOST:
+        value->ptr = processor->hostname;
+        value->len = strlen(processor->hostname);
+        break;
+      case META_INGEST_TS:
+        value->ptr = item->meta_ts;
+        value->len = strlen(item->meta_ts);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Sets the read timestamp ($_INGEST_TS) of witem.
+ * @param[in,out] item Watched item.
+ */
+static void set_ingest_ts(witem_t *item)
+{
+  struct timespec ts;
+  struct tm tm_utc;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  gmtime_r(&(ts.tv_sec), &tm_utc);
+  size_t len = strftime(item->meta_ts, sizeof(item->meta_ts), "%Y-%m-%d %H:%M:%S", &tm_utc);
+  snprintf(item->meta_ts + len, sizeof(item->meta_ts) - len, ".%06ld+00:00", ts.tv_nsec/1000);
+}
+
+/**************************************************************************//**
+ * @brief Process a chunk.
  * @see https://www.pcre.org/current/doc/html/pcre2api.html#SEC31
  * @see https://www.pcre.org/current/doc/html/pcre2_match.html
  * @param[in] processor Processor parameters.
@@ -210,22 +824,61 @@ static void process_chunk(processor_t *processor, witem_t *item, const char *str
   assert(str != NULL);
   assert(len > 0);
 
-  syslog(LOG_DEBUG, "processor - processing chunk '%.*s'", (int)(len), str);
+  // content is not logged (mapped content can raise SIGBUS inside syslog)
+  syslog(LOG_DEBUG, "processor - processing chunk (file=%s, offset=%lld, length=%zu)",
+         item->filename, (long long)(item->offset + (str - item->buffer)), len);
 
   int rc = 0;
   format_t *format = ((file_t *) item->ptr)->format;
   assert(format != NULL);
 
-  // regex matching
-  rc = pcre2_match(format->re_values, (PCRE2_SPTR)str, (PCRE2_SIZE)len, 0, PCRE2_NOTEMPTY, item->md_values, NULL);
-  if (rc < 0) {
+  // unescaped values are written in scratch (sized to maxlength)
+  if (item->scratch != NULL && len >= format->maxlength) {
+    processor_discard(item, DISCARD_BUFFER_FULL, str, len);
+    return;
+  }
+
+  // values extraction
+  switch(format->type) {
+    case FORMAT_TYPE_JSON:
+      rc = json_extract(str, len, item->paths, item->num_params, item->values, item->scratch);
+      break;
+    case FORMAT_TYPE_LOGFMT:
+      rc = logfmt_extract(str, len, item->paths, item->num_params, item->values, item->scratch);
+      break;
+    case FORMAT_TYPE_BUILTIN:
+      rc = builtin_values(item, format, str, len);
+      break;
+    default:
+      rc = regex_extract(item, format, str, len);
+      break;
+  }
+  if (rc != 0) {
     processor_discard(item, DISCARD_NO_MATCH_PATTERN, str, len);
     return;
   }
 
-  trace_chunk_values(str, item->md_values, format);
-  wdata_t *data = wdata_alloc(item, str);
-  mqueue_push(processor->mqueue2, MSG_TYPE_MATCH1, data, false, 0);
+  if (convert_timestamps(item) != 0) {
+    processor_discard(item, DISCARD_INVALID_TIMESTAMP, str, len);
+    return;
+  }
+
+  resolve_meta(processor, item, str - item->buffer);
+
+  trace_chunk_values(item);
+
+  if (item->batch == NULL) {
+    item->batch = batch_alloc(((file_t *) item->ptr)->table);
+  }
+  if (item->batch == NULL || batch_append(item->batch, item->values) != 0) {
+    syslog(LOG_ERR, "processor - error allocating row of file %s", item->filename);
+    return;
+  }
+
+  // forks keep their rows until re-sequenced (see process_split)
+  if (item->origin == NULL && item->batch->num_rows >= BATCH_MAX_ROWS) {
+    processor_send(processor, item);
+  }
 }
 
 /**************************************************************************//**
@@ -236,8 +889,9 @@ static void process_chunk(processor_t *processor, witem_t *item, const char *str
  *    starts-ends : both regex declared.
  * @param[in] processor Processor parameters.
  * @param[in,out] item Witem to process.
+ * @return Number of bytes processed (buffer begin).
  */
-static void process_buffer(processor_t *processor, witem_t *item)
+static size_t process_buffer(processor_t *processor, witem_t *item)
 {
   assert(processor != NULL);
   assert(item != NULL);
@@ -303,59 +957,658 @@ static void process_buffer(processor_t *processor, witem_t *item)
     }
   }
 
-  memmove(item->buffer, str, len);
-  item->buffer_pos = len;
+  return(str - item->buffer);
 }
 
 /**************************************************************************//**
- * @brief Read and parses new info appended to file.
+ * @brief Checks if the buffer of a witem can be split between workers.
+ * @details Only formats delimited by ends (without starts) are splitted,
+ *          because any ends match is a chunk boundary. Boundaries are exact
+ *          when ends is a literal (eg. '\n').
  * @param[in] processor Processor parameters.
- * @param[in,out] item Witem to process.
+ * @param[in] item Watched item.
+ * @return true=splittable, false=otherwise.
  */
-static void process_witem(processor_t *processor, witem_t *item)
+static bool witem_is_splittable(const processor_t *processor, const witem_t *item)
+{
+  return(processor->split_size > 0 && processor->workers > 1 &&
+         item->md_starts == NULL && item->md_ends != NULL);
+}
+
+/**************************************************************************//**
+ * @brief Checks if the content existing at startup of a witem is pending.
+ * @param[in] processor Processor parameters.
+ * @param[in] item Watched item.
+ * @return true=backfilling, false=otherwise.
+ */
+static bool witem_is_backfilling(const processor_t *processor, const witem_t *item)
+{
+  return(processor->backfill && item->backfill_end > 0 && item->origin == NULL);
+}
+
+/**************************************************************************//**
+ * @brief Enlarges the buffer of a witem.
+ * @details Buffers are only enlarged while the memory used by all witem
+ *          buffers is below the buffers-memory limit.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item (not mapped).
+ * @param[in] length New buffer length.
+ * @return true=enlarged, false=otherwise.
+ */
+static bool witem_grow(const processor_t *processor, witem_t *item, size_t length)
+{
+  size_t prev = item->buffer_length;
+
+  if (length <= prev) {
+    return(false);
+  }
+
+  if (witem_buffers_memory() + (length - prev) > processor->buffers_memory) {
+    syslog(LOG_WARNING, "processor - buffer of file %s not enlarged (buffers-memory exhausted)",
+           item->filename);
+    return(false);
+  }
+
+  if (witem_resize_buffer(item, length) != 0) {
+    return(false);
+  }
+
+  syslog(LOG_DEBUG, "processor - buffer of file %s enlarged [%zu -> %zu]",
+         item->filename, prev, item->buffer_length);
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Enlarges the buffer of a hot witem to allow split it.
+ * @details Called when a read fills the buffer (the file has a backlog).
+ *          Also used to read large blocks while backfilling. Chunks are
+ *          still limited to format hardlength.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item.
+ */
+static void witem_split_grow(const processor_t *processor, witem_t *item)
+{
+  format_t *format = ((file_t *) item->ptr)->format;
+  size_t length = format->maxlength + format->blocksize + processor->split_size;
+
+  if (item->buffer_length < length) {
+    witem_grow(processor, item, length);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Makes room in the buffer for a chunk longer than maxlength.
+ * @details Buffer is doubled up to hardlength + blocksize bytes. Formats
+ *          json and logfmt are not enlarged (scratch sized to maxlength).
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item (pending content >= maxlength).
+ * @return true=room available, false=pending content must be discarded.
+ */
+static bool witem_chunk_grow(const processor_t *processor, witem_t *item)
+{
+  format_t *format = ((file_t *) item->ptr)->format;
+
+  if (item->scratch != NULL || item->buffer_pos >= format->hardlength - 1) {
+    return(false);
+  }
+
+  if (item->buffer_length - item->buffer_pos - 1 >= format->blocksize) {
+    return(true);
+  }
+
+  size_t length = MIN(2 * item->buffer_length, format->hardlength + format->blocksize);
+  return(witem_grow(processor, item, length));
+}
+
+/**************************************************************************//**
+ * @brief Shrinks back an enlarged buffer once large chunks are flushed.
+ * @details Buffers of splittable or backfilling witems keep the split length.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item.
+ */
+static void witem_shrink(const processor_t *processor, witem_t *item)
+{
+  format_t *format = ((file_t *) item->ptr)->format;
+  size_t length = format->maxlength + format->blocksize;
+
+  if (witem_is_splittable(processor, item) || witem_is_backfilling(processor, item)) {
+    length += processor->split_size;
+  }
+
+  if (item->buffer_length <= length || item->buffer_pos >= format->maxlength - 1) {
+    return;
+  }
+
+  size_t prev = item->buffer_length;
+  if (witem_resize_buffer(item, length) == 0 && item->buffer_length < prev) {
+    syslog(LOG_DEBUG, "processor - buffer of file %s shrinked [%zu -> %zu]",
+           item->filename, prev, item->buffer_length);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Process a piece of a split.
+ * @details Accesses to a truncated region (SIGBUS) mark the piece as
+ *          truncated (see fmap.h).
+ * @param[in] processor Processor parameters.
+ * @param[in,out] piece Piece to process.
+ */
+static void process_piece(processor_t *processor, piece_t *piece)
+{
+  witem_t *item = piece->item;
+  sigjmp_buf env;
+  sigjmp_buf *prev = fmap_guard;
+
+  if (sigsetjmp(env, 0) == 0) {
+    fmap_guard = &env;
+    piece->length = process_buffer(processor, item);
+    // inner pieces ends at a chunk boundary (only non-literal ends can fail)
+    if (!piece->last && piece->length < item->buffer_pos) {
+      processor_discard(item, DISCARD_INTER_CHUNK, item->buffer + piece->length, item->buffer_pos - piece->length);
+      piece->length = item->buffer_pos;
+    }
+  }
+  else {
+    piece->truncated = true;
+  }
+  fmap_guard = prev;
+}
+
+/**************************************************************************//**
+ * @brief Process a pending piece of any split.
+ * @details Called by the split owner and by idle workers (MSG_TYPE_TASK).
+ * @param[in] processor Processor parameters.
+ * @return true=a piece was processed, false=no pending pieces.
+ */
+static bool processor_help(processor_t *processor)
+{
+  split_t *split = NULL;
+  piece_t *piece = NULL;
+
+  pthread_mutex_lock(&(processor->mutex));
+  for(uint32_t i=0; i<processor->splits.size && piece == NULL; i++) {
+    split = (split_t *) processor->splits.data[i];
+    if (split->next < split->num) {
+      piece = split->pieces + split->next;
+      split->next++;
+    }
+  }
+  pthread_mutex_unlock(&(processor->mutex));
+
+  if (piece == NULL) {
+    return(false);
+  }
+
+  process_piece(processor, piece);
+
+  pthread_mutex_lock(&(processor->mutex));
+  split->done++;
+  if (split->done == split->num) {
+    pthread_cond_broadcast(&(processor->cond));
+  }
+  pthread_mutex_unlock(&(processor->mutex));
+
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Appends the discarded content of a forked item to its origin.
+ * @param[in,out] item Watched item (origin).
+ * @param[in] fork Forked item.
+ */
+static void witem_join_discard(witem_t *item, witem_t *fork)
+{
+  if (fork->discard == NULL) {
+    return;
+  }
+
+  FILE *file = witem_discard_file(item);
+  if (file == NULL) {
+    return;
+  }
+
+  char buf[4096];
+  size_t len = 0;
+
+  rewind(fork->discard);
+  while((len = fread(buf, 1, sizeof(buf), fork->discard)) > 0) {
+    fwrite(buf, 1, len, file);
+  }
+  fflush(file);
+}
+
+/**************************************************************************//**
+ * @brief Process witem buffer in parallel.
+ * @details Buffer is split in pieces at chunk boundaries. Pieces are parsed
+ *          by this worker and by idle workers (notified with MSG_TYPE_TASK).
+ *          Parsed rows are re-sequenced before being sended to the database
+ *          thread, so insertion order is preserved. If the mapped file is
+ *          truncated, only the pieces before the truncated one are kept.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Witem to process.
+ * @return Number of bytes processed (0=buffer not split).
+ */
+static size_t process_split(processor_t *processor, witem_t *item)
+{
+  assert(witem_is_splittable(processor, item));
+
+  format_t *format = ((file_t *) item->ptr)->format;
+  size_t len = item->buffer_pos;
+  size_t num = MIN(processor->workers, len / SPLIT_MIN_PIECE_SIZE);
+  size_t bounds[MAX_WORKERS+1] = {0};
+  size_t n = 1;
+
+  if (len < processor->split_size || num < 2) {
+    return(0);
+  }
+
+  // pieces ends just after an ends match
+  for(size_t k=1; k<num; k++) {
+    size_t offset = MAX(k*len/num, bounds[n-1]);
+    int rc = pcre2_match(format->re_ends, (PCRE2_SPTR)item->buffer, (PCRE2_SIZE)len, (PCRE2_SIZE)offset,
+                         PCRE2_NOTEMPTY|PCRE2_NOTBOL|PCRE2_NOTEOL, item->md_ends, NULL);
+    if (rc < 0) break;
+    size_t pos = get_match_pos(item->md_ends, 1);
+    if (pos > bounds[n-1] && pos < len) {
+      bounds[n++] = pos;
+    }
+  }
+  bounds[n] = len;
+
+  if (n < 2) {
+    return(0);
+  }
+
+  piece_t pieces[MAX_WORKERS] = {{0}};
+  split_t split = {pieces, n, 0, 0};
+  size_t lines[MAX_WORKERS] = {0};
+  size_t line = item->line;
+  size_t line_pos = item->line_pos;
+  size_t ret = 0;
+
+  // line numbers are counted before forking (content can be truncated)
+  for(size_t k=0; k<n; k++) {
+    if (item->lines) {
+      line += scan_count(item->buffer + line_pos, item->buffer + bounds[k], '\n');
+      line_pos = bounds[k];
+    }
+    lines[k] = line;
+  }
+
+  for(size_t k=0; k<n; k++) {
+    pieces[k].item = witem_fork(item, bounds[k], bounds[k+1] - bounds[k], lines[k]);
+    pieces[k].last = (k == n-1);
+    if (pieces[k].item == NULL) {
+      goto process_split_exit;
+    }
+  }
+
+  syslog(LOG_DEBUG, "processor - file %s split in %zu pieces", item->filename, n);
+
+  // publish pieces and wake up idle workers
+  pthread_mutex_lock(&(processor->mutex));
+  vector_insert(&(processor->splits), &split);
+  pthread_mutex_unlock(&(processor->mutex));
+
+  for(size_t k=1; k<n; k++) {
+    mqueue_push(processor->mqueue1, MSG_TYPE_TASK, processor, false, 0);
+  }
+
+  // process pending pieces and wait for the pieces taken by others
+  while(processor_help(processor));
+
+  pthread_mutex_lock(&(processor->mutex));
+  while(split.done < split.num) {
+    pthread_cond_wait(&(processor->cond), &(processor->mutex));
+  }
+  for(uint32_t i=0; i<processor->splits.size; i++) {
+    if (processor->splits.data[i] == &split) {
+      vector_remove(&(processor->splits), i, NULL);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&(processor->mutex));
+
+  // re-sequence rows in file order
+  msg_t msgs[MAX_WORKERS];
+  size_t num_msgs = 0;
+  size_t k = 0;
+  processor_send(processor, item);
+  for(k=0; k<n && !pieces[k].truncated; k++) {
+    batch_t *batch = pieces[k].item->batch;
+    if (batch != NULL && batch->num_rows > 0) {
+      msgs[num_msgs++] = (msg_t){MSG_TYPE_BATCH, batch};
+      pieces[k].item->batch = NULL;
+    }
+    witem_join_discard(item, pieces[k].item);
+  }
+  for(size_t i=mqueue_push_n_lane(processor_mqueue(processor, item), witem_priority(item), msgs, num_msgs, 0); i<num_msgs; i++) {
+    batch_free(msgs[i].data);
+  }
+
+  if (k < n) {
+    ret = bounds[k];
+  }
+  else {
+    item->line = line;
+    item->line_pos = line_pos;
+    ret = bounds[n-1] + pieces[n-1].length;
+  }
+
+process_split_exit:
+  for(size_t j=0; j<n; j++) {
+    witem_free(pieces[j].item);
+  }
+  // discarded rows could be allocated by helpers
+  slab_flush();
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Process the unprocessed content of witem buffer.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Witem to process.
+ * @return Number of bytes processed (buffer begin).
+ */
+static size_t process_content(processor_t *processor, witem_t *item)
+{
+  size_t ret = 0;
+
+  if (item->meta != NULL) {
+    set_ingest_ts(item);
+  }
+  if (witem_is_splittable(processor, item)) {
+    ret = process_split(processor, item);
+  }
+  if (ret == 0) {
+    ret = process_buffer(processor, item);
+  }
+
+  processor_send(processor, item);
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Starts the backfill of a witem.
+ * @details Kernel is advised that the file is read sequentially (larger
+ *          readahead).
+ * @param[in,out] item Watched item.
+ */
+static void processor_backfill_start(witem_t *item)
+{
+  gettimeofday(&(item->backfill_tv), NULL);
+  item->backfill_report = 0;
+  item->backfill_dropped = item->offset;
+  posix_fadvise(fileno(item->file), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  syslog(LOG_INFO, "processor - backfill of %s started [bytes=%lld]",
+         item->filename, (long long)(item->backfill_end - item->offset));
+}
+
+/**************************************************************************//**
+ * @brief Reports the backfill progress of a witem.
+ * @details Called after each block read (or mmap window) and at the end of
+ *          each turn, so a single large file (or quantum=0) is reported too.
+ *          Consumed content is released from the page cache (it is not read
+ *          again) every BACKFILL_DROP_BYTES. Progress and throughput are
+ *          reported every BACKFILL_REPORT_MILLIS. Once the content existing
+ *          at startup is read, the file is tailed as usual from the current
+ *          offset (the same witem continues).
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Watched item.
+ * @param[in] all Release all consumed content (end of turn).
+ */
+static void processor_backfill(processor_t *processor, witem_t *item, bool all)
+{
+  assert(witem_is_backfilling(processor, item));
+
+  int fd = fileno(item->file);
+  off_t offset = item->offset + (off_t) item->buffer_pos;
+  size_t millis = MAX(elapsed_millis(&(item->backfill_tv)), 1);
+  double mbps = (double)(offset) * 1000.0 / ((double) millis * 1048576.0);
+
+  // truncated file (processed again from the beginning)
+  if (item->offset < item->backfill_dropped) {
+    syslog(LOG_WARNING, "processor - backfill of %s interrupted (file truncated)", item->filename);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+    item->backfill_end = 0;
+    return;
+  }
+
+  if (item->offset > item->backfill_dropped &&
+      (all || item->offset - item->backfill_dropped >= BACKFILL_DROP_BYTES)) {
+    posix_fadvise(fd, item->backfill_dropped, item->offset - item->backfill_dropped, POSIX_FADV_DONTNEED);
+    item->backfill_dropped = item->offset;
+  }
+
+  if (offset < item->backfill_end) {
+    if (millis >= item->backfill_report + BACKFILL_REPORT_MILLIS) {
+      item->backfill_report = millis;
+      syslog(LOG_INFO, "processor - backfill of %s at %.1f%% [bytes=%lld/%lld, MB/s=%.1f]",
+             item->filename, 100.0 * (double) offset / (double) item->backfill_end,
+             (long long) offset, (long long) item->backfill_end, mbps);
+    }
+    return;
+  }
+
+  syslog(LOG_INFO, "processor - backfill of %s completed [bytes=%lld, millis=%zu, MB/s=%.1f], tailing from offset %lld",
+         item->filename, (long long) item->backfill_end, millis, mbps, (long long) offset);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+  item->backfill_end = 0;
+}
+
+/**************************************************************************//**
+ * @brief Read and parses new info appended to file (stdio reader).
+ * @details File is read in blocks into the witem ring buffer. Consumed
+ *          chunks only advance the buffer pointer (no memmove). Chunks
+ *          longer than maxlength enlarge the buffer up to hardlength.
+ *          If the file is truncated then it is processed again from the
+ *          beginning.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Witem to process.
+ */
+static void process_witem_stdio(processor_t *processor, witem_t *item)
 {
-  assert(processor != NULL);
-  assert(item != NULL);
-  assert(item->type == WITEM_FILE);
-  assert(item->file != NULL);
   assert(item->buffer != NULL);
 
+  format_t *format = ((file_t *) item->ptr)->format;
   bool more = true;
+  struct stat st;
 
-  syslog(LOG_DEBUG, "processor - processing file %s", item->filename);
+  // truncated file (eg. copytruncate), pending partial chunk is dropped
+  if (item->pid == 0 && fstat(fileno(item->file), &st) == 0 &&
+      st.st_size < item->offset + (off_t) item->buffer_pos) {
+    syslog(LOG_WARNING, "processor - file '%s' truncated", item->filename);
+    witem_flush_buffer(item);
+    item->offset = 0;
+    item->line = 1;
+    fseeko(item->file, 0, SEEK_SET);
+  }
+
+  // EOF is sticky, content appended since the last turn is read
+  clearerr(item->file);
 
   // read and process new data until EOF
   while(more)
   {
-    if (item->buffer_pos >= item->buffer_length-1) {
-      processor_discard(item, DISCARD_BUFFER_FULL, item->buffer, item->buffer_length-1);
+    if (item->buffer_pos >= format->maxlength-1 && !witem_chunk_grow(processor, item)) {
+      processor_discard(item, DISCARD_BUFFER_FULL, item->buffer, item->buffer_pos);
       witem_flush_buffer(item);
     }
 
-    size_t buffer_free_bytes = item->buffer_length - item->buffer_pos - 1;
-    size_t len = fread(item->buffer + item->buffer_pos, 1, buffer_free_bytes, item->file);
+    processor_throttle(processor);
+    if (processor_defer(processor, item)) {
+      break;
+    }
+
+    size_t block = MIN(item->buffer_length - item->buffer_pos - 1,
+                       item->buffer_length - format->maxlength);
+    size_t len = fread(item->buffer + item->buffer_pos, 1, block, item->file);
     if (len == 0) {
       break;
     }
     //TODO: if error at fread -> try to reopen ?
 
-    more = (len == buffer_free_bytes);
+    more = (len == block);
     item->buffer_pos += len;
     item->buffer[item->buffer_pos] = '\0';
 
-    process_buffer(processor, item);
+    witem_consume(item, process_content(processor, item));
+
+    if (witem_is_backfilling(processor, item)) {
+      processor_backfill(processor, item, false);
+    }
+
+    if (more && processor_yield(processor, item, len)) {
+      break;
+    }
+
+    if (more && (witem_is_splittable(processor, item) || witem_is_backfilling(processor, item))) {
+      witem_split_grow(processor, item);
+    }
+  }
+
+  witem_shrink(processor, item);
+}
+
+/**************************************************************************//**
+ * @brief Parses new info appended to file (mmap reader).
+ * @details Content is parsed directly from the mapped file, in windows of
+ *          MMAP_WINDOW_SIZE bytes. Chunks are only limited by the window
+ *          size. If the file is truncated then it is processed again from
+ *          the beginning. Accesses to a truncated region (SIGBUS) abort the
+ *          current processing (see fmap.h).
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Witem to process.
+ */
+static void process_witem_mmap(processor_t *processor, witem_t *item)
+{
+  struct stat st;
+  sigjmp_buf env;
+  sigjmp_buf *prev = fmap_guard;
+
+  if (sigsetjmp(env, 0) != 0) {
+    fmap_guard = prev;
+    syslog(LOG_WARNING, "processor - file '%s' truncated while reading", item->filename);
+    processor_send(processor, item);
+    witem_unmap(item);
+    return;
+  }
+  fmap_guard = &env;
+
+  while(fstat(fileno(item->file), &st) == 0)
+  {
+    // truncated mapped region
+    if (item->map != NULL && st.st_size < item->map_offset + (off_t) item->map_length) {
+      witem_unmap(item);
+    }
+
+    // truncated file (eg. copytruncate)
+    if (st.st_size < item->offset) {
+      syslog(LOG_WARNING, "processor - file '%s' truncated", item->filename);
+      item->offset = 0;
+      item->line = 1;
+      item->line_pos = 0;
+    }
+
+    // no new content
+    off_t end = (item->map == NULL ? item->offset : item->map_offset + (off_t) item->map_length);
+    if (end >= st.st_size) {
+      break;
+    }
+
+    processor_throttle(processor);
+    if (processor_defer(processor, item)) {
+      break;
+    }
+
+    if (witem_map(item, st.st_size, MMAP_WINDOW_SIZE) != 0) {
+      break;
+    }
+
+    size_t processed = process_content(processor, item);
+
+    // window without chunks
+    if (processed == 0 && item->map_offset + (off_t) item->map_length < st.st_size) {
+      processor_discard(item, DISCARD_BUFFER_FULL, item->buffer, item->buffer_pos);
+      processed = item->buffer_pos;
+    }
+
+    witem_consume(item, processed);
+
+    if (witem_is_backfilling(processor, item)) {
+      processor_backfill(processor, item, false);
+    }
+
+    if (item->map_offset + (off_t) item->map_length < st.st_size &&
+        processor_yield(processor, item, processed)) {
+      break;
+    }
+  }
+
+  fmap_guard = prev;
+}
+
+/**************************************************************************//**
+ * @brief Read and parses new info appended to file.
+ * @param[in] processor Processor parameters.
+ * @param[in,out] item Witem to process.
+ */
+static void process_witem(processor_t *processor, witem_t *item)
+{
+  assert(processor != NULL);
+  assert(item != NULL);
+  assert(item->type == WITEM_FILE);
+  assert(item->file != NULL);
+
+  syslog(LOG_DEBUG, "processor - processing file %s", item->filename);
+
+  // new turn (unspent bytes are not accumulated, overrun is charged)
+  item->deficit = MIN(item->deficit, 0) + (long long) processor->quantum;
+  if (processor_yield(processor, item, 0)) {
+    return;
+  }
+
+  if (witem_is_backfilling(processor, item) && item->backfill_tv.tv_sec == 0) {
+    processor_backfill_start(item);
+  }
+
+  // rotated files and decompressed files (pipes) are streams read up to EOF
+  if (processor->reader == READER_MMAP && item->live == NULL && item->pid == 0) {
+    process_witem_mmap(processor, item);
+  }
+  else {
+    process_witem_stdio(processor, item);
+  }
+
+  // published to the monitor (see monitor_rescan)
+  atomic_store(&(item->read_offset), item->offset + (off_t) item->buffer_pos);
+
+  if (witem_is_backfilling(processor, item)) {
+    processor_backfill(processor, item, true);
+  }
+
+  // rotated file completed (EOF is cleared at every turn)
+  if (item->live != NULL && feof(item->file)) {
+    processor_handover(processor, item);
   }
 }
 
 /**************************************************************************//**
  * @brief Process file events readed from queue.
  * @details This function block the current thread until NULL event is received.
- * @param[in] ptr Monitor parameters.
+ *          Several workers can run this function concurrently sharing the
+ *          same queue. Pending files are served to the first idle worker,
+ *          and a file is processed by at most one worker at a time (see
+ *          witem_claim), keeping the per-file order. Files deferred by a
+ *          congested writer are re-queued by idle workers. The last worker
+ *          ending closes the queues to the database threads.
+ * @param[in] ptr Processor object.
  */
 void* processor_run(void *ptr)
 {
   processor_t *processor = (processor_t *) ptr;
-  if (processor == NULL || processor->mqueue1 == NULL || processor->mqueue2 == NULL) {
+  if (processor == NULL || processor->mqueue1 == NULL || processor->mqueues == NULL) {
     assert(false);
     return(NULL);
   }
@@ -363,8 +1616,9 @@ void* processor_run(void *ptr)
 
   while(true)
   {
-    // waiting for a new message
-    msg_t msg = mqueue_pop(processor->mqueue1, 0);
+    // waiting for a new message (retrying deferred files periodically)
+    size_t millis = (atomic_load(&(processor->num_deferred)) > 0 ? DEFER_RETRY_MILLIS : 0);
+    msg_t msg = mqueue_pop(processor->mqueue1, millis);
 
     // processing message
     if (msg.type == MSG_TYPE_ERROR) {
@@ -374,26 +1628,42 @@ void* processor_run(void *ptr)
     else if(msg.type == MSG_TYPE_CLOSE) {
       break;
     }
+
+    processor_resume(processor);
+
+    if (msg.type == MSG_TYPE_TIMEOUT) {
+      continue;
+    }
     else if (msg.type == MSG_TYPE_EINTR || msg.type == MSG_TYPE_NULL) {
       assert(false);
       continue;
     }
+    else if (msg.type == MSG_TYPE_TASK) {
+      // helps to process a split file
+      while(processor_help(processor));
+    }
     else {
       assert(msg.data != NULL);
       witem_t *item = (witem_t *) msg.data;
 
-      process_witem(processor, item);
-
-      if (msg.type == MSG_TYPE_FILE1) {
-        witem_free(item);
+      // item owned by another worker (notification transferred)
+      if (!witem_claim(item)) {
+        continue;
       }
+
+      do {
+        process_witem(processor, item);
+      } while(witem_release(item));
     }
   }
 
-  // sends termination signal to database thread
-  mqueue_close(processor->mqueue2);
+  // last worker sends termination signal to database threads
+  if (atomic_fetch_sub(&(processor->running), 1) == 1) {
+    for(size_t i=0; i<processor->num_writers; i++) {
+      mqueue_close(processor->mqueues + i);
+    }
+  }
 
   syslog(LOG_DEBUG, "processor - thread ended");
   return(NULL);
 }
-
@@ -23,24 +23,69 @@
 #ifndef PROCESSOR_H
 #define PROCESSOR_H
 
+#include <stdatomic.h>
+#include <pthread.h>
+#include <libconfig.h>
+#include "vector.h"
 #include "mqueue.h"
 
 /**************************************************************************//**
- * @brief Processor thread.
+ * @brief Types of file readers.
+ */
+typedef enum {
+  READER_STDIO = 0,  // fread() into witem buffer.
+  READER_MMAP        // witem buffer maps the file.
+} reader_type_e;
+
+/**************************************************************************//**
+ * @brief Processor workers (shared by all processor threads).
  */
 typedef struct processor_t
 {
   //! Messages received from monitor thread.
   mqueue_t *mqueue1;
-  //! Messages sended to database thread.
-  mqueue_t *mqueue2;
+  //! Messages sended to database threads (one queue per writer).
+  mqueue_t *mqueues;
+  //! Number of writers (see table_t::writer).
+  size_t num_writers;
+  //! Host name ($_HOST).
+  char hostname[256];
+  //! Number of worker threads.
+  size_t workers;
+  //! Number of running worker threads.
+  atomic_size_t running;
+  //! Minimum region size split between workers (0=disabled).
+  size_t split_size;
+  //! File reader.
+  reader_type_e reader;
+  //! Memory limit to enlarge witem buffers (see witem_buffers_memory).
+  size_t buffers_memory;
+  //! Memory budget of buffers and rows (0=unlimited, see processor_throttle).
+  size_t memory_budget;
+  //! Number of workers paused by the memory budget.
+  atomic_size_t paused;
+  //! Bytes processed per file turn (0=until EOF, see processor_yield).
+  size_t quantum;
+  //! Existing contents are backfilled (see processor_backfill).
+  bool backfill;
+  //! Mutex to protect splits.
+  pthread_mutex_t mutex;
+  //! Condition variable signaled when a split is completed.
+  pthread_cond_t cond;
+  //! Splits having pending pieces (see process_split).
+  vector_t splits;
+  //! Files deferred because their writer is congested (see processor_defer).
+  vector_t deferred;
+  //! Number of deferred files.
+  atomic_size_t num_deferred;
 } processor_t;
 
 /**************************************************************************
  * Function declarations.
  */
-extern int processor_init(processor_t *processor, mqueue_t *mqueue1, mqueue_t *mqueue2);
+extern int processor_init(processor_t *processor, const config_t *cfg, mqueue_t *mqueue1, mqueue_t *mqueues, size_t num_writers, bool backfill);
 extern void* processor_run(void *ptr);
 extern void processor_reset(processor_t *processor);
 
 #endif
+
@@ -0,0 +1,539 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <assert.h>
+#include "ring.h"
+
+// Iterations checking the ring before parking.
+#define RING_SPIN_COUNT 128
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define cpu_relax() __builtin_ia32_pause()
+#else
+#  define cpu_relax() sched_yield()
+#endif
+
+/*
+ * Bounded queue based on slot sequence numbers (D. Vyukov).
+ * Slot i is free for the push at position p when seq == p, and it is
+ * ready for the pop at position p when seq == p+1. After the pop the
+ * slot is released for position p+capacity.
+ */
+
+/**************************************************************************//**
+ * @brief Returns the deadline of a wait.
+ * @param[in] millis Milliseconds to wait (0=waits forever).
+ * @param[out] ts Deadline (CLOCK_MONOTONIC).
+ * @return ts, NULL if waits forever.
+ */
+static struct timespec* ring_deadline(size_t millis, struct timespec *ts)
+{
+  if (millis == 0) {
+    return(NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += millis / 1000;
+  ts->tv_nsec += (millis % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec += 1;
+    ts->tv_nsec -= 1000000000;
+  }
+
+  return(ts);
+}
+
+/**************************************************************************//**
+ * @brief Parks the current thread until futex changes.
+ * @param[in] futex Futex word.
+ * @param[in] value Expected value.
+ * @param[in] ts Absolute deadline (CLOCK_MONOTONIC, NULL=waits forever).
+ * @return 0=woken up (or value changed), MSG_TYPE_TIMEOUT, MSG_TYPE_EINTR.
+ */
+static int ring_park(atomic_uint *futex, unsigned int value, const struct timespec *ts)
+{
+  long rc = syscall(SYS_futex, futex, FUTEX_WAIT_BITSET_PRIVATE, value, ts, NULL, FUTEX_BITSET_MATCH_ANY);
+
+  if (rc == 0 || errno == EAGAIN) {
+    return(0);
+  }
+  else if (errno == ETIMEDOUT) {
+    return(MSG_TYPE_TIMEOUT);
+  }
+  else if (errno == EINTR) {
+    return(MSG_TYPE_EINTR);
+  }
+  else {
+    return(MSG_TYPE_ERROR);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Wakes up parked threads (if any).
+ * @details The fence orders the previous slot update with the waiters
+ *          load (a parking thread increments waiters before rechecking
+ *          the ring, so one of both sides always sees the other).
+ * @param[in,out] futex Futex word.
+ * @param[in] waiters Number of parked threads.
+ * @param[in] num Number of threads to wake up.
+ */
+static void ring_unpark(atomic_uint *futex, atomic_uint *waiters, int num)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(waiters, memory_order_relaxed) > 0) {
+    atomic_fetch_add(futex, 1);
+    syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+  }
+}
+
+/**************************************************************************//**
+ * @brief Allocate and initialize a ring.
+ * @param[in] capacity Minimum capacity (rounded up to a power of 2).
+ * @return Initialized object or NULL if error.
+ */
+ring_t* ring_alloc(size_t capacity)
+{
+  if (capacity == 0) {
+    assert(false);
+    return(NULL);
+  }
+
+  size_t length = 2;
+  while (length < capacity) {
+    length *= 2;
+  }
+
+  ring_t *ret = (ring_t *) aligned_alloc(RING_CACHE_LINE, sizeof(ring_t));
+  if (ret == NULL) {
+    return(NULL);
+  }
+
+  ret->slots = (ring_slot_t *) calloc(length, sizeof(ring_slot_t));
+  if (ret->slots == NULL) {
+    free(ret);
+    return(NULL);
+  }
+
+  for(size_t i=0; i<length; i++) {
+    atomic_init(&(ret->slots[i].seq), i);
+  }
+
+  ret->mask = length - 1;
+  // spinning on a single cpu only delays the peer thread
+  ret->spins = (sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RING_SPIN_COUNT : 0);
+  atomic_init(&(ret->head), 0);
+  atomic_init(&(ret->tail), 0);
+  atomic_init(&(ret->pushed), 0);
+  atomic_init(&(ret->pop_waiters), 0);
+  atomic_init(&(ret->popped), 0);
+  atomic_init(&(ret->push_waiters), 0);
+  atomic_init(&(ret->open), true);
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Appends a message to the ring if there is room.
+ * @details Parked consumers are not woken up.
+ * @param[in,out] ring Ring object.
+ * @param[in] msg Message to append.
+ * @return true=appended, false=ring full.
+ */
+static bool ring_enqueue(ring_t *ring, const msg_t *msg)
+{
+  size_t pos = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+
+  while (true)
+  {
+    ring_slot_t *slot = ring->slots + (pos & ring->mask);
+    size_t seq = atomic_load_explicit(&(slot->seq), memory_order_acquire);
+    intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&(ring->tail), &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        slot->msg = *msg;
+        atomic_store_explicit(&(slot->seq), pos + 1, memory_order_release);
+        return(true);
+      }
+    }
+    else if (diff < 0) {
+      return(false);
+    }
+    else {
+      pos = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Retrieves a message from the ring if not empty.
+ * @details Parked producers are not woken up.
+ * @param[in,out] ring Ring object.
+ * @param[out] msg Retrieved message.
+ * @return true=retrieved, false=ring empty.
+ */
+static bool ring_dequeue(ring_t *ring, msg_t *msg)
+{
+  size_t pos = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+
+  while (true)
+  {
+    ring_slot_t *slot = ring->slots + (pos & ring->mask);
+    size_t seq = atomic_load_explicit(&(slot->seq), memory_order_acquire);
+    intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&(ring->head), &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        *msg = slot->msg;
+        atomic_store_explicit(&(slot->seq), pos + ring->mask + 1, memory_order_release);
+        return(true);
+      }
+    }
+    else if (diff < 0) {
+      return(false);
+    }
+    else {
+      pos = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Appends a message, waiting while the ring is full.
+ * @details Spins briefly and then parks until a slot becomes free.
+ *          Parked consumers are not woken up.
+ * @param[in,out] ring Ring object.
+ * @param[in] msg Message to append.
+ * @param[in] ts Absolute deadline (CLOCK_MONOTONIC, NULL=waits forever).
+ * @return 0 = appended, otherwise error code (see ring_push).
+ */
+static int ring_push_wait(ring_t *ring, const msg_t *msg, const struct timespec *ts)
+{
+  while (atomic_load_explicit(&(ring->open), memory_order_relaxed))
+  {
+    for(int i=0; i<=ring->spins; i++) {
+      if (ring_enqueue(ring, msg)) {
+        return(0);
+      }
+      cpu_relax();
+    }
+
+    // give the peer threads a chance before parking
+    sched_yield();
+    if (ring_enqueue(ring, msg)) {
+      return(0);
+    }
+
+    atomic_fetch_add(&(ring->push_waiters), 1);
+    unsigned int value = atomic_load(&(ring->popped));
+    int rc = 0;
+    if (ring_enqueue(ring, msg)) {
+      atomic_fetch_sub(&(ring->push_waiters), 1);
+      return(0);
+    }
+    if (atomic_load(&(ring->open))) {
+      rc = ring_park(&(ring->popped), value, ts);
+    }
+    atomic_fetch_sub(&(ring->push_waiters), 1);
+
+    if (rc != 0) {
+      return(rc);
+    }
+  }
+
+  return(MSG_TYPE_CLOSE);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves a message, waiting while the ring is empty.
+ * @details Spins briefly and then parks until a message is available.
+ *          Parked producers are not woken up.
+ * @param[in,out] ring Ring object.
+ * @param[out] msg Retrieved message.
+ * @param[in] ts Absolute deadline (CLOCK_MONOTONIC, NULL=waits forever).
+ * @return 0 = retrieved, otherwise error code (see ring_pop).
+ */
+static int ring_pop_wait(ring_t *ring, msg_t *msg, const struct timespec *ts)
+{
+  while (atomic_load_explicit(&(ring->open), memory_order_relaxed))
+  {
+    for(int i=0; i<=ring->spins; i++) {
+      if (ring_dequeue(ring, msg)) {
+        return(0);
+      }
+      cpu_relax();
+    }
+
+    // give the peer threads a chance before parking
+    sched_yield();
+    if (ring_dequeue(ring, msg)) {
+      return(0);
+    }
+
+    atomic_fetch_add(&(ring->pop_waiters), 1);
+    unsigned int value = atomic_load(&(ring->pushed));
+    int rc = 0;
+    if (ring_dequeue(ring, msg)) {
+      atomic_fetch_sub(&(ring->pop_waiters), 1);
+      return(0);
+    }
+    if (atomic_load(&(ring->open))) {
+      rc = ring_park(&(ring->pushed), value, ts);
+    }
+    atomic_fetch_sub(&(ring->pop_waiters), 1);
+
+    if (rc != 0) {
+      return(rc);
+    }
+  }
+
+  return(MSG_TYPE_CLOSE);
+}
+
+/**************************************************************************//**
+ * @brief Frees a ring.
+ * @details Caution, no threads can be using the ring.
+ * @param[in] ring Ring to free.
+ * @param[in] item_free Function to free the pending items (can be NULL).
+ */
+void ring_free(ring_t *ring, void (*item_free)(void*))
+{
+  if (ring == NULL) {
+    return;
+  }
+
+  msg_t msg;
+  while (ring_dequeue(ring, &msg)) {
+    if (item_free != NULL) {
+      item_free(msg.data);
+    }
+  }
+
+  free(ring->slots);
+  free(ring);
+}
+
+/**************************************************************************//**
+ * @brief Appends a message to the ring.
+ * @details If ring is full, waits until one slot becomes free.
+ * @param[in,out] ring Ring object.
+ * @param[in] msg Message to append.
+ * @param[in] millis Milliseconds to wait before return (0=waits forever).
+ * @return 0 = appended,
+ *         MSG_TYPE_EINTR = signal interrupted wait (not appended),
+ *         MSG_TYPE_TIMEOUT = wait timedout (not appended),
+ *         MSG_TYPE_CLOSE = ring closed (not appended),
+ *         MSG_TYPE_ERROR = error.
+ */
+int ring_push(ring_t *ring, msg_t msg, size_t millis)
+{
+  if (ring == NULL) {
+    assert(false);
+    return(MSG_TYPE_ERROR);
+  }
+
+  struct timespec ts = {0};
+  int rc = ring_push_wait(ring, &msg, ring_deadline(millis, &ts));
+  if (rc == 0) {
+    ring_unpark(&(ring->pushed), &(ring->pop_waiters), 1);
+  }
+
+  return(rc);
+}
+
+/**************************************************************************//**
+ * @brief Appends several messages to the ring.
+ * @details Parked consumers are woken up once per burst (when the ring
+ *          becomes full or at the end).
+ * @param[in,out] ring Ring object.
+ * @param[in] msgs Messages to append.
+ * @param[in] num Number of messages.
+ * @param[in] millis Milliseconds to wait (if full) before return (0=waits forever).
+ * @return Number of appended messages (less than num if the ring is
+ *         closed, timeout expired or an error ocurred).
+ */
+size_t ring_push_n(ring_t *ring, const msg_t *msgs, size_t num, size_t millis)
+{
+  if (ring == NULL || (msgs == NULL && num > 0)) {
+    assert(false);
+    return(0);
+  }
+
+  size_t ret = 0;
+  struct timespec ts = {0};
+  struct timespec *pts = ring_deadline(millis, &ts);
+
+  while (ret < num)
+  {
+    if (!ring_enqueue(ring, msgs + ret)) {
+      // let consumers drain the already appended messages
+      if (ret > 0) {
+        ring_unpark(&(ring->pushed), &(ring->pop_waiters), INT_MAX);
+      }
+      if (ring_push_wait(ring, msgs + ret, pts) != 0) {
+        break;
+      }
+    }
+    ret++;
+  }
+
+  if (ret > 0) {
+    ring_unpark(&(ring->pushed), &(ring->pop_waiters), (ret > 1 ? INT_MAX : 1));
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves a message from the ring.
+ * @details If ring is empty, waits until a message is available.
+ * @param[in,out] ring Ring object.
+ * @param[out] msg Retrieved message.
+ * @param[in] millis Milliseconds to wait before return (0=waits forever).
+ * @return 0 = retrieved,
+ *         MSG_TYPE_EINTR = signal interrupted wait,
+ *         MSG_TYPE_TIMEOUT = wait timedout,
+ *         MSG_TYPE_CLOSE = ring closed,
+ *         MSG_TYPE_ERROR = error.
+ */
+int ring_pop(ring_t *ring, msg_t *msg, size_t millis)
+{
+  if (ring == NULL || msg == NULL) {
+    assert(false);
+    return(MSG_TYPE_ERROR);
+  }
+
+  struct timespec ts = {0};
+  int rc = ring_pop_wait(ring, msg, ring_deadline(millis, &ts));
+  if (rc == 0) {
+    ring_unpark(&(ring->popped), &(ring->push_waiters), 1);
+  }
+
+  return(rc);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves several messages from the ring.
+ * @details Waits for the first message, then retrieves the available ones
+ *          (up to num). Parked producers are woken up once.
+ * @param[in,out] ring Ring object.
+ * @param[out] msgs Retrieved messages (at least 1 slot).
+ * @param[in] num Maximum number of messages to retrieve.
+ * @param[in] millis Milliseconds to wait before return (0=waits forever).
+ * @return Number of retrieved messages. If 0 then msgs[0].type contains
+ *         the error code (see ring_pop).
+ */
+size_t ring_pop_n(ring_t *ring, msg_t *msgs, size_t num, size_t millis)
+{
+  if (ring == NULL || msgs == NULL || num == 0) {
+    assert(false);
+    return(0);
+  }
+
+  struct timespec ts = {0};
+  int rc = ring_pop_wait(ring, msgs, ring_deadline(millis, &ts));
+  if (rc != 0) {
+    msgs[0].type = rc;
+    msgs[0].data = NULL;
+    return(0);
+  }
+
+  size_t ret = 1;
+  while (ret < num && ring_dequeue(ring, msgs + ret)) {
+    ret++;
+  }
+
+  ring_unpark(&(ring->popped), &(ring->push_waiters), (ret > 1 ? INT_MAX : 1));
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Retrieves the available messages without waiting.
+ * @details Parked producers are woken up once.
+ * @param[in,out] ring Ring object.
+ * @param[out] msgs Retrieved messages.
+ * @param[in] num Maximum number of messages to retrieve.
+ * @return Number of retrieved messages (0 if ring is empty).
+ */
+size_t ring_take_n(ring_t *ring, msg_t *msgs, size_t num)
+{
+  if (ring == NULL || (msgs == NULL && num > 0)) {
+    assert(false);
+    return(0);
+  }
+
+  size_t ret = 0;
+  while (ret < num && ring_dequeue(ring, msgs + ret)) {
+    ret++;
+  }
+
+  if (ret > 0) {
+    ring_unpark(&(ring->popped), &(ring->push_waiters), (ret > 1 ? INT_MAX : 1));
+  }
+
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Returns the number of messages in the ring.
+ * @details Approximated value when there are concurrent push/pop.
+ * @param[in] ring Ring object.
+ * @return Number of messages.
+ */
+size_t ring_length(ring_t *ring)
+{
+  size_t head = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+
+  return(tail > head ? tail - head : 0);
+}
+
+/**************************************************************************//**
+ * @brief Close the ring.
+ * @details Parked threads are woken up. Next push/pop return MSG_TYPE_CLOSE.
+ * @param[in,out] ring Ring object.
+ */
+void ring_close(ring_t *ring)
+{
+  if (ring == NULL) {
+    assert(false);
+    return;
+  }
+
+  atomic_store(&(ring->open), false);
+  atomic_fetch_add(&(ring->pushed), 1);
+  atomic_fetch_add(&(ring->popped), 1);
+  syscall(SYS_futex, &(ring->pushed), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  syscall(SYS_futex, &(ring->popped), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
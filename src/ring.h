@@ -0,0 +1,90 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "mqueue.h"
+
+#define RING_CACHE_LINE 64
+
+/**************************************************************************//**
+ * @brief Slot of a ring.
+ */
+typedef struct ring_slot_t
+{
+  //! Sequence number (slot state, see ring.c).
+  atomic_size_t seq;
+  //! Message.
+  msg_t msg;
+} ring_slot_t;
+
+/**************************************************************************//**
+ * @brief Lock-free bounded message queue:
+ *        - multiple producers, multiple consumers (MPSC in practice)
+ *        - fixed capacity (power of 2)
+ *        - push()/pop() spin briefly then park on a futex
+ *        - timeouts based on CLOCK_MONOTONIC
+ *        - same return codes as mqueue (see mqueue_push/mqueue_pop)
+ * @details Indices are in separate cache lines to avoid false sharing.
+ */
+typedef struct ring_t
+{
+  //! Next position to pop.
+  _Alignas(RING_CACHE_LINE) atomic_size_t head;
+  //! Next position to push.
+  _Alignas(RING_CACHE_LINE) atomic_size_t tail;
+  //! Futex incremented on push (consumers park on it).
+  _Alignas(RING_CACHE_LINE) atomic_uint pushed;
+  //! Number of parked consumers.
+  atomic_uint pop_waiters;
+  //! Futex incremented on pop (producers park on it).
+  _Alignas(RING_CACHE_LINE) atomic_uint popped;
+  //! Number of parked producers.
+  atomic_uint push_waiters;
+  //! Indicate if ring is open or closed.
+  _Alignas(RING_CACHE_LINE) atomic_bool open;
+  //! Capacity - 1.
+  size_t mask;
+  //! Iterations checking the ring before parking (0 on single cpu).
+  int spins;
+  //! Slots.
+  ring_slot_t *slots;
+} ring_t;
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern ring_t* ring_alloc(size_t capacity);
+extern void ring_free(ring_t *ring, void (*item_free)(void*));
+extern int ring_push(ring_t *ring, msg_t msg, size_t millis);
+extern size_t ring_push_n(ring_t *ring, const msg_t *msgs, size_t num, size_t millis);
+extern int ring_pop(ring_t *ring, msg_t *msg, size_t millis);
+extern size_t ring_pop_n(ring_t *ring, msg_t *msgs, size_t num, size_t millis);
+extern size_t ring_take_n(ring_t *ring, msg_t *msgs, size_t num);
+extern size_t ring_length(ring_t *ring);
+extern void ring_close(ring_t *ring);
+
+#endif
+
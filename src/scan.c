@@ -0,0 +1,164 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "scan.h"
+
+/**************************************************************************
+ * Word-at-a-time (SWAR) helpers.
+ * @see https://graphics.stanford.edu/~seander/bithacks.html#ZeroInWord
+ */
+#define SWAR_ONES  0x0101010101010101ULL
+#define SWAR_LOW7  0x7F7F7F7F7F7F7F7FULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define SWAR_ENABLED 1
+#else
+#  define SWAR_ENABLED 0
+#endif
+
+/**************************************************************************//**
+ * @brief Loads 8 bytes from an unaligned address.
+ * @param[in] ptr Address to read.
+ * @return Word value.
+ */
+static inline uint64_t swar_load(const char *ptr)
+{
+  uint64_t ret;
+  memcpy(&ret, ptr, sizeof(ret));
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Exact byte equality mask.
+ * @details Unlike the classic haszero() trick there are no false
+ *          positives, so the result can be used to count matches.
+ * @param[in] word Word to check.
+ * @param[in] c Character to search.
+ * @return Word with the high bit set in each byte equal to c.
+ */
+static inline uint64_t swar_eq(uint64_t word, char c)
+{
+  uint64_t t = word ^ (SWAR_ONES * (unsigned char)(c));
+  uint64_t y = ((t & SWAR_LOW7) + SWAR_LOW7) | t;
+  return(~y & SWAR_HIGHS);
+}
+
+/**************************************************************************//**
+ * @brief Returns the first occurrence of c1 or c2 in [ptr, end).
+ * @param[in] ptr Initial position.
+ * @param[in] end End of content (not included).
+ * @param[in] c1 First character to search.
+ * @param[in] c2 Second character to search.
+ * @return Pointer to the found character, end if not found.
+ */
+const char* scan_chr2(const char *ptr, const char *end, char c1, char c2)
+{
+  assert(ptr != NULL);
+  assert(ptr <= end);
+
+#if SWAR_ENABLED
+  while (end - ptr >= 8) {
+    uint64_t word = swar_load(ptr);
+    uint64_t mask = swar_eq(word, c1) | swar_eq(word, c2);
+    if (mask != 0) {
+      return(ptr + __builtin_ctzll(mask)/8);
+    }
+    ptr += 8;
+  }
+#endif
+
+  while (ptr < end && *ptr != c1 && *ptr != c2) {
+    ptr++;
+  }
+
+  return(ptr);
+}
+
+/**************************************************************************//**
+ * @brief Returns the first occurrence of any char of set in [ptr, end).
+ * @param[in] ptr Initial position.
+ * @param[in] end End of content (not included).
+ * @param[in] set Characters to search ('\0' ended, not empty).
+ * @return Pointer to the found character, end if not found.
+ */
+const char* scan_any(const char *ptr, const char *end, const char *set)
+{
+  assert(ptr != NULL);
+  assert(ptr <= end);
+  assert(set != NULL && *set != '\0');
+
+#if SWAR_ENABLED
+  while (end - ptr >= 8) {
+    uint64_t word = swar_load(ptr);
+    uint64_t mask = 0;
+    for (const char *c=set; *c != '\0'; c++) {
+      mask |= swar_eq(word, *c);
+    }
+    if (mask != 0) {
+      return(ptr + __builtin_ctzll(mask)/8);
+    }
+    ptr += 8;
+  }
+#endif
+
+  size_t len = strlen(set);
+  while (ptr < end && memchr(set, *ptr, len) == NULL) {
+    ptr++;
+  }
+
+  return(ptr);
+}
+
+/**************************************************************************//**
+ * @brief Counts the occurrences of c in [ptr, end).
+ * @details Used to track line numbers (c='\n') at almost no cost.
+ * @param[in] ptr Initial position.
+ * @param[in] end End of content (not included).
+ * @param[in] c Character to count.
+ * @return Number of occurrences.
+ */
+size_t scan_count(const char *ptr, const char *end, char c)
+{
+  assert(ptr != NULL);
+  assert(ptr <= end);
+
+  size_t ret = 0;
+
+#if SWAR_ENABLED
+  while (end - ptr >= 8) {
+    ret += __builtin_popcountll(swar_eq(swar_load(ptr), c));
+    ptr += 8;
+  }
+#endif
+
+  while (ptr < end) {
+    ret += (*ptr == c);
+    ptr++;
+  }
+
+  return(ret);
+}
@@ -20,29 +20,17 @@
 //
 //===========================================================================
 
-#ifndef WDATA_H
-#define WDATA_H
+#ifndef SCAN_H
+#define SCAN_H
 
-#include "witem.h"
-
-/**************************************************************************//**
- * @brief Values parsed by processor to be persisted in DB.
- * @details Variable length depending on param values. We do it this way to
- *          minimize the number of malloc/free calls.
- * @details To retrieve the pointer to param values do "char *ptr = &x;"
- */
-typedef struct wdata_t
-{
-  //! Watched item.
-  witem_t *item;
-  //! Table param values (sorted, separated by '\0').
-  char x;
-} wdata_t;
+#include <stddef.h>
 
 /**************************************************************************
  * Function declarations.
  */
-extern wdata_t* wdata_alloc(witem_t *item, const char *str);
-extern void wdata_free(void *obj);
+extern const char* scan_chr2(const char *ptr, const char *end, char c1, char c2);
+extern const char* scan_any(const char *ptr, const char *end, const char *set);
+extern size_t scan_count(const char *ptr, const char *end, char c);
 
 #endif
+
@@ -0,0 +1,411 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <assert.h>
+#include "slab.h"
+
+#define SLAB_PAGE_SIZE (64*1024)
+#define SLAB_HEADER_SIZE 64
+#define SLAB_MIN_SHIFT 5
+#define SLAB_NUM_CLASSES 8
+#define SLAB_CLASS_HUGE SLAB_NUM_CLASSES
+#define SLAB_BATCH_SIZE 64
+
+/**************************************************************************//**
+ * @brief Free block (first bytes of an unused block).
+ */
+typedef struct slab_block_t
+{
+  //! Next free block.
+  struct slab_block_t *next;
+} slab_block_t;
+
+/**************************************************************************//**
+ * @brief Per-thread cache.
+ */
+typedef struct slab_cache_t
+{
+  //! Free blocks per size class (accessed only by owner thread).
+  slab_block_t *free[SLAB_NUM_CLASSES];
+  //! Blocks returned by other threads (lock-free stack).
+  _Atomic(slab_block_t *) remote;
+  //! Pages allocated by this cache.
+  struct slab_page_t *pages;
+  //! Cache owning the blocks of the batch.
+  struct slab_cache_t *batch_owner;
+  //! First block of the batch (blocks freed by this thread, owned by another).
+  slab_block_t *batch_head;
+  //! Last block of the batch.
+  slab_block_t *batch_tail;
+  //! Number of blocks in the batch.
+  size_t batch_size;
+  //! Next cache (see caches).
+  struct slab_cache_t *next;
+} slab_cache_t;
+
+/**************************************************************************//**
+ * @brief Page header (page is aligned to SLAB_PAGE_SIZE).
+ */
+typedef struct slab_page_t
+{
+  //! Cache owning the page (NULL=huge).
+  slab_cache_t *owner;
+  //! Size class of the page blocks.
+  size_t sclass;
+  //! Page length (huge pages only).
+  size_t length;
+  //! Next page of the cache.
+  struct slab_page_t *next;
+} slab_page_t;
+
+static_assert(sizeof(slab_page_t) <= SLAB_HEADER_SIZE, "slab header too small");
+
+// Cache of the current thread.
+static _Thread_local slab_cache_t *slab_cache = NULL;
+// List of caches (protected by mutex).
+static slab_cache_t *caches = NULL;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+// Allocated bytes (block sizes).
+static atomic_size_t used = 0;
+// Maximum allocated bytes.
+static atomic_size_t peak = 0;
+
+/**************************************************************************//**
+ * @brief Returns the size class of a requested size.
+ * @param[in] size Requested size.
+ * @return Size class (SLAB_CLASS_HUGE if bigger than largest block).
+ */
+static size_t slab_class(size_t size)
+{
+  size_t ret = 0;
+  while (ret < SLAB_NUM_CLASSES && ((size_t) 1 << (ret + SLAB_MIN_SHIFT)) < size) {
+    ret++;
+  }
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Returns the page containing a block.
+ * @param[in] ptr Block allocated with slab_alloc().
+ * @return Page header.
+ */
+static inline slab_page_t* slab_page(const void *ptr)
+{
+  return((slab_page_t *)((uintptr_t) ptr & ~((uintptr_t) SLAB_PAGE_SIZE - 1)));
+}
+
+/**************************************************************************//**
+ * @brief Updates the allocated bytes.
+ * @param[in] len Allocated bytes.
+ */
+static void slab_account(size_t len)
+{
+  size_t value = atomic_fetch_add(&used, len) + len;
+  size_t max = atomic_load(&peak);
+  while (value > max && !atomic_compare_exchange_weak(&peak, &max, value));
+}
+
+/**************************************************************************//**
+ * @brief Returns the cache of the current thread (created on first use).
+ * @return The cache, NULL if error.
+ */
+static slab_cache_t* slab_cache_get(void)
+{
+  if (slab_cache != NULL) {
+    return(slab_cache);
+  }
+
+  slab_cache_t *cache = (slab_cache_t *) calloc(1, sizeof(slab_cache_t));
+  if (cache == NULL) {
+    return(NULL);
+  }
+
+  atomic_init(&(cache->remote), NULL);
+
+  pthread_mutex_lock(&mutex);
+  cache->next = caches;
+  caches = cache;
+  pthread_mutex_unlock(&mutex);
+
+  slab_cache = cache;
+  return(cache);
+}
+
+/**************************************************************************//**
+ * @brief Moves the blocks returned by other threads to the free lists.
+ * @param[in,out] cache Cache of the current thread.
+ */
+static void slab_collect(slab_cache_t *cache)
+{
+  slab_block_t *block = atomic_exchange(&(cache->remote), NULL);
+
+  while (block != NULL) {
+    slab_block_t *next = block->next;
+    size_t sclass = slab_page(block)->sclass;
+    block->next = cache->free[sclass];
+    cache->free[sclass] = block;
+    block = next;
+  }
+}
+
+/**************************************************************************//**
+ * @brief Allocates a new page and splits it in blocks.
+ * @param[in,out] cache Cache of the current thread.
+ * @param[in] sclass Size class.
+ * @return 0=OK, otherwise=error.
+ */
+static int slab_grow(slab_cache_t *cache, size_t sclass)
+{
+  slab_page_t *page = (slab_page_t *) aligned_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+  if (page == NULL) {
+    return(1);
+  }
+
+  page->owner = cache;
+  page->sclass = sclass;
+  page->length = SLAB_PAGE_SIZE;
+  page->next = cache->pages;
+  cache->pages = page;
+
+  size_t size = (size_t) 1 << (sclass + SLAB_MIN_SHIFT);
+  char *ptr = (char *) page + SLAB_PAGE_SIZE - size;
+
+  // blocks are linked in address order
+  while (ptr >= (char *) page + SLAB_HEADER_SIZE) {
+    slab_block_t *block = (slab_block_t *) ptr;
+    block->next = cache->free[sclass];
+    cache->free[sclass] = block;
+    ptr -= size;
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Allocates a block of memory.
+ * @details Returned memory is aligned to pointer size (at least).
+ * @param[in] size Requested size.
+ * @return Allocated memory, NULL if error.
+ */
+void* slab_alloc(size_t size)
+{
+  size_t sclass = slab_class(size);
+
+  if (sclass == SLAB_CLASS_HUGE) {
+    size_t length = (SLAB_HEADER_SIZE + size + SLAB_PAGE_SIZE - 1) / SLAB_PAGE_SIZE * SLAB_PAGE_SIZE;
+    slab_page_t *page = (slab_page_t *) aligned_alloc(SLAB_PAGE_SIZE, length);
+    if (page == NULL) {
+      return(NULL);
+    }
+    page->owner = NULL;
+    page->sclass = SLAB_CLASS_HUGE;
+    page->length = length;
+    page->next = NULL;
+    slab_account(length);
+    return((char *) page + SLAB_HEADER_SIZE);
+  }
+
+  slab_cache_t *cache = slab_cache_get();
+  if (cache == NULL) {
+    return(NULL);
+  }
+
+  if (cache->free[sclass] == NULL) {
+    slab_collect(cache);
+  }
+  if (cache->free[sclass] == NULL && slab_grow(cache, sclass) != 0) {
+    return(NULL);
+  }
+
+  slab_block_t *block = cache->free[sclass];
+  cache->free[sclass] = block->next;
+  slab_account((size_t) 1 << (sclass + SLAB_MIN_SHIFT));
+  return(block);
+}
+
+/**************************************************************************//**
+ * @brief Changes the size of a block allocated with slab_alloc().
+ * @details Block is kept if its size class has room for the new size.
+ *          Otherwise content is copied to a new block.
+ * @param[in] ptr Block to resize (NULL=allocate).
+ * @param[in] size Requested size.
+ * @return Resized block, NULL if error (ptr is not freed).
+ */
+void* slab_realloc(void *ptr, size_t size)
+{
+  if (ptr == NULL) {
+    return(slab_alloc(size));
+  }
+
+  slab_page_t *page = slab_page(ptr);
+  size_t capacity = (page->sclass == SLAB_CLASS_HUGE ?
+                     page->length - SLAB_HEADER_SIZE :
+                     (size_t) 1 << (page->sclass + SLAB_MIN_SHIFT));
+
+  if (size <= capacity) {
+    return(ptr);
+  }
+
+  void *ret = slab_alloc(size);
+  if (ret == NULL) {
+    return(NULL);
+  }
+
+  memcpy(ret, ptr, capacity);
+  slab_free(ptr);
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Returns the batch of blocks freed by this thread to its owner.
+ * @details Call it when the thread stops freeing blocks for a while (eg.
+ *          after a bulk release). Otherwise batch is returned when it is
+ *          full or when a block of another owner is freed.
+ */
+void slab_flush(void)
+{
+  slab_cache_t *cache = slab_cache;
+
+  if (cache == NULL || cache->batch_head == NULL) {
+    return;
+  }
+
+  slab_cache_t *owner = cache->batch_owner;
+  slab_block_t *head = atomic_load(&(owner->remote));
+  do {
+    cache->batch_tail->next = head;
+  } while (!atomic_compare_exchange_weak(&(owner->remote), &head, cache->batch_head));
+
+  cache->batch_owner = NULL;
+  cache->batch_head = NULL;
+  cache->batch_tail = NULL;
+  cache->batch_size = 0;
+}
+
+/**************************************************************************//**
+ * @brief Frees a block allocated with slab_alloc().
+ * @details Blocks owned by another thread are returned in batches of
+ *          SLAB_BATCH_SIZE blocks (see slab_flush).
+ * @param[in] ptr Block to free (can be NULL).
+ */
+void slab_free(void *ptr)
+{
+  if (ptr == NULL) {
+    return;
+  }
+
+  slab_page_t *page = slab_page(ptr);
+
+  if (page->sclass == SLAB_CLASS_HUGE) {
+    atomic_fetch_sub(&used, page->length);
+    free(page);
+    return;
+  }
+
+  atomic_fetch_sub(&used, (size_t) 1 << (page->sclass + SLAB_MIN_SHIFT));
+
+  slab_block_t *block = (slab_block_t *) ptr;
+  slab_cache_t *cache = slab_cache_get();
+
+  // no memory to track the batch, returned one by one
+  if (cache == NULL) {
+    slab_block_t *head = atomic_load(&(page->owner->remote));
+    do {
+      block->next = head;
+    } while (!atomic_compare_exchange_weak(&(page->owner->remote), &head, block));
+    return;
+  }
+
+  if (page->owner == cache) {
+    block->next = cache->free[page->sclass];
+    cache->free[page->sclass] = block;
+    return;
+  }
+
+  if (cache->batch_owner != page->owner) {
+    slab_flush();
+    cache->batch_owner = page->owner;
+    cache->batch_tail = block;
+  }
+
+  block->next = cache->batch_head;
+  cache->batch_head = block;
+  cache->batch_size++;
+
+  if (cache->batch_size >= SLAB_BATCH_SIZE) {
+    slab_flush();
+  }
+}
+
+/**************************************************************************//**
+ * @brief Returns the allocated bytes.
+ * @details Sum of the block sizes (requested size rounded up to its size
+ *          class) currently allocated by all threads.
+ * @return Allocated bytes.
+ */
+size_t slab_used(void)
+{
+  return(atomic_load(&used));
+}
+
+/**************************************************************************//**
+ * @brief Returns the maximum allocated bytes.
+ * @return Peak of allocated bytes.
+ */
+size_t slab_peak(void)
+{
+  return(atomic_load(&peak));
+}
+
+/**************************************************************************//**
+ * @brief Releases all the memory pages.
+ * @details Call it once no thread uses the allocator (eg. at exit). Huge
+ *          blocks not freed are not released.
+ */
+void slab_reset(void)
+{
+  pthread_mutex_lock(&mutex);
+
+  while (caches != NULL) {
+    slab_cache_t *cache = caches;
+    caches = cache->next;
+    while (cache->pages != NULL) {
+      slab_page_t *page = cache->pages;
+      cache->pages = page->next;
+      free(page);
+    }
+    free(cache);
+  }
+
+  slab_cache = NULL;
+  atomic_store(&used, 0);
+  atomic_store(&peak, 0);
+
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,51 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/**************************************************************************//**
+ * @brief Size-classed slab allocator for row payloads (see batch_t).
+ * @details Each thread allocates from its own cache of 64KB pages split in
+ *          blocks of a size class (32 to 4096 bytes). Blocks freed by
+ *          another thread are returned to the owner cache in batches
+ *          through a lock-free list, collected by the owner when its free
+ *          list of that class is empty. Bigger sizes are allocated one per
+ *          page. Allocated bytes are accounted (see slab_used/slab_peak).
+ *          Memory pages are retained until slab_reset().
+ */
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern void* slab_alloc(size_t size);
+extern void* slab_realloc(void *ptr, size_t size);
+extern void slab_free(void *ptr);
+extern void slab_flush(void);
+extern size_t slab_used(void);
+extern size_t slab_peak(void);
+extern void slab_reset(void);
+
+#endif
+
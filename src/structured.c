@@ -0,0 +1,677 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "scan.h"
+#include "structured.h"
+
+#define MAX_NUM_KEYS 128
+
+#define RC_OK 0
+#define RC_ERROR 1
+#define RC_DONE 2
+
+/**************************************************************************//**
+ * @brief Parser state.
+ * @details Only the keys referenced by paths are extracted. The remaining
+ *          content is skipped as fast as possible.
+ */
+typedef struct parser_t
+{
+  //! Current position.
+  const char *ptr;
+  //! End of content (not included).
+  const char *end;
+  //! Buffer where unescaped strings are written.
+  char *scratch;
+  //! Requested keys.
+  const keypath_t *paths;
+  //! Extracted values.
+  value_t *values;
+  //! Keys already found.
+  bool found[MAX_NUM_KEYS];
+  //! Number of keys not found yet.
+  size_t pending;
+} parser_t;
+
+/**************************************************************************//**
+ * @brief Initialize a key path from a parameter name.
+ * @param[out] path Key path to initialize.
+ * @param[in] name Parameter name (eg. 'request.method').
+ * @return 0=OK, otherwise=KO.
+ */
+int keypath_init(keypath_t *path, const char *name)
+{
+  if (path == NULL || name == NULL) {
+    assert(false);
+    return(1);
+  }
+
+  size_t length = strlen(name);
+  if (length == 0 || length > UINT8_MAX) {
+    return(1);
+  }
+
+  path->name = name;
+  path->length = length;
+  path->num = 0;
+
+  const char *ptr1 = name;
+  while(true) {
+    const char *ptr2 = strchr(ptr1, '.');
+    if (ptr2 == NULL) {
+      ptr2 = name + length;
+    }
+    if (path->num >= KEYPATH_MAX_DEPTH || ptr2 == ptr1) {
+      return(1);
+    }
+    path->pos[path->num] = ptr1 - name;
+    path->len[path->num] = ptr2 - ptr1;
+    path->num++;
+    if (*ptr2 == '\0') {
+      break;
+    }
+    ptr1 = ptr2 + 1;
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Initialize the parser state.
+ * @param[out] parser Parser state.
+ * @return 0=OK, otherwise=KO.
+ */
+static int parser_init(parser_t *parser, const char *str, size_t len, const keypath_t *paths,
+                       size_t num, value_t *values, char *scratch)
+{
+  if (num > MAX_NUM_KEYS) {
+    return(RC_ERROR);
+  }
+
+  parser->ptr = str;
+  parser->end = str + len;
+  parser->scratch = scratch;
+  parser->paths = paths;
+  parser->values = values;
+  parser->pending = num;
+
+  // empty paths are ignored
+  for(size_t i=0; i<num; i++) {
+    parser->found[i] = (paths[i].num == 0);
+    parser->pending -= (paths[i].num == 0);
+    values[i].ptr = NULL;
+    values[i].len = 0;
+  }
+
+  return(RC_OK);
+}
+
+/**************************************************************************//**
+ * @brief Sets a found value.
+ * @param[in,out] parser Parser state.
+ * @param[in] i Key index.
+ * @param[in] value Value.
+ */
+static void parser_set_value(parser_t *parser, size_t i, value_t value)
+{
+  assert(!parser->found[i]);
+  parser->values[i] = value;
+  parser->found[i] = true;
+  parser->pending--;
+}
+
+/**************************************************************************//**
+ * @brief Appends an UTF-8 encoded code point to buffer.
+ * @param[in,out] dst Buffer (updated to the next free position).
+ * @param[in] cp Unicode code point.
+ */
+static void utf8_encode(char **dst, unsigned long cp)
+{
+  char *ptr = *dst;
+
+  if (cp == 0) {
+    // '\0' is not allowed in database strings
+  }
+  else if (cp < 0x80) {
+    *ptr++ = (char) cp;
+  }
+  else if (cp < 0x800) {
+    *ptr++ = (char)(0xC0 | (cp >> 6));
+    *ptr++ = (char)(0x80 | (cp & 0x3F));
+  }
+  else if (cp < 0x10000) {
+    *ptr++ = (char)(0xE0 | (cp >> 12));
+    *ptr++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    *ptr++ = (char)(0x80 | (cp & 0x3F));
+  }
+  else {
+    *ptr++ = (char)(0xF0 | (cp >> 18));
+    *ptr++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+    *ptr++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    *ptr++ = (char)(0x80 | (cp & 0x3F));
+  }
+
+  *dst = ptr;
+}
+
+/**************************************************************************//**
+ * @brief Reads 4 hexadecimal digits.
+ * @param[in] ptr Digits position.
+ * @param[in] end End of content.
+ * @param[out] value Parsed value.
+ * @return true=OK, false=KO.
+ */
+static bool read_hex4(const char *ptr, const char *end, unsigned long *value)
+{
+  if (end - ptr < 4) {
+    return(false);
+  }
+
+  *value = 0;
+  for(int i=0; i<4; i++) {
+    char c = ptr[i];
+    *value <<= 4;
+    if (c >= '0' && c <= '9') *value |= (unsigned long)(c - '0');
+    else if (c >= 'a' && c <= 'f') *value |= (unsigned long)(c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F') *value |= (unsigned long)(c - 'A' + 10);
+    else return(false);
+  }
+
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Skips whitespaces.
+ * @param[in,out] parser Parser state.
+ */
+static inline void json_skip_ws(parser_t *parser)
+{
+  while(parser->ptr < parser->end &&
+        (*parser->ptr == ' ' || *parser->ptr == '\t' || *parser->ptr == '\n' || *parser->ptr == '\r')) {
+    parser->ptr++;
+  }
+}
+
+/**************************************************************************//**
+ * @brief Skips a string.
+ * @param[in,out] parser Parser state (positioned at opening quote).
+ * @return RC_OK or RC_ERROR.
+ */
+static int json_skip_string(parser_t *parser)
+{
+  const char *ptr = parser->ptr + 1;
+
+  while(true) {
+    ptr = scan_chr2(ptr, parser->end, '"', '\\');
+    if (ptr >= parser->end) {
+      return(RC_ERROR);
+    }
+    if (*ptr == '"') {
+      break;
+    }
+    ptr += 2;
+  }
+
+  parser->ptr = ptr + 1;
+  return(RC_OK);
+}
+
+/**************************************************************************//**
+ * @brief Reads a string.
+ * @details Strings without escape sequences reference the parsed content.
+ *          Otherwise string is unescaped to scratch buffer.
+ * @param[in,out] parser Parser state (positioned at opening quote).
+ * @param[out] value String content.
+ * @return RC_OK or RC_ERROR.
+ */
+static int json_read_string(parser_t *parser, value_t *value)
+{
+  const char *ptr = parser->ptr + 1;
+  const char *end = parser->end;
+  const char *aux = scan_chr2(ptr, end, '"', '\\');
+
+  if (aux >= end) {
+    return(RC_ERROR);
+  }
+
+  // fast path (no escape sequences)
+  if (*aux == '"') {
+    value->ptr = ptr;
+    value->len = aux - ptr;
+    parser->ptr = aux + 1;
+    return(RC_OK);
+  }
+
+  char *dst = parser->scratch;
+  value->ptr = dst;
+
+  while(true)
+  {
+    memcpy(dst, ptr, aux - ptr);
+    dst += aux - ptr;
+    ptr = aux;
+
+    if (*ptr == '"') {
+      break;
+    }
+
+    // escape sequence
+    if (ptr + 1 >= end) {
+      return(RC_ERROR);
+    }
+    ptr++;
+    switch(*ptr) {
+      case '"':  *dst++ = '"'; break;
+      case '\\': *dst++ = '\\'; break;
+      case '/':  *dst++ = '/'; break;
+      case 'b':  *dst++ = '\b'; break;
+      case 'f':  *dst++ = '\f'; break;
+      case 'n':  *dst++ = '\n'; break;
+      case 'r':  *dst++ = '\r'; break;
+      case 't':  *dst++ = '\t'; break;
+      case 'u': {
+        unsigned long cp = 0;
+        if (!read_hex4(ptr+1, end, &cp)) {
+          return(RC_ERROR);
+        }
+        ptr += 4;
+        // surrogate pair
+        unsigned long lo = 0;
+        if (cp >= 0xD800 && cp <= 0xDBFF && end - ptr > 6 && ptr[1] == '\\' && ptr[2] == 'u' &&
+            read_hex4(ptr+3, end, &lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+          ptr += 6;
+        }
+        utf8_encode(&dst, cp);
+        break;
+      }
+      default:
+        return(RC_ERROR);
+    }
+    ptr++;
+
+    aux = scan_chr2(ptr, end, '"', '\\');
+    if (aux >= end) {
+      return(RC_ERROR);
+    }
+  }
+
+  value->len = dst - value->ptr;
+  parser->scratch = dst;
+  parser->ptr = ptr + 1;
+  return(RC_OK);
+}
+
+/**************************************************************************//**
+ * @brief Skips a value (string, number, object, array, true, false, null).
+ * @param[in,out] parser Parser state (positioned at value).
+ * @return RC_OK or RC_ERROR.
+ */
+static int json_skip_value(parser_t *parser)
+{
+  if (parser->ptr >= parser->end) {
+    return(RC_ERROR);
+  }
+
+  char c = *parser->ptr;
+
+  if (c == '"') {
+    return json_skip_string(parser);
+  }
+
+  if (c == '{' || c == '[') {
+    int depth = 0;
+    while(true) {
+      parser->ptr = scan_any(parser->ptr, parser->end, "\"{}[]");
+      if (parser->ptr >= parser->end) {
+        return(RC_ERROR);
+      }
+      c = *parser->ptr;
+      if (c == '"') {
+        if (json_skip_string(parser) != RC_OK) {
+          return(RC_ERROR);
+        }
+        continue;
+      }
+      parser->ptr++;
+      depth += (c == '{' || c == '[' ? 1 : -1);
+      if (depth == 0) {
+        return(RC_OK);
+      }
+    }
+  }
+
+  // number, true, false, null
+  const char *ptr = parser->ptr;
+  while(ptr < parser->end && *ptr != ',' && *ptr != '}' && *ptr != ']' &&
+        *ptr != ' ' && *ptr != '\t' && *ptr != '\n' && *ptr != '\r') {
+    ptr++;
+  }
+  if (ptr == parser->ptr) {
+    return(RC_ERROR);
+  }
+  parser->ptr = ptr;
+  return(RC_OK);
+}
+
+/**************************************************************************//**
+ * @brief Parses an object extracting the requested keys.
+ * @param[in,out] parser Parser state (positioned at '{').
+ * @param[in] depth Object depth (0=root).
+ * @param[in] cand Keys that can be found in this object.
+ * @param[in] num Number of candidates.
+ * @return RC_OK, RC_ERROR or RC_DONE (all keys found).
+ */
+static int json_parse_object(parser_t *parser, uint32_t depth, const uint8_t *cand, size_t num)
+{
+  assert(*parser->ptr == '{');
+
+  int rc = RC_OK;
+  uint8_t sub[MAX_NUM_KEYS];
+  uint8_t term[MAX_NUM_KEYS];
+
+  parser->ptr++;
+  json_skip_ws(parser);
+  if (parser->ptr < parser->end && *parser->ptr == '}') {
+    parser->ptr++;
+    return(RC_OK);
+  }
+
+  while(true)
+  {
+    // member key
+    json_skip_ws(parser);
+    if (parser->ptr >= parser->end || *parser->ptr != '"') {
+      return(RC_ERROR);
+    }
+    value_t key = {0};
+    char *scratch = parser->scratch;
+    if (json_read_string(parser, &key) != RC_OK) {
+      return(RC_ERROR);
+    }
+    // unescaped key is not preserved
+    parser->scratch = scratch;
+
+    json_skip_ws(parser);
+    if (parser->ptr >= parser->end || *parser->ptr != ':') {
+      return(RC_ERROR);
+    }
+    parser->ptr++;
+    json_skip_ws(parser);
+    if (parser->ptr >= parser->end) {
+      return(RC_ERROR);
+    }
+
+    // selects the requested keys matching member key
+    size_t num_sub = 0;
+    size_t num_term = 0;
+    for(size_t i=0; i<num; i++) {
+      const keypath_t *path = parser->paths + cand[i];
+      if (parser->found[cand[i]] || path->len[depth] != key.len ||
+          memcmp(path->name + path->pos[depth], key.ptr, key.len) != 0) {
+        continue;
+      }
+      if (depth+1 == path->num) {
+        term[num_term++] = cand[i];
+      }
+      else {
+        sub[num_sub++] = cand[i];
+      }
+    }
+
+    // member value
+    const char *start = parser->ptr;
+    value_t value = {0};
+    bool is_string = false;
+
+    if (num_sub > 0 && *start == '{') {
+      // a raw object requested too keeps pending > 0 (no RC_DONE)
+      rc = json_parse_object(parser, depth+1, sub, num_sub);
+    }
+    else if (num_term > 0 && *start == '"') {
+      rc = json_read_string(parser, &value);
+      is_string = true;
+    }
+    else {
+      rc = json_skip_value(parser);
+    }
+    if (rc != RC_OK) {
+      return(rc);
+    }
+
+    // setting found values (json null = NULL)
+    if (!is_string && parser->ptr - start == 4 && memcmp(start, "null", 4) == 0) {
+      value.ptr = NULL;
+    }
+    else if (!is_string) {
+      value.ptr = start;
+      value.len = parser->ptr - start;
+    }
+    for(size_t i=0; i<num_term; i++) {
+      parser_set_value(parser, term[i], value);
+    }
+    if (parser->pending == 0) {
+      return(RC_DONE);
+    }
+
+    // next member
+    json_skip_ws(parser);
+    if (parser->ptr >= parser->end) {
+      return(RC_ERROR);
+    }
+    if (*parser->ptr == '}') {
+      parser->ptr++;
+      return(RC_OK);
+    }
+    if (*parser->ptr != ',') {
+      return(RC_ERROR);
+    }
+    parser->ptr++;
+  }
+}
+
+/**************************************************************************//**
+ * @brief Extracts the requested keys from a JSON object.
+ * @details Missing keys and JSON nulls are returned as NULL values.
+ *          String values are unescaped, other values (numbers,
+ *          booleans, objects, arrays) are returned as raw JSON text.
+ *          Parsing stops as soon as all keys are found.
+ * @param[in] str Content to parse (a JSON object, not '\0' ended).
+ * @param[in] len Content length.
+ * @param[in] paths Requested keys (empty paths are ignored).
+ * @param[in] num Number of requested keys.
+ * @param[out] values Extracted values (num entries).
+ * @param[in] scratch Buffer to write unescaped strings (at least len bytes).
+ * @return 0=OK, otherwise=malformed content.
+ */
+int json_extract(const char *str, size_t len, const keypath_t *paths, size_t num, value_t *values, char *scratch)
+{
+  if (str == NULL || (num > 0 && (paths == NULL || values == NULL || scratch == NULL))) {
+    assert(false);
+    return(RC_ERROR);
+  }
+
+  parser_t parser;
+  uint8_t cand[MAX_NUM_KEYS];
+
+  if (parser_init(&parser, str, len, paths, num, values, scratch) != RC_OK) {
+    return(RC_ERROR);
+  }
+
+  json_skip_ws(&parser);
+  if (parser.ptr >= parser.end || *parser.ptr != '{') {
+    return(RC_ERROR);
+  }
+
+  if (parser.pending == 0) {
+    return(RC_OK);
+  }
+
+  for(size_t i=0; i<num; i++) {
+    cand[i] = i;
+  }
+
+  int rc = json_parse_object(&parser, 0, cand, num);
+  return(rc == RC_ERROR ? RC_ERROR : RC_OK);
+}
+
+/**************************************************************************//**
+ * @brief Checks if a character is a logfmt separator.
+ * @param[in] c Character to check.
+ * @return true=separator, false=otherwise.
+ */
+static inline bool logfmt_is_space(char c)
+{
+  return(c == ' ' || c == '\t' || c == '\n' || c == '\r');
+}
+
+/**************************************************************************//**
+ * @brief Reads a quoted logfmt value.
+ * @param[in,out] parser Parser state (positioned at opening quote).
+ * @param[out] value String content.
+ * @return RC_OK or RC_ERROR.
+ */
+static int logfmt_read_quoted(parser_t *parser, value_t *value)
+{
+  const char *ptr = parser->ptr + 1;
+  const char *end = parser->end;
+  const char *aux = scan_chr2(ptr, end, '"', '\\');
+
+  if (aux >= end) {
+    return(RC_ERROR);
+  }
+
+  // fast path (no escape sequences)
+  if (*aux == '"') {
+    value->ptr = ptr;
+    value->len = aux - ptr;
+    parser->ptr = aux + 1;
+    return(RC_OK);
+  }
+
+  char *dst = parser->scratch;
+  value->ptr = dst;
+
+  while(*aux != '"')
+  {
+    memcpy(dst, ptr, aux - ptr);
+    dst += aux - ptr;
+    if (aux + 1 >= end) {
+      return(RC_ERROR);
+    }
+    switch(aux[1]) {
+      case 'n': *dst++ = '\n'; break;
+      case 'r': *dst++ = '\r'; break;
+      case 't': *dst++ = '\t'; break;
+      default:  *dst++ = aux[1]; break;
+    }
+    ptr = aux + 2;
+    aux = scan_chr2(ptr, end, '"', '\\');
+    if (aux >= end) {
+      return(RC_ERROR);
+    }
+  }
+
+  memcpy(dst, ptr, aux - ptr);
+  dst += aux - ptr;
+
+  value->len = dst - value->ptr;
+  parser->scratch = dst;
+  parser->ptr = aux + 1;
+  return(RC_OK);
+}
+
+/**************************************************************************//**
+ * @brief Extracts the requested keys from a logfmt line.
+ * @details Format: key1=value1 key2="quoted value" flag
+ *          Missing keys are returned as NULL values. Keys without value
+ *          (flags) are returned as 'true'. Dots are part of the key name.
+ *          Parsing stops as soon as all keys are found.
+ * @see https://brandur.org/logfmt
+ * @param[in] str Content to parse (not '\0' ended).
+ * @param[in] len Content length.
+ * @param[in] paths Requested keys (empty paths are ignored).
+ * @param[in] num Number of requested keys.
+ * @param[out] values Extracted values (num entries).
+ * @param[in] scratch Buffer to write unescaped strings (at least len bytes).
+ * @return 0=OK, otherwise=malformed content.
+ */
+int logfmt_extract(const char *str, size_t len, const keypath_t *paths, size_t num, value_t *values, char *scratch)
+{
+  if (str == NULL || (num > 0 && (paths == NULL || values == NULL || scratch == NULL))) {
+    assert(false);
+    return(RC_ERROR);
+  }
+
+  parser_t parser;
+
+  if (parser_init(&parser, str, len, paths, num, values, scratch) != RC_OK) {
+    return(RC_ERROR);
+  }
+
+  while(parser.pending > 0)
+  {
+    while(parser.ptr < parser.end && logfmt_is_space(*parser.ptr)) {
+      parser.ptr++;
+    }
+    if (parser.ptr >= parser.end) {
+      break;
+    }
+
+    // key
+    const char *key = parser.ptr;
+    while(parser.ptr < parser.end && *parser.ptr != '=' && !logfmt_is_space(*parser.ptr)) {
+      parser.ptr++;
+    }
+    size_t key_len = parser.ptr - key;
+
+    // value
+    value_t value = {"true", 4};
+    if (parser.ptr < parser.end && *parser.ptr == '=') {
+      parser.ptr++;
+      if (parser.ptr < parser.end && *parser.ptr == '"') {
+        if (logfmt_read_quoted(&parser, &value) != RC_OK) {
+          return(RC_ERROR);
+        }
+      }
+      else {
+        value.ptr = parser.ptr;
+        while(parser.ptr < parser.end && !logfmt_is_space(*parser.ptr)) {
+          parser.ptr++;
+        }
+        value.len = parser.ptr - value.ptr;
+      }
+    }
+
+    for(size_t i=0; i<num; i++) {
+      if (!parser.found[i] && paths[i].length == key_len && memcmp(paths[i].name, key, key_len) == 0) {
+        parser_set_value(&parser, i, value);
+      }
+    }
+  }
+
+  return(RC_OK);
+}
@@ -0,0 +1,59 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef STRUCTURED_H
+#define STRUCTURED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "format.h"
+
+#define KEYPATH_MAX_DEPTH 16
+
+/**************************************************************************//**
+ * @brief Key referenced by a table parameter.
+ * @details Parameter 'request.method' references the key 'method' of
+ *          the object 'request' (json) or the key 'request.method' (logfmt).
+ */
+typedef struct keypath_t
+{
+  //! Parameter name (not owner).
+  const char *name;
+  //! Parameter name length.
+  uint32_t length;
+  //! Number of segments.
+  uint32_t num;
+  //! Segment positions (relative to name).
+  uint8_t pos[KEYPATH_MAX_DEPTH];
+  //! Segment lengths.
+  uint8_t len[KEYPATH_MAX_DEPTH];
+} keypath_t;
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern int keypath_init(keypath_t *path, const char *name);
+extern int json_extract(const char *str, size_t len, const keypath_t *paths, size_t num, value_t *values, char *scratch);
+extern int logfmt_extract(const char *str, size_t len, const keypath_t *paths, size_t num, value_t *values, char *scratch);
+
+#endif
+
@@ -33,6 +33,9 @@
 
 #define TABLE_PARAM_NAME "name"
 #define TABLE_PARAM_SQL "sql"
+#define TABLE_PARAM_WRITER "writer"
+
+#define DEFAULT_WRITER "default"
 
 #define MAX_NUM_PARAMS 99
 #define PARAMETER_PREFIX '$'
@@ -41,15 +44,65 @@
 static const char *TABLE_PARAMS[] = {
     TABLE_PARAM_NAME,
     TABLE_PARAM_SQL,
+    TABLE_PARAM_WRITER,
+    NULL
+};
+
+static const char *META_PARAMS[] = {
+    "",
+    "_FILE",
+    "_OFFSET",
+    "_LINE",
+    "_HOST",
+    "_INGEST_TS",
     NULL
 };
 
 /**************************************************************************//**
- * @brief Returns the list of parameters (identifiers prefixed by ':').
- * @details Parameters sorted by order of appearance.
- * @details Parameter identifier consist of up to 32 alphanumeric characters
- *          and underscores, but must start with a non-digit.
- * @example str="INSERT INTO table VALUES(:id, :name)"
+ * @brief Returns the end of the parameter identifier starting at ptr.
+ * @details Parameter identifier consist of up to 32 alphanumeric characters,
+ *          underscores and dots, but must start with a letter or an underscore
+ *          followed by a letter (reserved parameters, eg. $_FILE). Dots are
+ *          used to reference nested keys (eg. $request.method) and must be
+ *          followed by a non-digit.
+ * @param[in] ptr Position just after the parameter prefix.
+ * @return End of identifier (ptr if there is no identifier).
+ */
+static const char* sql_param_end(const char *ptr)
+{
+  // start with a non-digit
+  if (!isalpha(*ptr) && !(*ptr == '_' && isalpha(ptr[1]))) {
+    return(ptr);
+  }
+  // alphanumeric characters, underscores and dots
+  while(isalnum(*ptr) || *ptr == '_' || (*ptr == '.' && (isalpha(ptr[1]) || ptr[1] == '_'))) {
+    ptr++;
+  }
+  return(ptr);
+}
+
+/**************************************************************************//**
+ * @brief Returns the index of a parameter.
+ * @param[in] lst List of parameters.
+ * @param[in] name Parameter name (not '\0' ended).
+ * @param[in] len Parameter name length.
+ * @return Index of parameter, negative value if not found.
+ */
+static int sql_param_find(const vector_t *lst, const char *name, size_t len)
+{
+  for(uint32_t i=0; i<lst->size; i++) {
+    const char *param = (const char *) lst->data[i];
+    if (strncmp(param, name, len) == 0 && param[len] == '\0') {
+      return(i);
+    }
+  }
+  return(-1);
+}
+
+/**************************************************************************//**
+ * @brief Returns the list of parameters (identifiers prefixed by '$').
+ * @details Parameters sorted by order of appearance (without duplicates).
+ * @example str="INSERT INTO table VALUES($id, $name)"
  * @param[in] sql Sql string.
  * @param[in,out] lst List of parameters (initially empty).
  * @return 0=OK, otherwise=KO.
@@ -64,24 +117,17 @@ static int sql_get_parameters(const char *sql, vector_t *lst)
   const char *ptr1 = sql;
   while((ptr1 = strchr(ptr1, PARAMETER_PREFIX)) != NULL)
   {
-    const char *ptr2 = ptr1+1;
-    // start with a non-digit
-    if (!isalpha(*ptr2)) {
-      ptr1 = ptr2;
-      continue;
-    }
-    // alphanumeric characters and underscores
-    while(isalnum(*ptr2) || *ptr2 == '_') ptr2++;
+    const char *ptr2 = sql_param_end(ptr1+1);
+    size_t len = ptr2 - ptr1 - 1;
     // length up to 32 characters
-    if (ptr2-ptr1-1 <= PARAMETER_MAX_SIZE) {
-      char *var = strndup(ptr1+1, (ptr2-ptr1-1));
+    if (len > 0 && len <= PARAMETER_MAX_SIZE && sql_param_find(lst, ptr1+1, len) < 0) {
+      char *var = strndup(ptr1+1, len);
       if (var == NULL) {
         return(1);
       }
-      //TODO: avoid duplicates
       vector_insert(lst, var);
     }
-    ptr1 = ptr2;
+    ptr1 = (ptr2 == ptr1 ? ptr1+1 : ptr2);
   }
   return(0);
 }
@@ -90,12 +136,14 @@ static int sql_get_parameters(const char *sql, vector_t *lst)
  * @brief Allocate and initialize a table object.
  * @param[in] name Table name.
  * @param[in] sql Sql command.
+ * @param[in] writer Writer group name.
  * @return Initialized object or NULL if error.
  */
-static table_t* table_alloc(const char *name, const char *sql)
+static table_t* table_alloc(const char *name, const char *sql, const char *writer)
 {
   assert(name != NULL);
   assert(sql != NULL);
+  assert(writer != NULL);
 
   table_t *ret = (table_t *) calloc(1, sizeof(table_t));
   if (ret == NULL) {
@@ -104,12 +152,17 @@ static table_t* table_alloc(const char *name, const char *sql)
 
   ret->name = strdup(name);
   ret->sql = strdup(sql);
+  ret->writer_name = strdup(writer);
+  ret->writer = 0;
+  atomic_init(&(ret->num_rows), 0);
+  atomic_init(&(ret->millis_exec), 0);
+  atomic_init(&(ret->num_deferred), 0);
   vector_reset(&(ret->parameters), NULL);
   sql_get_parameters(sql, &(ret->parameters));
 
   char *str = vector_print(&(ret->parameters));
-  syslog(LOG_DEBUG, "created table [address=%p, name=%s, sql=%s, parameters=%s]",
-         (void *)ret, name, sql, str);
+  syslog(LOG_DEBUG, "created table [address=%p, name=%s, sql=%s, writer=%s, parameters=%s]",
+         (void *)ret, name, sql, writer, str);
   free(str);
 
   return(ret);
@@ -128,13 +181,17 @@ void table_free(void *ptr)
 
   free(obj->name);
   free(obj->sql);
+  free(obj->writer_name);
   vector_reset(&(obj->parameters), free);
   free(obj);
 }
 
 /**************************************************************************//**
- * @brief Replace parameters (':') by numeric identifiers ('$').
- * @example 'values(:timestamp, :msg)' -> 'values($1, $2)'
+ * @brief Replace parameters by numeric identifiers.
+ * @details Parameters are replaced token by token, so a parameter that
+ *          is a prefix of another one (eg. $request and $request.method)
+ *          does not interfere with it.
+ * @example 'values($timestamp, $msg)' -> 'values($1, $2)'
  * @param[in] table Table object.
  * @return String with numeric identifiers (to be freed by caller), NULL if error.
  */
@@ -146,25 +203,40 @@ char* table_get_stmt(const table_t *table)
   }
 
   stringbuf_t ret = {0};
-  char param_name[PARAMETER_MAX_SIZE+2] = {0};
-  char param_id[6] = {0};
-
-  stringbuf_append(&ret, table->sql);
-  param_name[0] = PARAMETER_PREFIX;
+  char param_id[16] = {0};
+  const char *ptr1 = table->sql;
+  const char *ptr2 = NULL;
 
   // performs the replacement ($variable -> $1)
-  for(uint32_t i=0; i<table->parameters.size; i++) {
-    sprintf(param_id, "$%d", (int)(i+1));
-    strncpy(param_name+1, (char*)(table->parameters.data[i]), PARAMETER_MAX_SIZE);
-    stringbuf_replace(&ret, param_name, param_id);
+  while((ptr2 = strchr(ptr1, PARAMETER_PREFIX)) != NULL)
+  {
+    const char *ptr3 = sql_param_end(ptr2+1);
+    if (ptr3 == ptr2+1) {
+      // not a parameter
+      stringbuf_append_n(&ret, ptr1, ptr3-ptr1);
+      ptr1 = ptr3;
+      continue;
+    }
+    int ipos = sql_param_find(&(table->parameters), ptr2+1, ptr3-ptr2-1);
+    if (ipos < 0) {
+      // parameter too long (ignored)
+      stringbuf_append_n(&ret, ptr1, ptr3-ptr1);
+      ptr1 = ptr3;
+      continue;
+    }
+    stringbuf_append_n(&ret, ptr1, ptr2-ptr1);
+    snprintf(param_id, sizeof(param_id), "$%d", ipos+1);
+    stringbuf_append(&ret, param_id);
+    ptr1 = ptr3;
   }
+  stringbuf_append(&ret, ptr1);
 
   return(ret.data);
 }
 
 /**************************************************************************//**
  * @brief Parse a table entry and adds to table list.
- * @detail setting format: { name="xxx"; sql="yyy"; }
+ * @detail setting format: { name="xxx"; sql="yyy"; writer="zzz"; }
  * @param[in,out] lst List of tables.
  * @param[in] setting Configuration setting.
  * @return 0=OK, otherwise=KO.
@@ -177,6 +249,7 @@ static int tables_parse_item(vector_t *lst, const config_setting_t *setting)
   int rc = 0;
   const char *name = NULL;
   const char *sql = NULL;
+  const char *writer = DEFAULT_WRITER;
 
   // check attributes
   rc = setting_check_childs(setting, TABLE_PARAMS);
@@ -184,6 +257,7 @@ static int tables_parse_item(vector_t *lst, const config_setting_t *setting)
   // retrieving attributes
   config_setting_lookup_string(setting, TABLE_PARAM_NAME, &name);
   config_setting_lookup_string(setting, TABLE_PARAM_SQL, &sql);
+  config_setting_lookup_string(setting, TABLE_PARAM_WRITER, &writer);
 
   // check if attributes are set
   if (name == NULL) {
@@ -215,11 +289,21 @@ static int tables_parse_item(vector_t *lst, const config_setting_t *setting)
   }
 
   // create table
-  table_t *item = table_alloc(name, sql);
+  table_t *item = table_alloc(name, sql, writer);
   if (item == NULL) {
     return(1);
   }
 
+  // tables having the same writer name share the writer
+  item->writer = tables_writers(lst);
+  for(uint32_t i=0; i<lst->size; i++) {
+    const table_t *table = (const table_t *) lst->data[i];
+    if (strcmp(table->writer_name, writer) == 0) {
+      item->writer = table->writer;
+      break;
+    }
+  }
+
   // check the number of parameters
   if (item->parameters.size > MAX_NUM_PARAMS) {
     config_setting_t *aux = config_setting_get_member(setting, TABLE_PARAM_SQL);
@@ -241,6 +325,23 @@ static int tables_parse_item(vector_t *lst, const config_setting_t *setting)
   return(rc);
 }
 
+/**************************************************************************//**
+ * @brief Returns the number of writer groups.
+ * @param[in] lst List of tables.
+ * @return Number of writers (writer indexes are 0..n-1).
+ */
+size_t tables_writers(const vector_t *lst)
+{
+  size_t ret = 0;
+
+  for(uint32_t i=0; i<lst->size; i++) {
+    const table_t *table = (const table_t *) lst->data[i];
+    ret = MAX(ret, table->writer + 1);
+  }
+
+  return(ret);
+}
+
 /**************************************************************************//**
  * @brief Initialize the list of tables.
  * @param[in,out] lst List of tables.
@@ -272,3 +373,23 @@ int tables_init(vector_t *lst, const config_t *cfg)
 
   return(rc);
 }
+
+/**************************************************************************//**
+ * @brief Returns the reserved parameter identifier.
+ * @param[in] name Parameter name (eg. '_FILE').
+ * @return Reserved parameter, META_NONE if not reserved.
+ */
+meta_e table_meta_find(const char *name)
+{
+  if (name == NULL || name[0] != '_') {
+    return(META_NONE);
+  }
+
+  for(int i=1; META_PARAMS[i]!=NULL; i++) {
+    if (strcmp(META_PARAMS[i], name) == 0) {
+      return((meta_e) i);
+    }
+  }
+
+  return(META_NONE);
+}
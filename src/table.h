@@ -23,9 +23,23 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+#include <stddef.h>
+#include <stdatomic.h>
 #include <libconfig.h>
 #include "vector.h"
 
+/**************************************************************************//**
+ * @brief Reserved parameters (resolved by log2pg, not by format).
+ */
+typedef enum {
+  META_NONE = 0,    // Not reserved.
+  META_FILE,        // $_FILE: source filename.
+  META_OFFSET,      // $_OFFSET: byte offset of the chunk in file.
+  META_LINE,        // $_LINE: line number of the chunk in file.
+  META_HOST,        // $_HOST: host name.
+  META_INGEST_TS    // $_INGEST_TS: time when chunk was read.
+} meta_e;
+
 /**************************************************************************//**
  * @brief Table defined in configuration file.
  * @details First member is 'char *' to be searchable.
@@ -38,14 +52,26 @@ typedef struct table_t
   char *sql;
   //! Table parameters (strings).
   vector_t parameters;
+  //! Writer group name.
+  char *writer_name;
+  //! Writer group index (queue and database connection).
+  size_t writer;
+  //! Number of committed rows.
+  atomic_size_t num_rows;
+  //! Time spent inserting rows (in millis).
+  atomic_size_t millis_exec;
+  //! Number of times a file was deferred because the writer was congested.
+  atomic_size_t num_deferred;
 } table_t;
 
 /**************************************************************************
  * Function declarations.
  */
 extern int tables_init(vector_t *lst, const config_t *cfg);
+extern size_t tables_writers(const vector_t *lst);
 extern void table_free(void *obj);
 char* table_get_stmt(const table_t *table);
+extern meta_e table_meta_find(const char *name);
 
 #endif
 
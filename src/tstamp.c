@@ -0,0 +1,520 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#include "log2pg.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <assert.h>
+#include "tstamp.h"
+
+static const char *TSTAMP_LAYOUTS[] = {
+    "clf",
+    "iso8601",
+    "syslog",
+    "epoch",
+    "epoch_ms",
+    NULL
+};
+
+static const char *MONTHS[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/**************************************************************************//**
+ * @brief Date-time components.
+ */
+typedef struct datetime_t
+{
+  int year;
+  int month;
+  int day;
+  int hour;
+  int minute;
+} datetime_t;
+
+/**************************************************************************//**
+ * @brief Returns the layout identifier.
+ * @param[in] name Layout name (eg. 'clf').
+ * @return Layout or TSTAMP_NONE if not found.
+ */
+tstamp_layout_e tstamp_layout_find(const char *name)
+{
+  if (name == NULL) {
+    return(TSTAMP_NONE);
+  }
+
+  int i = 0;
+  while(TSTAMP_LAYOUTS[i] != NULL && strcmp(TSTAMP_LAYOUTS[i], name) != 0) i++;
+  return((tstamp_layout_e) i);
+}
+
+/**************************************************************************//**
+ * @brief Frees memory space pointed by ptr.
+ * @param[in] ptr Pointer to tstamp_param object.
+ */
+void tstamp_param_free(void *ptr)
+{
+  if (ptr == NULL) return;
+  tstamp_param_t *obj = (tstamp_param_t *) ptr;
+  free(obj->name);
+  free(ptr);
+}
+
+/**************************************************************************//**
+ * @brief Initialize a timestamp parser.
+ * @param[out] obj Timestamp parser.
+ * @param[in] layout Timestamp layout.
+ */
+void tstamp_init(tstamp_t *obj, tstamp_layout_e layout)
+{
+  if (obj == NULL) {
+    assert(false);
+    return;
+  }
+
+  memset(obj, 0, sizeof(tstamp_t));
+  obj->layout = layout;
+  obj->minute = -1;
+}
+
+/**************************************************************************//**
+ * @brief Reads a fixed-length number.
+ * @param[in] str String to read.
+ * @param[in] n Number of digits.
+ * @param[out] value Parsed value.
+ * @return true=OK, false=KO.
+ */
+static bool read_num(const char *str, size_t n, int *value)
+{
+  *value = 0;
+  for(size_t i=0; i<n; i++) {
+    if (str[i] < '0' || str[i] > '9') return(false);
+    *value = 10*(*value) + (str[i] - '0');
+  }
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Checks seconds and fraction (eg. '09' or '09.123').
+ * @param[in] str Seconds.
+ * @param[in] len Seconds length (including fraction).
+ * @return true=valid, false=otherwise.
+ */
+static bool check_seconds(const char *str, size_t len)
+{
+  int sec = 0;
+  if (len < 2 || !read_num(str, 2, &sec) || sec > 60) {
+    return(false);
+  }
+  if (len == 2) {
+    return(true);
+  }
+  if (len == 3 || (str[2] != '.' && str[2] != ',')) {
+    return(false);
+  }
+  for(size_t i=3; i<len; i++) {
+    if (str[i] < '0' || str[i] > '9') return(false);
+  }
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Returns the month number from its abbreviation.
+ * @param[in] str Month abbreviation (eg. 'Jan').
+ * @return Month (1-12), 0 if invalid.
+ */
+static int read_month(const char *str)
+{
+  for(int i=0; i<12; i++) {
+    if (strncasecmp(str, MONTHS[i], 3) == 0) {
+      return(i+1);
+    }
+  }
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Checks date-time components.
+ * @param[in] dt Date-time.
+ * @return true=valid, false=otherwise.
+ */
+static bool check_datetime(const datetime_t *dt)
+{
+  static const int DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  if (dt->month < 1 || dt->month > 12 || dt->day < 1 || dt->hour > 23 || dt->minute > 59) {
+    return(false);
+  }
+
+  bool leap = (dt->year%4 == 0 && (dt->year%100 != 0 || dt->year%400 == 0));
+  int days = DAYS[dt->month-1] + (dt->month == 2 && leap ? 1 : 0);
+  return(dt->day <= days);
+}
+
+/**************************************************************************//**
+ * @brief Writes 'YYYY-MM-DD HH:MM:' to output.
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] dt Date-time.
+ * @return Number of written chars.
+ */
+static size_t write_datetime(tstamp_t *obj, const datetime_t *dt)
+{
+  int len = snprintf(obj->output, TSTAMP_MAX_LENGTH, "%04d-%02d-%02d %02d:%02d:",
+                     dt->year, dt->month, dt->day, dt->hour, dt->minute);
+  assert(len == 17);
+  return((size_t) len);
+}
+
+/**************************************************************************//**
+ * @brief Writes seconds (and fraction) to output.
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] str Seconds (eg. '09' or '09,123').
+ * @param[in] len Seconds length.
+ */
+static void write_seconds(tstamp_t *obj, const char *str, size_t len)
+{
+  memcpy(obj->output + obj->sec_pos_output, str, len);
+  if (len > 2) {
+    obj->output[obj->sec_pos_output + 2] = '.';
+  }
+}
+
+/**************************************************************************//**
+ * @brief Writes time zone to output.
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] pos Position in output.
+ * @param[in] sign Time zone sign ('+' or '-').
+ * @param[in] hh Time zone hours.
+ * @param[in] mm Time zone minutes.
+ * @return Output length.
+ */
+static size_t write_zone(tstamp_t *obj, size_t pos, char sign, int hh, int mm)
+{
+  int len = snprintf(obj->output + pos, TSTAMP_MAX_LENGTH - pos, "%c%02d:%02d", sign, hh, mm);
+  return(pos + (size_t) len);
+}
+
+/**************************************************************************//**
+ * @brief Parses a Common Log Format timestamp.
+ * @details Format: 10/Oct/2000:13:55:36 -0700
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] str Timestamp.
+ * @param[in] len Timestamp length.
+ * @return true=OK, false=KO.
+ */
+static bool parse_clf(tstamp_t *obj, const char *str, size_t len)
+{
+  datetime_t dt = {0};
+  int sec = 0, zh = 0, zm = 0;
+
+  if (len != 26 || str[2] != '/' || str[6] != '/' || str[11] != ':' || str[14] != ':' ||
+      str[17] != ':' || str[20] != ' ' || (str[21] != '+' && str[21] != '-')) {
+    return(false);
+  }
+
+  dt.month = read_month(str+3);
+  if (!read_num(str, 2, &dt.day) || !read_num(str+7, 4, &dt.year) ||
+      !read_num(str+12, 2, &dt.hour) || !read_num(str+15, 2, &dt.minute) ||
+      !read_num(str+18, 2, &sec) || !read_num(str+22, 2, &zh) || !read_num(str+24, 2, &zm) ||
+      !check_datetime(&dt) || !check_seconds(str+18, 2)) {
+    return(false);
+  }
+
+  obj->sec_pos_input = 18;
+  obj->sec_length = 2;
+  obj->sec_pos_output = write_datetime(obj, &dt);
+  write_seconds(obj, str+18, 2);
+  obj->output_length = write_zone(obj, obj->sec_pos_output + 2, str[21], zh, zm);
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Parses an ISO-8601 timestamp.
+ * @details Format: YYYY-MM-DD[T ]HH:MM:SS[.fff][Z|+HH:MM|+HHMM|+HH]
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] str Timestamp.
+ * @param[in] len Timestamp length.
+ * @return true=OK, false=KO.
+ */
+static bool parse_iso8601(tstamp_t *obj, const char *str, size_t len)
+{
+  datetime_t dt = {0};
+
+  if (len < 19 || str[4] != '-' || str[7] != '-' || (str[10] != 'T' && str[10] != ' ') ||
+      str[13] != ':' || str[16] != ':') {
+    return(false);
+  }
+
+  if (!read_num(str, 4, &dt.year) || !read_num(str+5, 2, &dt.month) || !read_num(str+8, 2, &dt.day) ||
+      !read_num(str+11, 2, &dt.hour) || !read_num(str+14, 2, &dt.minute) || !check_datetime(&dt)) {
+    return(false);
+  }
+
+  // seconds and fraction
+  size_t pos = 19;
+  if (pos < len && (str[pos] == '.' || str[pos] == ',')) {
+    pos++;
+    while(pos < len && str[pos] >= '0' && str[pos] <= '9' && pos < 29) pos++;
+  }
+  if (!check_seconds(str+17, pos-17)) {
+    return(false);
+  }
+
+  obj->sec_pos_input = 17;
+  obj->sec_length = pos - 17;
+  obj->sec_pos_output = write_datetime(obj, &dt);
+  write_seconds(obj, str+17, obj->sec_length);
+  obj->output_length = obj->sec_pos_output + obj->sec_length;
+
+  // time zone
+  if (pos == len) {
+    return(true);
+  }
+  if (str[pos] == 'Z' && pos+1 == len) {
+    obj->output_length = write_zone(obj, obj->output_length, '+', 0, 0);
+    return(true);
+  }
+
+  int zh = 0, zm = 0;
+  char sign = str[pos];
+  size_t zlen = len - pos - 1;
+  const char *zone = str + pos + 1;
+  if ((sign != '+' && sign != '-') || !read_num(zone, 2, &zh) || zh > 23) {
+    return(false);
+  }
+  if (!(zlen == 2 || (zlen == 4 && read_num(zone+2, 2, &zm)) ||
+        (zlen == 5 && zone[2] == ':' && read_num(zone+3, 2, &zm))) || zm > 59) {
+    return(false);
+  }
+
+  obj->output_length = write_zone(obj, obj->output_length, sign, zh, zm);
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Parses a syslog timestamp.
+ * @details Format: 'Oct 10 13:55:36' or 'Oct  1 13:55:36'.
+ *          Year is not included. We use the current year unless the
+ *          resulting date is more than one month ahead (eg. december
+ *          entries read in january belong to the previous year).
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] str Timestamp.
+ * @param[in] len Timestamp length.
+ * @param[in] now Current time (0=system time).
+ * @return true=OK, false=KO.
+ */
+static bool parse_syslog(tstamp_t *obj, const char *str, size_t len, time_t now)
+{
+  datetime_t dt = {0};
+  size_t pos = 4;
+
+  if (len < 14 || str[3] != ' ') {
+    return(false);
+  }
+
+  dt.month = read_month(str);
+
+  // day (1 or 2 digits, optionally space-padded)
+  if (str[pos] == ' ') pos++;
+  if (pos+1 < len && str[pos+1] != ' ') {
+    if (!read_num(str+pos, 2, &dt.day)) return(false);
+    pos += 2;
+  }
+  else {
+    if (!read_num(str+pos, 1, &dt.day)) return(false);
+    pos += 1;
+  }
+
+  if (len != pos + 9 || str[pos] != ' ' || str[pos+3] != ':' || str[pos+6] != ':' ||
+      !read_num(str+pos+1, 2, &dt.hour) || !read_num(str+pos+4, 2, &dt.minute) ||
+      !check_seconds(str+pos+7, 2)) {
+    return(false);
+  }
+
+  // year inference
+  if (now == 0) {
+    now = time(NULL);
+  }
+  struct tm tm_now;
+  localtime_r(&now, &tm_now);
+  dt.year = tm_now.tm_year + 1900;
+  if (dt.month > tm_now.tm_mon + 2) {
+    dt.year--;
+  }
+  if (!check_datetime(&dt)) {
+    return(false);
+  }
+
+  obj->sec_pos_input = pos + 7;
+  obj->sec_length = 2;
+  obj->sec_pos_output = write_datetime(obj, &dt);
+  write_seconds(obj, str+pos+7, 2);
+  obj->output_length = obj->sec_pos_output + 2;
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Parses an epoch timestamp.
+ * @details Formats: seconds with optional fraction, or milliseconds.
+ *          Output is UTC. Output prefix is reused within the same minute.
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] str Timestamp.
+ * @param[in] len Timestamp length.
+ * @return true=OK, false=KO.
+ */
+static bool parse_epoch(tstamp_t *obj, const char *str, size_t len)
+{
+  long long secs = 0;
+  const char *frac = NULL;
+  size_t frac_len = 0;
+  char millis[3];
+  size_t pos = 0;
+
+  while(pos < len && str[pos] >= '0' && str[pos] <= '9' && pos < 16) {
+    secs = 10*secs + (str[pos] - '0');
+    pos++;
+  }
+  if (pos == 0) {
+    return(false);
+  }
+
+  if (obj->layout == TSTAMP_EPOCH_MS) {
+    if (pos != len) return(false);
+    int ms = (int)(secs % 1000);
+    secs /= 1000;
+    millis[0] = '0' + ms/100;
+    millis[1] = '0' + (ms/10)%10;
+    millis[2] = '0' + ms%10;
+    frac = millis;
+    frac_len = 3;
+  }
+  else if (pos < len) {
+    if (str[pos] != '.' || len - pos - 1 == 0 || len - pos - 1 > 9) return(false);
+    frac = str + pos + 1;
+    frac_len = len - pos - 1;
+    for(size_t i=0; i<frac_len; i++) {
+      if (frac[i] < '0' || frac[i] > '9') return(false);
+    }
+  }
+
+  // date-time prefix (only when minute changes)
+  long long minute = secs / 60;
+  if (minute != obj->minute) {
+    time_t aux = (time_t) secs;
+    struct tm tm_utc;
+    if (gmtime_r(&aux, &tm_utc) == NULL || tm_utc.tm_year + 1900 > 9999) {
+      return(false);
+    }
+    datetime_t dt = {tm_utc.tm_year + 1900, tm_utc.tm_mon + 1, tm_utc.tm_mday, tm_utc.tm_hour, tm_utc.tm_min};
+    obj->sec_pos_output = write_datetime(obj, &dt);
+    obj->minute = minute;
+  }
+
+  int sec = (int)(secs % 60);
+  char *ptr = obj->output + obj->sec_pos_output;
+  *ptr++ = '0' + sec/10;
+  *ptr++ = '0' + sec%10;
+  if (frac != NULL) {
+    *ptr++ = '.';
+    memcpy(ptr, frac, frac_len);
+    ptr += frac_len;
+  }
+  obj->output_length = write_zone(obj, ptr - obj->output, '+', 0, 0);
+  return(true);
+}
+
+/**************************************************************************//**
+ * @brief Parses a timestamp.
+ * @details When the timestamp differs from the previous one only in the
+ *          seconds, the previous output is patched (no full parsing).
+ * @param[in,out] obj Timestamp parser.
+ * @param[in] str Timestamp (not '\0' ended).
+ * @param[in] len Timestamp length.
+ * @param[in] now Current time used to infer the year (0=system time).
+ * @param[out] value Canonical timestamp (valid until next call).
+ * @return 0=OK, otherwise=invalid timestamp.
+ */
+int tstamp_parse(tstamp_t *obj, const char *str, size_t len, time_t now, value_t *value)
+{
+  if (obj == NULL || str == NULL || value == NULL) {
+    assert(false);
+    return(1);
+  }
+
+  bool done = false;
+
+  if (len == 0 || len >= TSTAMP_MAX_LENGTH) {
+    return(1);
+  }
+
+  if (obj->layout == TSTAMP_EPOCH || obj->layout == TSTAMP_EPOCH_MS) {
+    if (!parse_epoch(obj, str, len)) {
+      return(1);
+    }
+    value->ptr = obj->output;
+    value->len = obj->output_length;
+    return(0);
+  }
+
+  // only seconds changed
+  size_t sec_end = obj->sec_pos_input + obj->sec_length;
+  if (obj->input_length == len &&
+      memcmp(str, obj->input, obj->sec_pos_input) == 0 &&
+      memcmp(str + sec_end, obj->input + sec_end, len - sec_end) == 0 &&
+      check_seconds(str + obj->sec_pos_input, obj->sec_length)) {
+    memcpy(obj->input + obj->sec_pos_input, str + obj->sec_pos_input, obj->sec_length);
+    write_seconds(obj, str + obj->sec_pos_input, obj->sec_length);
+    value->ptr = obj->output;
+    value->len = obj->output_length;
+    return(0);
+  }
+
+  switch(obj->layout) {
+    case TSTAMP_CLF:
+      done = parse_clf(obj, str, len);
+      break;
+    case TSTAMP_ISO8601:
+      done = parse_iso8601(obj, str, len);
+      break;
+    case TSTAMP_SYSLOG:
+      done = parse_syslog(obj, str, len, now);
+      break;
+    default:
+      assert(false);
+      break;
+  }
+
+  if (!done) {
+    obj->input_length = 0;
+    return(1);
+  }
+
+  memcpy(obj->input, str, len);
+  obj->input_length = len;
+  value->ptr = obj->output;
+  value->len = obj->output_length;
+  return(0);
+}
@@ -0,0 +1,93 @@
+
+//===========================================================================
+//
+// log2pg - File forwarder to Postgresql database
+// Copyright (C) 2018 Gerard Torrent
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+//
+//===========================================================================
+
+#ifndef TSTAMP_H
+#define TSTAMP_H
+
+#include <stddef.h>
+#include <time.h>
+#include "format.h"
+
+#define TSTAMP_MAX_LENGTH 48
+
+/**************************************************************************//**
+ * @brief Timestamp layouts.
+ */
+typedef enum {
+  TSTAMP_CLF = 0,      // 10/Oct/2000:13:55:36 -0700
+  TSTAMP_ISO8601,      // 2000-10-10T13:55:36.123-07:00
+  TSTAMP_SYSLOG,       // Oct 10 13:55:36 (year inferred)
+  TSTAMP_EPOCH,        // 971211336[.123]
+  TSTAMP_EPOCH_MS,     // 971211336123
+  TSTAMP_NONE
+} tstamp_layout_e;
+
+/**************************************************************************//**
+ * @brief Timestamp parameter declared in a format.
+ * @details First member is 'char *' to be searchable.
+ */
+typedef struct tstamp_param_t
+{
+  //! Parameter name.
+  char *name;
+  //! Timestamp layout.
+  tstamp_layout_e layout;
+} tstamp_param_t;
+
+/**************************************************************************//**
+ * @brief Timestamp parser with last-value memoization.
+ * @details Consecutive timestamps usually differ only in seconds. In this
+ *          case the previous output is patched instead of re-parsed.
+ *          Output is 'YYYY-MM-DD HH:MM:SS[.fff][+HH:MM]'.
+ */
+typedef struct tstamp_t
+{
+  //! Timestamp layout.
+  tstamp_layout_e layout;
+  //! Last parsed input.
+  char input[TSTAMP_MAX_LENGTH];
+  //! Last parsed input length (0=none).
+  size_t input_length;
+  //! Last output.
+  char output[TSTAMP_MAX_LENGTH];
+  //! Last output length.
+  size_t output_length;
+  //! Position of seconds (and fraction) in input.
+  size_t sec_pos_input;
+  //! Position of seconds (and fraction) in output.
+  size_t sec_pos_output;
+  //! Length of seconds (and fraction).
+  size_t sec_length;
+  //! Last epoch minute (epoch layouts).
+  long long minute;
+} tstamp_t;
+
+/**************************************************************************
+ * Function declarations.
+ */
+extern tstamp_layout_e tstamp_layout_find(const char *name);
+extern void tstamp_init(tstamp_t *obj, tstamp_layout_e layout);
+extern int tstamp_parse(tstamp_t *obj, const char *str, size_t len, time_t now, value_t *value);
+extern void tstamp_param_free(void *obj);
+
+#endif
+
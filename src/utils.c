@@ -303,3 +303,41 @@ const char* filename_ext(const char *filename)
     return ptr + 1;
   }
 }
+
+/**************************************************************************//**
+ * @brief Smooth weighted round-robin selection.
+ * @details Each active entry earns its weight and the richest one is
+ *          selected and pays the total. Entries are interleaved (no
+ *          bursts) and each one is selected in proportion to its weight.
+ *          Credits of inactive entries are reset (only backlogged entries
+ *          share the turns).
+ * @see nginx ngx_http_upstream_get_peer()
+ * @param[in,out] credits Current credits (num entries, initially 0).
+ * @param[in] weights Entries weight (num entries, greater than 0).
+ * @param[in] active Bitmask of active entries (bit i = entry i).
+ * @param[in] num Number of entries (up to 32).
+ * @return Index of the selected entry, -1 if there are no active entries.
+ */
+int swrr_select(int *credits, const int *weights, unsigned int active, size_t num)
+{
+  int ret = -1;
+  int total = 0;
+
+  for(size_t i=0; i<num; i++) {
+    if ((active & (1U << i)) == 0) {
+      credits[i] = 0;
+      continue;
+    }
+    credits[i] += weights[i];
+    total += weights[i];
+    if (ret < 0 || credits[i] > credits[ret]) {
+      ret = (int) i;
+    }
+  }
+
+  if (ret >= 0) {
+    credits[ret] -= total;
+  }
+
+  return(ret);
+}
@@ -37,6 +37,7 @@ extern size_t elapsed_millis(const struct timeval *tv);
 extern void* memdup(const void* ptr, size_t size);
 extern char* replace_str(const char *str, const char *from, const char *to);
 extern const char *filename_ext(const char *filename);
+extern int swrr_select(int *credits, const int *weights, unsigned int active, size_t num);
 
 #endif
 
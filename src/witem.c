@@ -20,17 +20,110 @@
 //
 //===========================================================================
 
+// memfd_create()
+#define _GNU_SOURCE
 #include "log2pg.h"
 #include <stdlib.h>
+#include <unistd.h>
 #include <string.h>
 #include <libgen.h>
 #include <errno.h>
 #include <syslog.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
 #include <assert.h>
 #include "entities.h"
 #include "witem.h"
 #include "stringbuf.h"
 #include "utils.h"
+#include "scan.h"
+#include "batch.h"
+
+/**************************************************************************
+ * Scheduling state flags (witem_t::state).
+ */
+// A processor worker owns the item.
+#define WITEM_BUSY 0x1U
+// Item was notified while busy (owner must process it again).
+#define WITEM_AGAIN 0x2U
+// Item was removed by the monitor (owner must free it).
+#define WITEM_CLOSE 0x4U
+// Item is pending in the monitor -> processor queue.
+#define WITEM_QUEUED 0x8U
+
+// Memory used by witem buffers (heap or ring, mapped files excluded).
+static atomic_size_t buffers_memory = 0;
+
+/**************************************************************************//**
+ * @brief Decompressors of rotated files (by extension).
+ */
+static const struct {
+  const char *ext;
+  const char *command;
+} DECOMPRESSORS[] = {
+  { "gz", "gzip" },
+  { "zst", "zstd" },
+  { "xz", "xz" },
+  { "bz2", "bzip2" },
+  { NULL, NULL }
+};
+
+/**************************************************************************//**
+ * @brief Allocates a double-mapped ring buffer.
+ * @details The same physical pages are mapped twice consecutively, so any
+ *          region of up to length bytes starting in [ring, ring+length) is
+ *          contiguous.
+ * @param[in] length Ring length (multiple of page size).
+ * @return The ring buffer (length*2 bytes of address space), NULL if error.
+ */
+static char* dmap_alloc(size_t length)
+{
+  int fd = memfd_create(PACKAGE_NAME, MFD_CLOEXEC);
+  if (fd < 0) {
+    return(NULL);
+  }
+
+  char *ret = NULL;
+
+  if (ftruncate(fd, length) == 0) {
+    void *addr = mmap(NULL, 2*length, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (addr != MAP_FAILED) {
+      ret = (char *) addr;
+      if (mmap(ret, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED ||
+          mmap(ret + length, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(addr, 2*length);
+        ret = NULL;
+      }
+    }
+  }
+
+  close(fd);
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Releases the buffer of a witem (heap, ring or mapped file).
+ * @param[in,out] item Watched item.
+ */
+static void witem_release_buffer(witem_t *item)
+{
+  if (item->map != NULL) {
+    munmap(item->map, item->map_length);
+  }
+  else if (item->ring != NULL) {
+    munmap(item->ring, 2*item->buffer_length);
+    atomic_fetch_sub(&buffers_memory, item->buffer_length);
+  }
+  else if (item->buffer != NULL) {
+    free(item->buffer);
+    atomic_fetch_sub(&buffers_memory, item->buffer_length);
+  }
+
+  item->ring = NULL;
+}
 
 /**************************************************************************//**
  * @brief Frees memory space pointed by ptr.
@@ -41,6 +134,21 @@ void witem_free(void *ptr)
   if (ptr == NULL) return;
   witem_t *obj = (witem_t *) ptr;
 
+  // forked item (shared members are owned by origin)
+  if (obj->origin != NULL) {
+    pcre2_match_data_free(obj->md_ends);
+    pcre2_match_data_free(obj->md_values);
+    free(obj->values);
+    free(obj->scratch);
+    free(obj->tstamps);
+    batch_free(obj->batch);
+    if (obj->discard != NULL) {
+      fclose(obj->discard);
+    }
+    free(ptr);
+    return;
+  }
+
   syslog(LOG_DEBUG, "removed witem [address=%p, filename=%s, type=%s]",
          ptr, obj->filename, (obj->type==WITEM_DIR?"dir":"file"));
 
@@ -48,11 +156,22 @@ void witem_free(void *ptr)
   if (obj->file != NULL) {
     fclose(obj->file);
   }
-  free(obj->buffer);
+  if (obj->pid > 0) {
+    // decompressor ends (SIGPIPE) if stream was not read up to EOF
+    waitpid(obj->pid, NULL, 0);
+  }
+  vector_reset(&(obj->catchup), free);
+  witem_release_buffer(obj);
   pcre2_match_data_free(obj->md_starts);
   pcre2_match_data_free(obj->md_ends);
   pcre2_match_data_free(obj->md_values);
   free(obj->param_pos);
+  free(obj->paths);
+  free(obj->values);
+  free(obj->scratch);
+  free(obj->tstamps);
+  free(obj->meta);
+  batch_free(obj->batch);
   if (obj->discard != NULL) {
     fclose(obj->discard);
   }
@@ -60,6 +179,145 @@ void witem_free(void *ptr)
   free(ptr);
 }
 
+/**************************************************************************//**
+ * @brief Opens a stream to the decompressed content of a file.
+ * @details Decompression is done by a child process (eg. 'gzip -dc file')
+ *          writing to a pipe, so it runs concurrently with the parsing.
+ * @param[in] filename Compressed file name.
+ * @param[in] command Decompressor command.
+ * @param[out] pid Decompressor process.
+ * @return Stream to read from, NULL if error.
+ */
+static FILE* witem_popen(const char *filename, const char *command, pid_t *pid)
+{
+  int fds[2];
+  sigset_t mask;
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  char *argv[] = {(char *) command, "-dc", (char *) filename, NULL};
+
+  if (pipe2(fds, O_CLOEXEC) != 0) {
+    return(NULL);
+  }
+
+  sigemptyset(&mask);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+  int rc = posix_spawnp(pid, command, &actions, &attr, argv, environ);
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  close(fds[1]);
+
+  if (rc != 0) {
+    close(fds[0]);
+    errno = rc;
+    return(NULL);
+  }
+
+  return(fdopen(fds[0], "r"));
+}
+
+/**************************************************************************//**
+ * @brief Counts the lines of a file up to a given offset.
+ * @param[in] file File stream.
+ * @param[in] end File offset.
+ * @return Number of '\n' found.
+ */
+static size_t count_lines(FILE *file, off_t end)
+{
+  const size_t block_size = 65536;
+  char *block = malloc(block_size);
+  size_t ret = 0;
+  off_t offset = 0;
+
+  if (block == NULL) {
+    return(0);
+  }
+
+  while(offset < end) {
+    size_t len = (end - offset < (off_t) block_size ? (size_t)(end - offset) : block_size);
+    ssize_t rc = pread(fileno(file), block, len, offset);
+    if (rc <= 0) {
+      break;
+    }
+    ret += scan_count(block, block + rc, '\n');
+    offset += rc;
+  }
+
+  free(block);
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Initialize the reserved params and the file position.
+ * @details Line numbers are only tracked when $_LINE is used, because it
+ *          requires counting the lines of the existing content.
+ * @param[in,out] item Watched item.
+ * @param[in] table File table.
+ * @return 0=OK, otherwise=error.
+ */
+static int witem_init_meta(witem_t *item, const table_t *table)
+{
+  item->offset = (item->pid > 0 ? 0 : ftello(item->file));
+  atomic_store(&(item->read_offset), item->offset);
+  item->line = 1;
+  item->line_pos = 0;
+  item->lines = false;
+
+  for(size_t j=0; j<table->parameters.size; j++) {
+    meta_e meta = table_meta_find(table->parameters.data[j]);
+    if (meta == META_NONE) {
+      continue;
+    }
+    if (item->meta == NULL) {
+      item->meta = calloc(table->parameters.size, sizeof(meta_e));
+      if (item->meta == NULL) {
+        return(1);
+      }
+    }
+    item->meta[j] = meta;
+    item->lines |= (meta == META_LINE);
+  }
+
+  if (item->lines && item->offset > 0) {
+    item->line += count_lines(item->file, item->offset);
+  }
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Initialize the timestamp parsers of table params.
+ * @param[in,out] item Watched item.
+ * @param[in] format File format.
+ * @param[in] table File table.
+ * @return 0=OK, otherwise=error.
+ */
+static int witem_init_tstamps(witem_t *item, const format_t *format, const table_t *table)
+{
+  if (format->timestamps.size == 0 || table->parameters.size == 0) {
+    return(0);
+  }
+
+  item->tstamps = calloc(table->parameters.size, sizeof(tstamp_t));
+  if (item->tstamps == NULL) {
+    return(1);
+  }
+
+  for(size_t j=0; j<table->parameters.size; j++) {
+    int pos = vector_find(&(format->timestamps), table->parameters.data[j]);
+    tstamp_param_t *param = (pos < 0 ? NULL : format->timestamps.data[pos]);
+    tstamp_init(item->tstamps + j, (param == NULL ? TSTAMP_NONE : param->layout));
+  }
+
+  return(0);
+}
+
 /**************************************************************************//**
  * @brief Initialize buffer and data linked to regex match.
  * @param[in,out] item Watched item to initialize.
@@ -77,24 +335,34 @@ static int witem_init(witem_t *item, bool seek0)
     return(0);
   }
 
-  // open file
-  item->file = fopen(item->filename, "r");
+  // open file (compressed files are read from start)
+  const char *command = witem_decompressor(item->filename);
+  if (command != NULL) {
+    item->file = witem_popen(item->filename, command, &(item->pid));
+  }
+  else {
+    item->file = fopen(item->filename, "r");
+  }
   if (item->file == NULL) {
     syslog(LOG_WARNING, "error opening file '%s' - %s", item->filename, strerror(errno));
     return(1);
   }
-  if (!seek0) {
+  if (!seek0 && command == NULL) {
     fseek(item->file, 0, SEEK_END);
   }
 
+  // identifies the opened file (name can be reused after a rotation)
+  struct stat st;
+  if (command == NULL && fstat(fileno(item->file), &st) == 0) {
+    item->dev = st.st_dev;
+    item->ino = st.st_ino;
+  }
+
   format_t *format = ((file_t *) item->ptr)->format;
   assert(format != NULL);
 
-  item->buffer_length = format->maxlength;
   item->buffer_pos = 0;
-  item->buffer = calloc(item->buffer_length, sizeof(char));
-  if (item->buffer == NULL) {
-    syslog(LOG_ERR, "%s", strerror(errno));
+  if (witem_resize_buffer(item, format->maxlength + format->blocksize) != 0) {
     return(1);
   }
   if (format->re_starts != NULL) {
@@ -113,13 +381,57 @@ static int witem_init(witem_t *item, bool seek0)
   table_t *table = ((file_t *) item->ptr)->table;
   assert(table != NULL);
 
+  if (witem_init_tstamps(item, format, table) != 0 || witem_init_meta(item, table) != 0) {
+    return(1);
+  }
+
   item->num_params = 0;
+  if (table->parameters.size > 0) {
+    item->values = calloc(table->parameters.size, sizeof(value_t));
+    if (item->values == NULL) {
+      return(1);
+    }
+  }
+
+  // structured formats reference keys by name
+  if (format->type == FORMAT_TYPE_JSON || format->type == FORMAT_TYPE_LOGFMT) {
+    item->scratch = calloc(item->buffer_length, sizeof(char));
+    if (item->scratch == NULL) {
+      return(1);
+    }
+    if (table->parameters.size > 0) {
+      item->paths = calloc(table->parameters.size, sizeof(keypath_t));
+      if (item->paths == NULL) {
+        return(1);
+      }
+    }
+    for(size_t j=0; j<table->parameters.size; j++) {
+      // reserved params are resolved by processor (empty path)
+      if (item->meta != NULL && item->meta[j] != META_NONE) {
+        item->num_params++;
+        continue;
+      }
+      if (keypath_init(item->paths + j, table->parameters.data[j]) != 0) {
+        syslog(LOG_ERR, "witem - invalid table param '%s'", (char *) table->parameters.data[j]);
+        return(1);
+      }
+      item->num_params++;
+    }
+    return(0);
+  }
+
   if (table->parameters.size > 0) {
     item->param_pos = calloc(table->parameters.size, sizeof(size_t));
     if (item->param_pos == NULL) {
       return(1);
     }
     for(size_t j=0; j<table->parameters.size; j++) {
+      // reserved params are resolved by processor
+      if (item->meta != NULL && item->meta[j] != META_NONE) {
+        item->param_pos[item->num_params] = 0;
+        item->num_params++;
+        continue;
+      }
       bool found = false;
       for(size_t i=0; i<format->parameters.size; i++) {
         if (strcmp(format->parameters.data[i], table->parameters.data[j]) == 0) {
@@ -162,11 +474,17 @@ witem_t* witem_alloc(const char *filename, witem_type_e type, void *ptr, bool se
   }
 
   ret->wd = 0;
+  ret->debounce_millis = 0;
+  ret->debounce_size = 0;
+  ret->rotate_millis = 0;
   ret->filename = strdup(filename);
   ret->type = type;
   ret->ptr = ptr;
 
   ret->file = NULL;
+  ret->pid = 0;
+  ret->dev = 0;
+  ret->ino = 0;
   ret->buffer = NULL;
   ret->buffer_length = 0;
   ret->buffer_pos = 0;
@@ -175,7 +493,30 @@ witem_t* witem_alloc(const char *filename, witem_type_e type, void *ptr, bool se
   ret->md_values = NULL;
   ret->num_params = 0;
   ret->param_pos = NULL;
+  ret->paths = NULL;
+  ret->values = NULL;
+  ret->scratch = NULL;
+  ret->tstamps = NULL;
+  ret->meta = NULL;
+  ret->offset = 0;
+  ret->backfill_end = 0;
+  ret->backfill_tv = (struct timeval){0};
+  ret->backfill_report = 0;
+  ret->backfill_dropped = 0;
+  ret->map = NULL;
+  ret->map_length = 0;
+  ret->map_offset = 0;
+  ret->ring = NULL;
+  ret->lines = false;
+  ret->line = 1;
+  ret->line_pos = 0;
   ret->discard = NULL;
+  atomic_init(&(ret->state), 0U);
+  ret->deficit = 0;
+  ret->origin = NULL;
+  ret->batch = NULL;
+  ret->catchup = (vector_t){0};
+  ret->live = NULL;
 
   int rc = witem_init(ret, seek0);
   if (rc != 0 || ret->filename == NULL) {
@@ -197,28 +538,213 @@ witem_t* witem_alloc(const char *filename, witem_type_e type, void *ptr, bool se
 }
 
 /**************************************************************************//**
- * @brief Returns the discard filename replacing variables.
- * @param[in] item Watched item.
- * @return The discard filename.
+ * @brief Creates a fork of a witem restricted to a region of its buffer.
+ * @details The fork shares the buffer and the read-only members (filename,
+ *          params, paths, meta) of item, and owns the members written while
+ *          parsing (match data, values, scratch, timestamp parsers). This
+ *          allows parsing several regions of the same buffer in parallel.
+ *          Discarded content of a fork is kept in a temporary file.
+ *          Fork must be freed (using witem_free) before item.
+ * @param[in] item Watched item (only-ends format).
+ * @param[in] pos Region begin (position in buffer).
+ * @param[in] len Region length.
+ * @param[in] line Line number at pos.
+ * @return Forked item or NULL if error.
  */
-char* witem_discard_filename(const witem_t *item)
+witem_t* witem_fork(witem_t *item, size_t pos, size_t len, size_t line)
 {
-  if (item == NULL || item->ptr == NULL || item->type != WITEM_FILE) {
+  if (item == NULL || item->origin != NULL || item->md_starts != NULL ||
+      item->md_ends == NULL || pos + len > item->buffer_pos) {
     assert(false);
     return(NULL);
   }
 
-  file_t *file = (file_t *) item->ptr;
-  char *discard = file->discard;
-  char *filename = item->filename;
+  format_t *format = ((file_t *) item->ptr)->format;
 
-  if (discard == NULL || filename == NULL) {
-    assert(false);
+  witem_t *ret = (witem_t *) malloc(sizeof(witem_t));
+  if (ret == NULL) {
+    syslog(LOG_ERR, "%s", strerror(errno));
     return(NULL);
   }
 
+  memcpy(ret, item, sizeof(witem_t));
+  atomic_init(&(ret->state), 0U);
+  ret->deficit = 0;
+  ret->origin = item;
+  ret->file = NULL;
+  ret->buffer = item->buffer + pos;
+  ret->buffer_length = len + 1;
+  ret->buffer_pos = len;
+  ret->offset = item->offset + pos;
+  ret->line = line;
+  ret->line_pos = 0;
+  ret->md_ends = NULL;
+  ret->md_values = NULL;
+  ret->values = NULL;
+  ret->scratch = NULL;
+  ret->tstamps = NULL;
+  ret->discard = NULL;
+  ret->batch = NULL;
+
+  ret->md_ends = pcre2_match_data_create_from_pattern(format->re_ends, NULL);
+  if (ret->md_ends == NULL) {
+    goto witem_fork_err;
+  }
+  if (item->md_values != NULL) {
+    ret->md_values = pcre2_match_data_create_from_pattern(format->re_values, NULL);
+    if (ret->md_values == NULL) goto witem_fork_err;
+  }
+  if (item->values != NULL) {
+    ret->values = calloc(item->num_params, sizeof(value_t));
+    if (ret->values == NULL) goto witem_fork_err;
+  }
+  if (item->scratch != NULL) {
+    ret->scratch = calloc(format->maxlength, sizeof(char));
+    if (ret->scratch == NULL) goto witem_fork_err;
+  }
+  if (item->tstamps != NULL) {
+    ret->tstamps = malloc(item->num_params * sizeof(tstamp_t));
+    if (ret->tstamps == NULL) goto witem_fork_err;
+    memcpy(ret->tstamps, item->tstamps, item->num_params * sizeof(tstamp_t));
+  }
+
+  return(ret);
+
+witem_fork_err:
+  syslog(LOG_ERR, "witem - error forking '%s'", item->filename);
+  witem_free(ret);
+  return(NULL);
+}
+
+/**************************************************************************//**
+ * @brief Sets the buffer length preserving the unprocessed content.
+ * @details Buffer is a ring (see dmap_alloc), or a heap buffer if the ring
+ *          can't be created. Length is rounded up to page size. Used to
+ *          allocate, enlarge and shrink the buffer (see witem_buffers_memory).
+ * @param[in,out] item Watched item (not mapped).
+ * @param[in] length Minimum buffer length.
+ * @return 0=OK, otherwise=error (buffer unchanged).
+ */
+int witem_resize_buffer(witem_t *item, size_t length)
+{
+  if (item == NULL || item->map != NULL || length <= item->buffer_pos) {
+    assert(false);
+    return(1);
+  }
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  length = (length + page - 1) / page * page;
+
+  if (item->buffer != NULL && length == item->buffer_length) {
+    return(0);
+  }
+
+  char *ring = dmap_alloc(length);
+  char *buffer = (ring != NULL ? ring : (char *) malloc(length));
+  if (buffer == NULL) {
+    syslog(LOG_ERR, "%s", strerror(errno));
+    return(1);
+  }
+
+  if (item->buffer != NULL) {
+    memcpy(buffer, item->buffer, item->buffer_pos);
+  }
+  buffer[item->buffer_pos] = '\0';
+
+  witem_release_buffer(item);
+  item->buffer = buffer;
+  item->buffer_length = length;
+  item->ring = ring;
+  atomic_fetch_add(&buffers_memory, length);
+
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Returns the memory used by the buffers of all witems.
+ * @return Size in bytes.
+ */
+size_t witem_buffers_memory(void)
+{
+  return(atomic_load(&buffers_memory));
+}
+
+/**************************************************************************//**
+ * @brief Maps the unprocessed content of file into memory.
+ * @details Buffer points to the mapped content starting at offset (no
+ *          copies, no '\0' ended). The heap buffer (if any) is released
+ *          on first call. The current mapping is reused if it covers the
+ *          requested region.
+ * @param[in,out] item Watched item.
+ * @param[in] size Current file size.
+ * @param[in] window Maximum mapped length.
+ * @return 0=OK, otherwise=error.
+ */
+int witem_map(witem_t *item, off_t size, size_t window)
+{
+  if (item == NULL || item->file == NULL || size < item->offset || window == 0) {
+    assert(false);
+    return(1);
+  }
+
+  off_t page = sysconf(_SC_PAGESIZE);
+  off_t begin = item->offset - item->offset % page;
+  off_t end = MIN(size, begin + (off_t) window);
+
+  if (item->map == NULL || item->map_offset != begin ||
+      item->map_offset + (off_t) item->map_length < end) {
+    witem_unmap(item);
+    if (end == begin) {
+      return(0);
+    }
+    void *ptr = mmap(NULL, end - begin, PROT_READ, MAP_SHARED, fileno(item->file), begin);
+    if (ptr == MAP_FAILED) {
+      syslog(LOG_WARNING, "error mapping file '%s' - %s", item->filename, strerror(errno));
+      return(1);
+    }
+    madvise(ptr, end - begin, MADV_SEQUENTIAL);
+    item->map = (char *) ptr;
+    item->map_length = end - begin;
+    item->map_offset = begin;
+  }
+
+  item->buffer = item->map + (item->offset - begin);
+  item->buffer_pos = end - item->offset;
+  item->buffer_length = item->buffer_pos + 1;
+  return(0);
+}
+
+/**************************************************************************//**
+ * @brief Unmaps the file (unprocessed content remains in file).
+ * @param[in,out] item Watched item.
+ */
+void witem_unmap(witem_t *item)
+{
+  if (item == NULL) {
+    assert(false);
+    return;
+  }
+
+  witem_release_buffer(item);
+
+  item->map = NULL;
+  item->map_length = 0;
+  item->map_offset = 0;
+  item->buffer = NULL;
+  item->buffer_pos = 0;
+  item->buffer_length = 0;
+}
+
+/**************************************************************************//**
+ * @brief Replaces the filename variables of a string.
+ * @param[in] str String with variables ($REALPATH, $FILENAME, etc).
+ * @param[in] filename File name.
+ * @return The replaced string (to be freed by caller).
+ */
+static char* witem_replace_vars(const char *str, const char *filename)
+{
   stringbuf_t ret = {0};
-  stringbuf_append(&ret, discard);
+  stringbuf_append(&ret, str);
 
   if (strstr(ret.data, "$REALPATH") != NULL) {
     char *value = realpath(filename, NULL);
@@ -257,3 +783,223 @@ char* witem_discard_filename(const witem_t *item)
 
   return(ret.data);
 }
+
+/**************************************************************************//**
+ * @brief Returns the discard filename replacing variables.
+ * @param[in] item Watched item.
+ * @return The discard filename.
+ */
+char* witem_discard_filename(const witem_t *item)
+{
+  if (item == NULL || item->ptr == NULL || item->type != WITEM_FILE) {
+    assert(false);
+    return(NULL);
+  }
+
+  file_t *file = (file_t *) item->ptr;
+  char *discard = file->discard;
+  char *filename = item->filename;
+
+  if (discard == NULL || filename == NULL) {
+    assert(false);
+    return(NULL);
+  }
+
+  return(witem_replace_vars(discard, filename));
+}
+
+/**************************************************************************//**
+ * @brief Returns the rotated files pattern replacing variables.
+ * @details Relative patterns are relative to the file directory.
+ * @param[in] item Watched item.
+ * @return The rotated files pattern, NULL if not set.
+ */
+char* witem_rotated_pattern(const witem_t *item)
+{
+  if (item == NULL || item->ptr == NULL || item->type != WITEM_FILE) {
+    assert(false);
+    return(NULL);
+  }
+
+  const char *rotated = ((file_t *) item->ptr)->rotated;
+  if (rotated == NULL) {
+    return(NULL);
+  }
+
+  char *pattern = (rotated[0] == '/' ? strdup(rotated) : concat(2, "$DIRNAME/", rotated));
+  char *ret = witem_replace_vars(pattern, item->filename);
+  free(pattern);
+  return(ret);
+}
+
+/**************************************************************************//**
+ * @brief Returns the decompressor of a file.
+ * @param[in] filename File name.
+ * @return Decompressor command, NULL if file is not compressed.
+ */
+const char* witem_decompressor(const char *filename)
+{
+  const char *ext = filename_ext(filename);
+
+  for(int i=0; ext != NULL && DECOMPRESSORS[i].ext != NULL; i++) {
+    if (strcmp(DECOMPRESSORS[i].ext, ext) == 0) {
+      return(DECOMPRESSORS[i].command);
+    }
+  }
+
+  return(NULL);
+}
+
+/**************************************************************************//**
+ * @brief Returns the priority of an item (processor queue lane).
+ * @param[in] item Watched item.
+ * @return File priority (PRIORITY_NORMAL if it is not a file).
+ */
+priority_e witem_priority(const witem_t *item)
+{
+  if (item == NULL || item->type != WITEM_FILE || item->ptr == NULL) {
+    return(PRIORITY_NORMAL);
+  }
+
+  return(((const file_t *) item->ptr)->priority);
+}
+
+/**************************************************************************//**
+ * @brief Checks if an item is reading a given file.
+ * @param[in] item Watched item.
+ * @param[in] st File status (see stat).
+ * @return true=same device and inode, false=otherwise.
+ */
+bool witem_same_file(const witem_t *item, const struct stat *st)
+{
+  assert(item != NULL);
+  assert(st != NULL);
+
+  return(item->file != NULL && item->dev == st->st_dev && item->ino == st->st_ino);
+}
+
+/**************************************************************************//**
+ * @brief Notifies that an item has changed (called by the monitor).
+ * @details Replaces the unique push to the processor queue. An item is
+ *          pending in the queue at most once, further notifications only
+ *          update its flags (FILE0 -> FILE1 upgrade is done in place).
+ *          Caution, a closed item can not be accessed by the monitor
+ *          anymore.
+ * @param[in,out] item Watched item.
+ * @param[in] close Item was removed by the monitor (MSG_TYPE_FILE1).
+ * @return true=item must be pushed to the queue, false=already queued.
+ */
+bool witem_notify(witem_t *item, bool close)
+{
+  assert(item != NULL);
+
+  unsigned int flags = WITEM_QUEUED | (close ? WITEM_CLOSE : 0U);
+  unsigned int state = atomic_fetch_or(&(item->state), flags);
+
+  return(!(state & WITEM_QUEUED));
+}
+
+/**************************************************************************//**
+ * @brief Tries to acquire the ownership of an item popped from the queue.
+ * @details Guarantees that an item is processed by at most one worker at a
+ *          time. If the item is owned by another worker, the notification
+ *          is transferred to the owner and the caller must not access the
+ *          item anymore. In both cases the item is no longer queued.
+ * @param[in,out] item Watched item.
+ * @return true=caller owns the item, false=item is owned by another worker.
+ */
+bool witem_claim(witem_t *item)
+{
+  assert(item != NULL);
+
+  unsigned int state = atomic_load(&(item->state));
+
+  while(true) {
+    unsigned int next = (state & ~WITEM_QUEUED) | ((state & WITEM_BUSY) ? WITEM_AGAIN : WITEM_BUSY);
+    if (atomic_compare_exchange_weak(&(item->state), &state, next)) {
+      return(!(state & WITEM_BUSY));
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Gives up the turn of an owned item (called by the owner).
+ * @details The item is flagged as queued, so witem_release() releases the
+ *          ownership and the pending message claims it again. Pending
+ *          notifications are merged into the queued one (the item is
+ *          processed again when its message is popped).
+ * @param[in,out] item Watched item (owned by caller).
+ * @return true=item must be pushed to the queue, false=already queued.
+ */
+bool witem_yield(witem_t *item)
+{
+  assert(item != NULL);
+
+  unsigned int state = atomic_load(&(item->state));
+
+  while(true) {
+    assert(state & WITEM_BUSY);
+    unsigned int next = (state | WITEM_QUEUED) & ~WITEM_AGAIN;
+    if (atomic_compare_exchange_weak(&(item->state), &state, next)) {
+      return(!(state & WITEM_QUEUED));
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Releases the ownership of an item.
+ * @details Called by the owner when the item has been processed. If the
+ *          item was notified meanwhile then ownership is retained. If the
+ *          item was removed by the monitor (and it is not queued) then it
+ *          is freed.
+ * @param[in,out] item Watched item.
+ * @return true=item must be processed again, false=ownership released.
+ */
+bool witem_release(witem_t *item)
+{
+  assert(item != NULL);
+
+  unsigned int state = atomic_load(&(item->state));
+
+  while(true) {
+    assert(state & WITEM_BUSY);
+    if (state & WITEM_AGAIN) {
+      if (atomic_compare_exchange_weak(&(item->state), &state, state & ~WITEM_AGAIN)) {
+        return(true);
+      }
+    }
+    else if (state & WITEM_QUEUED) {
+      // pending message will claim it again
+      if (atomic_compare_exchange_weak(&(item->state), &state, state & ~WITEM_BUSY)) {
+        return(false);
+      }
+    }
+    else if (state & WITEM_CLOSE) {
+      witem_free(item);
+      return(false);
+    }
+    else if (atomic_compare_exchange_weak(&(item->state), &state, 0U)) {
+      return(false);
+    }
+  }
+}
+
+/**************************************************************************//**
+ * @brief Drops a pending notification (used at shutdown).
+ * @details The item is no longer queued. If it was removed by the monitor
+ *          then nobody else references it and it is freed (closing the
+ *          file and its mappings), otherwise the monitor frees it.
+ * @param[in,out] obj Watched item (queued, not owned).
+ */
+void witem_drop(void *obj)
+{
+  if (obj == NULL) return;
+  witem_t *item = (witem_t *) obj;
+
+  unsigned int state = atomic_fetch_and(&(item->state), ~WITEM_QUEUED);
+  assert(!(state & WITEM_BUSY));
+
+  if (state & WITEM_CLOSE) {
+    witem_free(item);
+  }
+}
@@ -26,9 +26,16 @@
 #include "log2pg.h"
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <pcre2.h>
 #include "vector.h"
 #include "entities.h"
+#include "structured.h"
+#include "tstamp.h"
+#include "table.h"
 
 /**************************************************************************//**
  * @brief Types of witems.
@@ -46,6 +53,12 @@ typedef struct witem_t
 {
   //! Inotify watched descriptor.
   int wd;
+  //! Time of the first debounced change (0=none, monitor only).
+  size_t debounce_millis;
+  //! File size at the last notification (monitor only).
+  off_t debounce_size;
+  //! Time when the file was renamed (0=not rotated, monitor only).
+  size_t rotate_millis;
   //! Real filename with absolute path.
   char *filename;
   //! Type of item.
@@ -54,12 +67,44 @@ typedef struct witem_t
   void *ptr;
   //! File stream.
   FILE *file;
-  //! Current line.
+  //! Decompressor process writing to file stream (0=none, see witem_decompressor).
+  pid_t pid;
+  //! Device of the opened file (see witem_same_file).
+  dev_t dev;
+  //! Inode of the opened file (see witem_same_file).
+  ino_t ino;
+  //! Current line (points to ring or map if set).
   char *buffer;
   //! Buffer length.
   size_t buffer_length;
   //! Current position in buffer.
   size_t buffer_pos;
+  //! File offset of buffer begin.
+  off_t offset;
+  //! File offset read at the end of the last turn (see monitor_rescan).
+  atomic_llong read_offset;
+  //! File offset where the content existing at startup ends (0=none, see processor_backfill).
+  off_t backfill_end;
+  //! Backfill starting time (tv_sec=0 if not started).
+  struct timeval backfill_tv;
+  //! Elapsed millis at the last backfill progress report.
+  size_t backfill_report;
+  //! File offset up to which cached pages are released.
+  off_t backfill_dropped;
+  //! Mapped file region (NULL=not mapped).
+  char *map;
+  //! Mapped region length.
+  size_t map_length;
+  //! File offset of mapped region (page aligned).
+  off_t map_offset;
+  //! Ring buffer of buffer_length bytes mapped twice (NULL=heap buffer).
+  char *ring;
+  //! Line numbers are tracked.
+  bool lines;
+  //! Line number at position line_pos of buffer (1-based).
+  size_t line;
+  //! Position in buffer up to which lines are counted.
+  size_t line_pos;
   //! Data to match regex starts.
   pcre2_match_data *md_starts;
   //! Data to match regex ends.
@@ -70,8 +115,36 @@ typedef struct witem_t
   size_t num_params;
   //! Position in regex_values of table params.
   size_t *param_pos;
+  //! Keys referenced by table params (json and logfmt formats).
+  keypath_t *paths;
+  //! Table param values of current chunk.
+  value_t *values;
+  //! Buffer where unescaped values are written.
+  char *scratch;
+  //! Timestamp parsers of table params (NULL if no timestamps).
+  tstamp_t *tstamps;
+  //! Reserved params of table params (NULL if no reserved params).
+  meta_e *meta;
+  //! Value of $_OFFSET.
+  char meta_offset[24];
+  //! Value of $_LINE.
+  char meta_line[24];
+  //! Value of $_INGEST_TS.
+  char meta_ts[40];
   //! Discard file.
   FILE *discard;
+  //! Scheduling state (see witem_notify/witem_claim/witem_release).
+  atomic_uint state;
+  //! Bytes that can be processed in the current turn (deficit round-robin).
+  long long deficit;
+  //! Forked from (NULL=not a fork, see witem_fork).
+  struct witem_t *origin;
+  //! Parsed rows pending to send (NULL=none).
+  struct batch_t *batch;
+  //! Rotated files read after this one (catch-up, see monitor_catchup).
+  vector_t catchup;
+  //! File read after the rotated files (NULL=not a rotated file).
+  struct witem_t *live;
 } witem_t;
 
 /**************************************************************************
@@ -79,6 +152,21 @@ typedef struct witem_t
  */
 extern witem_t* witem_alloc(const char *filename, witem_type_e type, void *ptr, bool seek0);
 extern void witem_free(void *obj);
+extern witem_t* witem_fork(witem_t *item, size_t pos, size_t len, size_t line);
+extern int witem_resize_buffer(witem_t *item, size_t length);
+extern size_t witem_buffers_memory(void);
+extern int witem_map(witem_t *item, off_t size, size_t window);
+extern void witem_unmap(witem_t *item);
 extern char* witem_discard_filename(const witem_t *item);
+extern char* witem_rotated_pattern(const witem_t *item);
+extern const char* witem_decompressor(const char *filename);
+extern priority_e witem_priority(const witem_t *item);
+extern bool witem_same_file(const witem_t *item, const struct stat *st);
+extern bool witem_notify(witem_t *item, bool close);
+extern bool witem_claim(witem_t *item);
+extern bool witem_yield(witem_t *item);
+extern bool witem_release(witem_t *item);
+extern void witem_drop(void *obj);
 
 #endif
+
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "slab.h"
+#include "batch.h"
+
+/*
+ * gcc -g -iquote ../src -o batch_test batch_test.c ../src/batch.c ../src/slab.c ../src/vector.c ../src/utils.c -lpthread
+ */
+
+#define NUM_ROWS 1000
+
+// auxiliary function
+static value_t value(const char *str)
+{
+  value_t ret = {str, (str == NULL ? 0 : strlen(str))};
+  return(ret);
+}
+
+// checks the content of a row appended by append_row
+static void check_row(const batch_t *batch, size_t row)
+{
+  char str[32];
+  sprintf(str, "row%zu", row);
+  assert(strcmp(batch_value(batch, row, 0), str) == 0);
+  if (row % 3 == 0) {
+    assert(batch_value(batch, row, 1) == NULL);
+  }
+  else {
+    assert(strcmp(batch_value(batch, row, 1), "") == 0);
+  }
+  sprintf(str, "%zu", row * 7);
+  assert(strcmp(batch_value(batch, row, 2), str) == 0);
+}
+
+// appends the row-th row (text, empty-or-null, number)
+static void append_row(batch_t *batch, size_t row)
+{
+  char str1[32];
+  char str3[32];
+  sprintf(str1, "row%zu", row);
+  sprintf(str3, "%zu", row * 7);
+  value_t values[3] = {value(str1), value(row % 3 == 0 ? NULL : ""), value(str3)};
+  assert(batch_append(batch, values) == 0);
+  assert(batch->num_rows == row + 1);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  (void)(argc);
+  (void)(argv);
+
+  table_t table = {0};
+  table.name = "test";
+  vector_insert(&table.parameters, "col1");
+  vector_insert(&table.parameters, "col2");
+  vector_insert(&table.parameters, "col3");
+
+  // empty batch has no storage
+  batch_t *batch = batch_alloc(&table);
+  assert(batch != NULL);
+  assert(batch->num_cols == 3);
+  assert(batch->num_rows == 0);
+  assert(batch->max_rows == 0);
+  assert(batch->offsets == NULL && batch->data == NULL);
+
+  // grow from empty
+  append_row(batch, 0);
+  assert(batch->max_rows > 0);
+  check_row(batch, 0);
+
+  // grow with rows (columns keep their values when stride changes)
+  size_t max_rows = batch->max_rows;
+  for(size_t row=1; row<NUM_ROWS; row++) {
+    append_row(batch, row);
+  }
+  assert(batch->max_rows > max_rows);
+  assert(batch->max_rows >= NUM_ROWS);
+  for(size_t row=0; row<NUM_ROWS; row++) {
+    check_row(batch, row);
+  }
+
+  // a table without parameters
+  table_t table0 = {0};
+  table0.name = "test0";
+  batch_t *batch0 = batch_alloc(&table0);
+  assert(batch_append(batch0, NULL) == 0);
+  assert(batch_append(batch0, NULL) == 0);
+  assert(batch0->num_rows == 2);
+
+  // reset (all memory is returned)
+  batch_free(batch);
+  batch_free(batch0);
+  batch_free(NULL);
+  assert(slab_used() == 0);
+
+  // batches allocated after reset start empty
+  batch = batch_alloc(&table);
+  assert(batch->num_rows == 0 && batch->max_rows == 0);
+  append_row(batch, 0);
+  check_row(batch, 0);
+  batch_free(batch);
+  assert(slab_used() == 0);
+
+  vector_reset(&table.parameters, NULL);
+  slab_reset();
+  printf("batch_test ok\n");
+  return(0);
+}
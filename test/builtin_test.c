@@ -0,0 +1,150 @@
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pcre2.h>
+#include "builtin.h"
+
+/*
+ * gcc -g -iquote ../src -o builtin_test builtin_test.c ../src/builtin.c ../src/scan.c -lpcre2-8
+ * valgrind --tool=memcheck --leak-check=yes ./builtin_test
+ */
+
+// regex versions (see conf/log2pg.conf)
+static const char *REGEX_COMBINED =
+    "^(?<hostname>[^ \\t]+)[ \\t]+"
+    "(?<identd>[^ \\t]+)[ \\t]+"
+    "(?<userid>[^ \\t]+)[ \\t]+"
+    "\\[(?<rtime>[^\\]]+)\\][ \\t]+"
+    "\"(?<request>[^\"]*)\"[ \\t]+"
+    "(?<status>[0-9-]+)[ \\t]+"
+    "(?<bytes>[0-9-]+)[ \\t]+"
+    "\"(?<referer>[^\"]*)\"[ \\t]+"
+    "\"(?<useragent>[^\"]*)\".*$";
+
+static const char *REGEX_HTTPD_ERROR =
+    "^\\[(?<rtime>[^\\]]+)\\][ \\t]+"
+    "\\[(?<loglevel>[^\\]]+)\\][ \\t]+"
+    "\\[(?<pid>[^\\]]+)\\][ \\t]+"
+    "\\[(?<ipaddress>[^\\]]+)\\][ \\t]+"
+    "(?<msg>.*)$";
+
+// sample regex accepting priority and space-padded days
+static const char *REGEX_RFC3164 =
+    "^(?:<[0-9]{1,3}>)?"
+    "(?<timestamp>[[:alpha:]]+  ?[0-9]{1,2} [0-9:]+)\\s+"
+    "(?<loghost>[^ ]+)\\s+"
+    "(?<app>[^:\\[\\s]+)[^:]*:\\s+"
+    "(?<msg>.*)$";
+
+static const char *REGEX_RFC5424 =
+    "^<(?<priority>[0-9]{1,3})>(?<version>[1-9][0-9]{0,2}) "
+    "(?<timestamp>[^ ]+) (?<hostname>[^ ]+) (?<app>[^ ]+) (?<procid>[^ ]+) (?<msgid>[^ ]+) "
+    "(?<sd>-|(?:\\[[^\\]\"]*(?:\"(?:[^\"\\\\]|\\\\.)*\"[^\\]\"]*)*\\])+)"
+    "(?: (?<msg>.*))?$";
+
+static const char *LINES_COMBINED[] = {
+  "192.168.1.2 - - [10/Jun/2018:08:43:44 +0200] \"GET /dependencies.html HTTP/1.1\" 200 20174 \"http://www.ccruncher.net/gstarted.html\" \"Mozilla/5.0 (X11; Fedora; Linux x86_64; rv:60.0) Gecko/20100101 Firefox/60.0\"\n",
+  "122.169.98.209 - - [10/Jun/2018:08:56:21 +0200] \"GET / HTTP/1.0\" 200 50 \"-\" \"-\"\n",
+  "10.0.0.1\t-\tfrank [10/Oct/2000:13:55:36 -0700] \"\" 304 - \"\" \"curl\" extra fields\n",
+  "10.0.0.1 - - [10/Oct/2000:13:55:36 -0700] \"GET / HTTP/1.0\" 2x0 50 \"-\" \"-\"\n",
+  "10.0.0.1 - - [] \"GET / HTTP/1.0\" 200 50 \"-\" \"-\"\n",
+  "10.0.0.1 - - [10/Oct/2000:13:55:36 -0700] \"GET / HTTP/1.0\" 200 50 \"-\"\n",
+  "garbage\n",
+  NULL
+};
+
+static const char *LINES_HTTPD_ERROR[] = {
+  "[Wed Oct 11 14:32:52 2000] [error] [pid 35708:tid 4328636416] [client 127.0.0.1] File does not exist: /var/www/favicon.ico\n",
+  "[Wed Oct 11 14:32:52 2000] [error] [pid 1] [client 127.0.0.1]\t  \n",
+  "[Wed Oct 11 14:32:52 2000] [error] [pid 1] AH00558: no client\n",
+  "[Wed Oct 11 14:32:52 2000] [error] [pid 1] [client 127.0.0.1]\n",
+  NULL
+};
+
+static const char *LINES_RFC3164[] = {
+  "May 20 09:43:00 fobos NetworkManager[687]: <info>  [1526802180.5062] dhcp4 (wlp3s0): state changed\n",
+  "May  2 09:43:00 fobos kernel: usb 1-1: new device\n",
+  "<34>Oct 11 22:14:15 mymachine su: 'su root' failed for lonvick on /dev/pts/8\n",
+  "May 20 09:43:00 fobos app[1]:no-space\n",
+  "May 20 09:43:00 fobos\n",
+  "20 May 09:43:00 fobos app: msg\n",
+  NULL
+};
+
+static const char *LINES_RFC5424[] = {
+  "<34>1 2003-10-11T22:14:15.003Z mymachine.example.com su - ID47 - 'su root' failed for lonvick on /dev/pts/8\n",
+  "<165>1 2003-08-24T05:14:15.000003-07:00 192.0.2.1 myproc 8710 - - %% It's time to make the do-nuts.\n",
+  "<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 [exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"][examplePriority@32473 class=\"high\"]\n",
+  "<165>1 2003-10-11T22:14:15.003Z host app - ID47 [a@1 x=\"q\\\"]\"] BOM msg\n",
+  "<165>0 2003-10-11T22:14:15.003Z host app - ID47 - msg\n",
+  "<165>1 2003-10-11T22:14:15.003Z host app - ID47 -x\n",
+  "<165>1 2003-10-11T22:14:15.003Z host app - ID47 [a@1 x=\"unterminated]\n",
+  NULL
+};
+
+// auxiliar function
+pcre2_code* compile(const char *pattern)
+{
+  int errornumber = 0;
+  PCRE2_SIZE erroroffset = 0;
+  pcre2_code *ret = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED,
+                                  PCRE2_MULTILINE|PCRE2_NO_AUTO_CAPTURE, &errornumber, &erroroffset, NULL);
+  assert(ret != NULL);
+  return(ret);
+}
+
+// compares builtin scanner against regex version
+void compare(builtin_e id, const char *pattern, const char **lines)
+{
+  pcre2_code *re = compile(pattern);
+  pcre2_match_data *md = pcre2_match_data_create_from_pattern(re, NULL);
+  const char **params = builtin_parameters(id);
+  value_t values[BUILTIN_MAX_PARAMS];
+
+  for(int i=0; lines[i]!=NULL; i++)
+  {
+    const char *str = lines[i];
+    size_t len = strlen(str);
+    int rc1 = pcre2_match(re, (PCRE2_SPTR)str, len, 0, PCRE2_NOTEMPTY, md, NULL);
+    int rc2 = builtin_extract(id, str, len, values);
+    printf("%s line %d: %s\n", builtin_name(id), i, (rc2==0?"match":"no match"));
+    assert((rc1 < 0) == (rc2 != 0));
+    if (rc2 != 0) continue;
+
+    PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(md);
+    for(int j=0; params[j]!=NULL; j++) {
+      int k = pcre2_substring_number_from_name(re, (PCRE2_SPTR) params[j]);
+      assert(k > 0);
+      if (ovector[2*k] == PCRE2_UNSET) {
+        assert(values[j].ptr == NULL);
+        continue;
+      }
+      assert(values[j].ptr == str + ovector[2*k]);
+      assert(values[j].len == ovector[2*k+1] - ovector[2*k]);
+    }
+  }
+
+  pcre2_match_data_free(md);
+  pcre2_code_free(re);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  assert(builtin_find("rfc3164") == BUILTIN_RFC3164);
+  assert(builtin_find("unknown") == BUILTIN_NONE);
+
+  compare(BUILTIN_HTTPD_COMBINED, REGEX_COMBINED, LINES_COMBINED);
+  compare(BUILTIN_NGINX_COMBINED, REGEX_COMBINED, LINES_COMBINED);
+  compare(BUILTIN_HTTPD_ERROR, REGEX_HTTPD_ERROR, LINES_HTTPD_ERROR);
+  compare(BUILTIN_RFC3164, REGEX_RFC3164, LINES_RFC3164);
+  compare(BUILTIN_RFC5424, REGEX_RFC5424, LINES_RFC5424);
+
+  printf("builtin test passed\n");
+  return(0);
+}
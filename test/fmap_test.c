@@ -0,0 +1,58 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include "fmap.h"
+
+/*
+ * gcc -g -iquote ../src -o fmap_test fmap_test.c ../src/fmap.c
+ */
+
+// sums the mapped bytes under guard (-1 if SIGBUS)
+long sum(const char *ptr, size_t len)
+{
+  sigjmp_buf env;
+  sigjmp_buf *prev = fmap_guard;
+  volatile long ret = 0;
+
+  if (sigsetjmp(env, 0) == 0) {
+    fmap_guard = &env;
+    for(size_t i=0; i<len; i++) ret += ptr[i];
+  }
+  else {
+    ret = -1;
+  }
+
+  fmap_guard = prev;
+  return(ret);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  long page = sysconf(_SC_PAGESIZE);
+  FILE *file = tmpfile();
+
+  fmap_init();
+
+  for(long i=0; i<2*page; i++) fputc(1, file);
+  fflush(file);
+
+  char *ptr = mmap(NULL, 2*page, PROT_READ, MAP_SHARED, fileno(file), 0);
+  assert(ptr != MAP_FAILED);
+  assert(sum(ptr, 2*page) == 2*page);
+
+  // truncated file raises SIGBUS beyond last page
+  assert(ftruncate(fileno(file), page/2) == 0);
+  assert(sum(ptr, page) == page/2);
+  assert(sum(ptr, 2*page) == -1);
+  assert(sum(ptr, 2*page) == -1);
+  assert(fmap_guard == NULL);
+
+  munmap(ptr, 2*page);
+  fclose(file);
+  printf("fmap_test ok\n");
+  return(0);
+}
@@ -0,0 +1,118 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <assert.h>
+#include "utils.h"
+#include "mqueue.h"
+
+#define UNUSED(x) (void)(x)
+#define NUM_MSGS 2000000
+#define BATCH_SIZE 64
+
+/*
+ * Contention benchmark: mqueue_push/pop vs mqueue_push_n/pop_n,
+ * mutex based vs lock-free.
+ * gcc -O2 -I../src -o mqueue_bench mqueue_bench.c ../src/mqueue.c ../src/ring.c ../src/utils.c -lpthread
+ * ./mqueue_bench [num-producers]
+ */
+int loglevel = 0;
+int value = 9999;
+
+typedef struct bench_t
+{
+  mqueue_t mqueue;
+  size_t num_producers;
+  size_t batch;
+} bench_t;
+
+void* producer(void *ptr)
+{
+  bench_t *bench = (bench_t *) ptr;
+  size_t num = NUM_MSGS / bench->num_producers;
+  msg_t msgs[BATCH_SIZE];
+
+  for(size_t i=0; i<BATCH_SIZE; i++) {
+    msgs[i].type = MSG_TYPE_BATCH;
+    msgs[i].data = &value;
+  }
+
+  for(size_t i=0; i<num; i+=bench->batch) {
+    if (bench->batch == 1) {
+      mqueue_push(&(bench->mqueue), MSG_TYPE_BATCH, &value, false, 0);
+    }
+    else {
+      mqueue_push_n(&(bench->mqueue), msgs, bench->batch, 0);
+    }
+  }
+  return(NULL);
+}
+
+void* consumer(void *ptr)
+{
+  bench_t *bench = (bench_t *) ptr;
+  size_t num = (NUM_MSGS / bench->num_producers) * bench->num_producers;
+  msg_t msgs[BATCH_SIZE];
+
+  for(size_t i=0; i<num; ) {
+    if (bench->batch == 1) {
+      msgs[0] = mqueue_pop(&(bench->mqueue), 0);
+      assert(msgs[0].type == MSG_TYPE_BATCH);
+      i++;
+    }
+    else {
+      i += mqueue_pop_n(&(bench->mqueue), msgs, bench->batch, 0);
+    }
+  }
+  return(NULL);
+}
+
+double run(size_t num_producers, size_t batch, bool lockfree)
+{
+  bench_t bench = {0};
+  pthread_t producers[64];
+  pthread_t thread;
+  struct timeval t1 = {0};
+  struct timeval t2 = {0};
+
+  bench.num_producers = num_producers;
+  bench.batch = batch;
+  if (lockfree) {
+    mqueue_init_lockfree(&(bench.mqueue), "bench", 4096);
+  }
+  else {
+    mqueue_init(&(bench.mqueue), "bench", 4096);
+  }
+
+  gettimeofday(&t1, NULL);
+  pthread_create(&thread, NULL, consumer, &bench);
+  for(size_t i=0; i<num_producers; i++) {
+    pthread_create(&(producers[i]), NULL, producer, &bench);
+  }
+  for(size_t i=0; i<num_producers; i++) {
+    pthread_join(producers[i], NULL);
+  }
+  pthread_join(thread, NULL);
+  gettimeofday(&t2, NULL);
+
+  mqueue_reset(&(bench.mqueue), NULL);
+  return(difftimeval(&t1, &t2));
+}
+
+int main(int argc, char *argv[])
+{
+  size_t num_producers = (argc > 1 ? strtoul(argv[1], NULL, 10) : 4);
+  assert(num_producers > 0 && num_producers <= 64);
+  UNUSED(argv);
+
+  printf("%zu producers, 1 consumer, %d messages\n", num_producers, NUM_MSGS);
+  for(int lockfree=0; lockfree<2; lockfree++) {
+    for(size_t batch=1; batch<=BATCH_SIZE; batch*=4) {
+      double secs = run(num_producers, batch, lockfree);
+      printf("%s batch=%-3zu %.3lf sec, %.2lf Mmsg/sec\n", (lockfree?"lockfree":"mutex   "), batch, secs, NUM_MSGS / secs / 1e6);
+    }
+  }
+  return(0);
+}
@@ -10,7 +10,7 @@
 #define DATA_LENGTH 100
 
 /*
- * gcc -g -I../src -o mqueue_test mqueue_test.c ../src/mqueue.c ../src/utils.c -lpthread
+ * gcc -g -I../src -o mqueue_test mqueue_test.c ../src/mqueue.c ../src/ring.c ../src/utils.c -lpthread
  * valgrind --tool=memcheck --leak-check=yes ./mqueue_test
  */
 int loglevel = 0;
@@ -189,6 +189,241 @@ void test3()
   mqueue_reset(&mqueue, NULL);
 }
 
+// push_n/pop_n without blocks
+void test4()
+{
+  mqueue_t mqueue = {0};
+  int items[DATA_LENGTH];
+  msg_t msgs[DATA_LENGTH];
+  size_t num = 0;
+
+  for(int i=0; i<DATA_LENGTH; i++) {
+    items[i] = i;
+    msgs[i].type = MSG_TYPE_FILE0;
+    msgs[i].data = &(items[i]);
+  }
+
+  printf("TEST4------------\n");
+  mqueue_init(&mqueue, "mqueue4", 50);
+
+  // bounded capacity (timeout when full)
+  num = mqueue_push_n(&mqueue, msgs, DATA_LENGTH, 100);
+  assert(num == 50);
+  assert(mqueue.length == 50);
+  assert(mqueue.capacity == 50);
+
+  num = mqueue_pop_n(&mqueue, msgs, 20, 0);
+  assert(num == 20);
+  for(int i=0; i<20; i++) {
+    assert(msgs[i].data == &(items[i]));
+  }
+  assert(mqueue.length == 30);
+
+  num = mqueue_pop_n(&mqueue, msgs, DATA_LENGTH, 0);
+  assert(num == 30);
+  assert(msgs[29].data == &(items[49]));
+  assert(mqueue.length == 0);
+
+  // timeout and close
+  num = mqueue_pop_n(&mqueue, msgs, DATA_LENGTH, 100);
+  assert(num == 0);
+  assert(msgs[0].type == MSG_TYPE_TIMEOUT);
+  mqueue_close(&mqueue);
+  num = mqueue_pop_n(&mqueue, msgs, DATA_LENGTH, 0);
+  assert(num == 0);
+  assert(msgs[0].type == MSG_TYPE_CLOSE);
+
+  mqueue_reset(&mqueue, NULL);
+}
+
+// lock-free mqueue
+void test5()
+{
+  mqueue_t mqueue = {0};
+  int items[DATA_LENGTH];
+  msg_t msgs[DATA_LENGTH];
+  msg_t msg = {0};
+  size_t num = 0;
+
+  for(int i=0; i<DATA_LENGTH; i++) {
+    items[i] = i;
+    msgs[i].type = MSG_TYPE_FILE0;
+    msgs[i].data = &(items[i]);
+  }
+
+  printf("TEST5------------\n");
+  mqueue_init_lockfree(&mqueue, "mqueue5", 50);
+  assert(mqueue.max_capacity == 64);
+
+  // unique not supported
+  assert(mqueue_push(&mqueue, MSG_TYPE_FILE0, &value, true, 0) == MSG_TYPE_ERROR);
+
+  num = mqueue_push_n(&mqueue, msgs, DATA_LENGTH, 100);
+  assert(num == 64);
+  assert(mqueue_push(&mqueue, MSG_TYPE_FILE0, &value, false, 100) == MSG_TYPE_TIMEOUT);
+
+  msg = mqueue_pop(&mqueue, 0);
+  assert(msg.type == MSG_TYPE_FILE0 && msg.data == &(items[0]));
+  num = mqueue_pop_n(&mqueue, msgs, DATA_LENGTH, 0);
+  assert(num == 63);
+  assert(msgs[62].data == &(items[63]));
+
+  // timeout and close
+  msg = mqueue_pop(&mqueue, 100);
+  assert(msg.type == MSG_TYPE_TIMEOUT);
+  assert(mqueue_push(&mqueue, MSG_TYPE_FILE0, &value, false, 0) == 0);
+  mqueue_close(&mqueue);
+  msg = mqueue_pop(&mqueue, 0);
+  assert(msg.type == MSG_TYPE_CLOSE);
+  assert(mqueue.num_incoming_msgs == 65);
+  assert(mqueue.num_delivered_msgs == 64);
+
+  mqueue_reset(&mqueue, NULL);
+
+  // blocking producer/consumer
+  pthread_t producer;
+  pthread_t consumer;
+  mqueue_init_lockfree(&mqueue, "mqueue5", 10);
+  pthread_create(&producer, NULL, test2_producer, (void*)(&mqueue));
+  pthread_create(&consumer, NULL, test2_consumer, (void*)(&mqueue));
+  pthread_join(producer, NULL);
+  pthread_join(consumer, NULL);
+  mqueue_reset(&mqueue, NULL);
+}
+
+// priority lanes
+void test6()
+{
+  mqueue_t mqueue = {0};
+  const int weights[3] = {6, 3, 1};
+  int items[3][DATA_LENGTH];
+  int counts[3] = {0};
+  msg_t msg = {0};
+
+  printf("TEST6------------\n");
+  mqueue_init_lanes(&mqueue, "mqueue6", 0, weights, 3);
+
+  // unique not supported
+  assert(mqueue_push(&mqueue, MSG_TYPE_FILE0, &value, true, 0) == MSG_TYPE_ERROR);
+
+  for(int i=0; i<DATA_LENGTH; i++) {
+    for(int j=0; j<3; j++) {
+      items[j][i] = i;
+      assert(mqueue_push_lane(&mqueue, j, MSG_TYPE_FILE0, &(items[j][i]), 0) == 0);
+    }
+  }
+  assert(mqueue_length(&mqueue) == 3*DATA_LENGTH);
+
+  // all lanes backlogged: weighted share, fifo per lane
+  for(int i=0; i<100; i++) {
+    msg = mqueue_pop(&mqueue, 0);
+    int lane = (msg.data >= (void*)items[2] ? 2 : msg.data >= (void*)items[1] ? 1 : 0);
+    assert(*((int*)msg.data) == counts[lane]);
+    counts[lane]++;
+  }
+  assert(counts[0] == 60 && counts[1] == 30 && counts[2] == 10);
+
+  // low priority lane is served when the others are empty
+  msg_t msgs[3*DATA_LENGTH];
+  assert(mqueue_pop_n(&mqueue, msgs, 3*DATA_LENGTH, 0) == 3*DATA_LENGTH-100);
+  assert(msgs[3*DATA_LENGTH-101].data == &(items[2][DATA_LENGTH-1]));
+
+  mqueue_close(&mqueue);
+  msg = mqueue_pop(&mqueue, 0);
+  assert(msg.type == MSG_TYPE_CLOSE);
+  mqueue_reset(&mqueue, NULL);
+}
+
+#define TEST7_NUM_MSGS 100000
+
+// pushes TEST7_NUM_MSGS messages to each lane (push_n and push_lane)
+void* test7_producer(void *ptr)
+{
+  mqueue_t *mqueue = (mqueue_t *) ptr;
+  msg_t msgs[10];
+  for(size_t i=0; i<10; i++) {
+    msgs[i].type = MSG_TYPE_BATCH;
+    msgs[i].data = &value;
+  }
+  for(size_t i=0; i<TEST7_NUM_MSGS/10; i++) {
+    assert(mqueue_push_n_lane(mqueue, 1, msgs, 10, 0) == 10);
+    for(size_t j=0; j<10; j++) {
+      assert(mqueue_push_lane(mqueue, 2, MSG_TYPE_BATCH, &value, 0) == 0);
+    }
+  }
+  return(NULL);
+}
+
+// lock-free priority lanes
+void test7()
+{
+  mqueue_t mqueue = {0};
+  const int weights[3] = {6, 3, 1};
+  int items[3][DATA_LENGTH];
+  int counts[3] = {0};
+  msg_t msgs[3*DATA_LENGTH];
+  msg_t msg = {0};
+
+  printf("TEST7------------\n");
+  mqueue_init_lockfree_lanes(&mqueue, "mqueue7", 100, weights, 3);
+  assert(mqueue.max_capacity == 128);
+
+  // unique not supported
+  assert(mqueue_push(&mqueue, MSG_TYPE_FILE0, &value, true, 0) == MSG_TYPE_ERROR);
+
+  // low priority lane full (others have room)
+  for(int i=0; i<DATA_LENGTH; i++) {
+    for(int j=0; j<3; j++) {
+      items[j][i] = i;
+      msgs[j*DATA_LENGTH+i] = (msg_t){MSG_TYPE_FILE0, &(items[j][i])};
+    }
+  }
+  for(int j=0; j<3; j++) {
+    assert(mqueue_push_n_lane(&mqueue, j, msgs + j*DATA_LENGTH, DATA_LENGTH, 0) == DATA_LENGTH);
+  }
+  for(int i=0; i<128-DATA_LENGTH; i++) {
+    assert(mqueue_push_lane(&mqueue, 2, MSG_TYPE_FILE0, &value, 0) == 0);
+  }
+  assert(mqueue_push_lane(&mqueue, 2, MSG_TYPE_FILE0, &value, 100) == MSG_TYPE_TIMEOUT);
+  assert(mqueue_push_lane(&mqueue, 0, MSG_TYPE_FILE0, &value, 100) == 0);
+  assert(mqueue_length(&mqueue) == 3*DATA_LENGTH+28+1);
+
+  // all lanes backlogged: weighted share, fifo per lane
+  for(int i=0; i<100; i++) {
+    msg = mqueue_pop(&mqueue, 0);
+    int lane = (msg.data >= (void*)items[2] ? 2 : msg.data >= (void*)items[1] ? 1 : 0);
+    assert(*((int*)msg.data) == counts[lane]);
+    counts[lane]++;
+  }
+  assert(counts[0] == 60 && counts[1] == 30 && counts[2] == 10);
+
+  // pop_n keeps the weighted share
+  assert(mqueue_pop_n(&mqueue, msgs, 10, 0) == 10);
+  assert(mqueue_pop_n(&mqueue, msgs, 3*DATA_LENGTH, 0) == 3*DATA_LENGTH+28+1-110);
+  assert(mqueue_pop_n(&mqueue, msgs, 3*DATA_LENGTH, 100) == 0);
+  assert(msgs[0].type == MSG_TYPE_TIMEOUT);
+
+  // blocking producer, consumer waiting on empty lanes
+  pthread_t producer;
+  pthread_create(&producer, NULL, test7_producer, (void*)(&mqueue));
+  size_t num = 0;
+  while (num < 2*TEST7_NUM_MSGS) {
+    size_t n = mqueue_pop_n(&mqueue, msgs, 64, 0);
+    assert(n > 0);
+    num += n;
+  }
+  pthread_join(producer, NULL);
+  assert(mqueue_length(&mqueue) == 0);
+  assert(mqueue.num_incoming_msgs == mqueue.num_delivered_msgs);
+
+  assert(mqueue_push_lane(&mqueue, 1, MSG_TYPE_FILE0, &value, 0) == 0);
+  mqueue_close(&mqueue);
+  msg = mqueue_pop(&mqueue, 0);
+  assert(msg.type == MSG_TYPE_CLOSE);
+  assert(mqueue_push_lane(&mqueue, 1, MSG_TYPE_FILE0, &value, 0) == MSG_TYPE_CLOSE);
+  mqueue_reset(&mqueue, NULL);
+}
+
 int main(int argc, char *argv[])
 {
   UNUSED(argc);
@@ -197,5 +432,9 @@ int main(int argc, char *argv[])
   test1();
   test2();
   test3();
+  test4();
+  test5();
+  test6();
+  test7();
   return(0);
 }
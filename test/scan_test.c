@@ -0,0 +1,54 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "scan.h"
+
+/*
+ * gcc -g -iquote ../src -o scan_test scan_test.c ../src/scan.c
+ */
+
+// reference implementation
+size_t count(const char *ptr, const char *end, char c)
+{
+  size_t ret = 0;
+  for(; ptr<end; ptr++) ret += (*ptr == c);
+  return(ret);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  char buf[1000];
+
+  srand(1);
+  for(size_t i=0; i<sizeof(buf); i++) {
+    buf[i] = "ab\n\"\\{}"[rand()%7];
+  }
+
+  // all offsets and lengths (covers unaligned heads and tails)
+  for(size_t i=0; i<64; i++) {
+    for(size_t j=i; j<sizeof(buf); j+=7) {
+      const char *ptr = buf + i;
+      const char *end = buf + j;
+      assert(scan_count(ptr, end, '\n') == count(ptr, end, '\n'));
+
+      const char *aux = ptr;
+      while(aux < end && *aux != '"' && *aux != '\\') aux++;
+      assert(scan_chr2(ptr, end, '"', '\\') == aux);
+
+      aux = ptr;
+      while(aux < end && strchr("{}", *aux) == NULL) aux++;
+      assert(scan_any(ptr, end, "{}") == aux);
+    }
+  }
+
+  // high bytes are not false positives
+  const char *str = "\x80\x8a\x0a\xff\x0b\x8a\x0a\x0a\x80";
+  assert(scan_count(str, str + strlen(str), '\n') == 3);
+  assert(scan_chr2(str, str + strlen(str), '\n', '\n') == str + 2);
+
+  printf("scan test passed\n");
+  return(0);
+}
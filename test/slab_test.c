@@ -0,0 +1,72 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include "slab.h"
+
+/*
+ * gcc -g -iquote ../src -o slab_test slab_test.c ../src/slab.c -lpthread
+ */
+
+#define NUM_BLOCKS 100000
+
+static void *blocks[NUM_BLOCKS];
+
+// frees the blocks allocated by main thread
+void* run_free(void *ptr)
+{
+  (void)(ptr);
+  for(int i=0; i<NUM_BLOCKS; i++) {
+    assert(*((int *) blocks[i]) == i);
+    slab_free(blocks[i]);
+  }
+  slab_flush();
+  return(NULL);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  (void)(argc);
+  (void)(argv);
+
+  // size classes and alignment
+  void *ptr1 = slab_alloc(1);
+  void *ptr2 = slab_alloc(33);
+  void *ptr3 = slab_alloc(100000);
+  assert(ptr1 != NULL && ptr2 != NULL && ptr3 != NULL);
+  assert(((size_t) ptr2) % sizeof(void *) == 0);
+  assert(slab_used() == 32 + 64 + 131072);
+  memset(ptr3, 'x', 100000);
+  slab_free(ptr1);
+  slab_free(ptr2);
+  slab_free(ptr3);
+  assert(slab_used() == 0);
+  assert(slab_peak() == 32 + 64 + 131072);
+
+  // freed blocks are reused
+  void *ptr4 = slab_alloc(20);
+  assert(ptr4 == ptr1);
+  slab_free(ptr4);
+
+  // blocks freed by another thread are returned to owner
+  for(int round=0; round<3; round++) {
+    for(int i=0; i<NUM_BLOCKS; i++) {
+      blocks[i] = slab_alloc(sizeof(int) + (i % 200));
+      assert(blocks[i] != NULL);
+      *((int *) blocks[i]) = i;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_free, NULL);
+    pthread_join(thread, NULL);
+    assert(slab_used() == 0);
+  }
+  // peak is bounded (blocks were recycled)
+  printf("peak = %zu bytes\n", slab_peak());
+
+  slab_reset();
+  printf("slab_test ok\n");
+  return(0);
+}
@@ -0,0 +1,118 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "structured.h"
+
+/*
+ * gcc -g -iquote ../src -o structured_test structured_test.c ../src/structured.c ../src/scan.c
+ * valgrind --tool=memcheck --leak-check=yes ./structured_test
+ */
+
+#define MAX_KEYS 8
+
+// auxiliar function
+int extract(bool json, const char *str, const char **names, value_t *values, char *scratch)
+{
+  keypath_t paths[MAX_KEYS];
+  size_t num = 0;
+
+  while(names[num] != NULL) {
+    int rc = keypath_init(paths + num, names[num]);
+    assert(rc == 0);
+    num++;
+  }
+
+  if (json) return json_extract(str, strlen(str), paths, num, values, scratch);
+  else return logfmt_extract(str, strlen(str), paths, num, values, scratch);
+}
+
+// auxiliar function
+bool equals(const value_t *value, const char *str)
+{
+  if (str == NULL) return(value->ptr == NULL);
+  if (value->ptr == NULL) return(false);
+  return(value->len == strlen(str) && strncmp(value->ptr, str, value->len) == 0);
+}
+
+void test_keypath()
+{
+  keypath_t path;
+
+  assert(keypath_init(&path, "request.method") == 0);
+  assert(path.num == 2);
+  assert(path.pos[1] == 8 && path.len[1] == 6);
+  assert(keypath_init(&path, "a..b") != 0);
+  assert(keypath_init(&path, "") != 0);
+}
+
+void test_json()
+{
+  char scratch[1024];
+  value_t values[MAX_KEYS];
+  const char *names[] = {"level", "request.method", "request.path", "count", "user", "tags", "missing", NULL};
+  const char *str = "{\"ts\":\"2018-05-20\", \"level\" : \"info\", \"skip\":{\"a\":[1,{\"level\":\"x\"}],\"b\":\"}\"},"
+                    "\"request\":{\"method\":\"GET\",\"path\":\"\\/a\\\"b\\u00e9\"},"
+                    "\"count\":42, \"user\":null, \"tags\":[\"x\",\"y\"]}";
+
+  assert(extract(true, str, names, values, scratch) == 0);
+  assert(equals(values+0, "info"));
+  assert(equals(values+1, "GET"));
+  assert(equals(values+2, "/a\"b\xC3\xA9"));
+  assert(equals(values+3, "42"));
+  assert(equals(values+4, NULL));
+  assert(equals(values+5, "[\"x\",\"y\"]"));
+  assert(equals(values+6, NULL));
+
+  // object requested as raw value and as container
+  const char *names2[] = {"request", "request.method", NULL};
+  assert(extract(true, str, names2, values, scratch) == 0);
+  assert(equals(values+0, "{\"method\":\"GET\",\"path\":\"\\/a\\\"b\\u00e9\"}"));
+  assert(equals(values+1, "GET"));
+
+  // parsing stops inside a nested object (trailing content is not parsed)
+  const char *names4[] = {"request.method", NULL};
+  assert(extract(true, "{\"request\":{\"method\":\"PUT\",\"x\":!!}, garbage", names4, values, scratch) == 0);
+  assert(equals(values+0, "PUT"));
+
+  // surrogate pairs
+  const char *names3[] = {"s", NULL};
+  assert(extract(true, "{\"s\":\"\\ud83d\\ude00\"}", names3, values, scratch) == 0);
+  assert(equals(values+0, "\xF0\x9F\x98\x80"));
+
+  // malformed content
+  assert(extract(true, "not json", names, values, scratch) != 0);
+  assert(extract(true, "{\"level\":\"info", names, values, scratch) != 0);
+  assert(extract(true, "{\"a\" 1}", names, values, scratch) != 0);
+}
+
+void test_logfmt()
+{
+  char scratch[1024];
+  value_t values[MAX_KEYS];
+  const char *names[] = {"level", "msg", "req.id", "debug", "empty", "missing", NULL};
+  const char *str = "ts=2018-05-20 level=info msg=\"hello \\\"world\\\"\" req.id=7 debug empty=";
+
+  assert(extract(false, str, names, values, scratch) == 0);
+  assert(equals(values+0, "info"));
+  assert(equals(values+1, "hello \"world\""));
+  assert(equals(values+2, "7"));
+  assert(equals(values+3, "true"));
+  assert(equals(values+4, ""));
+  assert(equals(values+5, NULL));
+
+  // malformed content
+  assert(extract(false, "msg=\"unterminated", names, values, scratch) != 0);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  test_keypath();
+  test_json();
+  test_logfmt();
+  printf("structured test passed\n");
+  return(0);
+}
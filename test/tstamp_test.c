@@ -0,0 +1,109 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <assert.h>
+#include "tstamp.h"
+
+/*
+ * gcc -g -iquote ../src -o tstamp_test tstamp_test.c ../src/tstamp.c
+ * valgrind --tool=memcheck --leak-check=yes ./tstamp_test
+ */
+
+// auxiliar function
+void check(tstamp_t *obj, const char *str, time_t now, const char *expected)
+{
+  value_t value = {0};
+  int rc = tstamp_parse(obj, str, strlen(str), now, &value);
+
+  if (expected == NULL) {
+    assert(rc != 0);
+    return;
+  }
+
+  printf("%s -> %.*s\n", str, (int) value.len, value.ptr);
+  assert(rc == 0);
+  assert(value.len == strlen(expected));
+  assert(strncmp(value.ptr, expected, value.len) == 0);
+}
+
+void test_clf()
+{
+  tstamp_t obj;
+  tstamp_init(&obj, tstamp_layout_find("clf"));
+
+  check(&obj, "10/Jun/2018:08:43:44 +0200", 0, "2018-06-10 08:43:44+02:00");
+  check(&obj, "10/Jun/2018:08:43:59 +0200", 0, "2018-06-10 08:43:59+02:00");
+  check(&obj, "10/Jun/2018:08:44:01 +0200", 0, "2018-06-10 08:44:01+02:00");
+  check(&obj, "10/Jun/2018:08:44:01 -0730", 0, "2018-06-10 08:44:01-07:30");
+  check(&obj, "10/Jun/2018:08:44:7x -0730", 0, NULL);
+  check(&obj, "31/Jun/2018:08:44:01 +0200", 0, NULL);
+  check(&obj, "10/Jun/2018:08:44:02 +0200", 0, "2018-06-10 08:44:02+02:00");
+}
+
+void test_iso8601()
+{
+  tstamp_t obj;
+  tstamp_init(&obj, tstamp_layout_find("iso8601"));
+
+  check(&obj, "2018-06-10T08:43:44Z", 0, "2018-06-10 08:43:44+00:00");
+  check(&obj, "2018-06-10T08:43:45Z", 0, "2018-06-10 08:43:45+00:00");
+  check(&obj, "2018-06-10 08:43:44.123+0200", 0, "2018-06-10 08:43:44.123+02:00");
+  check(&obj, "2018-06-10 08:43:46,456+0200", 0, "2018-06-10 08:43:46.456+02:00");
+  check(&obj, "2018-06-10T08:43:44.5-03:30", 0, "2018-06-10 08:43:44.5-03:30");
+  check(&obj, "2018-06-10T08:43:44", 0, "2018-06-10 08:43:44");
+  check(&obj, "2016-02-29T00:00:00+01", 0, "2016-02-29 00:00:00+01:00");
+  check(&obj, "2018-02-29T00:00:00", 0, NULL);
+  check(&obj, "2018-06-10T08:43:44+2", 0, NULL);
+  check(&obj, "2018-06-10", 0, NULL);
+}
+
+void test_syslog()
+{
+  tstamp_t obj;
+  tstamp_init(&obj, tstamp_layout_find("syslog"));
+
+  struct tm tm = {0};
+  tm.tm_year = 2019 - 1900;
+  tm.tm_mon = 0;
+  tm.tm_mday = 2;
+  tm.tm_hour = 12;
+  time_t now = mktime(&tm);
+
+  check(&obj, "Dec 31 23:59:58", now, "2018-12-31 23:59:58");
+  check(&obj, "Dec 31 23:59:59", now, "2018-12-31 23:59:59");
+  check(&obj, "Jan  1 00:00:00", now, "2019-01-01 00:00:00");
+  check(&obj, "Feb 1 00:00:00", now, "2019-02-01 00:00:00");
+  check(&obj, "Feb 29 00:00:00", now, NULL);
+  check(&obj, "Foo 10 00:00:00", now, NULL);
+}
+
+void test_epoch()
+{
+  tstamp_t obj;
+  tstamp_init(&obj, tstamp_layout_find("epoch"));
+
+  check(&obj, "1526802180", 0, "2018-05-20 07:43:00+00:00");
+  check(&obj, "1526802181.5062", 0, "2018-05-20 07:43:01.5062+00:00");
+  check(&obj, "1526802240", 0, "2018-05-20 07:44:00+00:00");
+  check(&obj, "15268x", 0, NULL);
+
+  tstamp_init(&obj, tstamp_layout_find("epoch_ms"));
+  check(&obj, "1526802180007", 0, "2018-05-20 07:43:00.007+00:00");
+  check(&obj, "1526802239999", 0, "2018-05-20 07:43:59.999+00:00");
+  check(&obj, "1526802180.5", 0, NULL);
+}
+
+// main function
+int main(int argc, char *argv[])
+{
+  assert(tstamp_layout_find("unknown") == TSTAMP_NONE);
+  test_clf();
+  test_iso8601();
+  test_syslog();
+  test_epoch();
+  printf("tstamp test passed\n");
+  return(0);
+}